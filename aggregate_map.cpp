@@ -0,0 +1,375 @@
+#include "aggregate_map.hpp"
+
+PyMethodDef *pystdcxx_aggregate_map::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "clear",        (PyCFunction)pystdcxx_aggregate_map::clear,        METH_NOARGS,  "Clear all items" },
+        { "range_sum",    (PyCFunction)pystdcxx_aggregate_map::range_sum,    METH_VARARGS, "Sum of values with key in [lower, upper), exact if they are all int64 ints" },
+        { "range_min",    (PyCFunction)pystdcxx_aggregate_map::range_min,    METH_VARARGS, "Minimum value with key in [lower, upper), None if empty" },
+        { "range_max",    (PyCFunction)pystdcxx_aggregate_map::range_max,    METH_VARARGS, "Maximum value with key in [lower, upper), None if empty" },
+        { "range_count",  (PyCFunction)pystdcxx_aggregate_map::range_count,  METH_VARARGS, "Number of items with key in [lower, upper)" },
+        { "prefix_sum",   (PyCFunction)pystdcxx_aggregate_map::prefix_sum,   METH_O,       "Sum of values with key less than key, exact if they are all int64 ints" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+int pystdcxx_aggregate_map::tp_init(pystdcxx_aggregate_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr, *less = nullptr;
+    static const char *kwlist[] = { "tuple", "less", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$O", const_cast<char **>(kwlist), &tuple, &less))
+        return -1;
+
+    if (less) {
+        if (PyCallable_Check(less)) {
+            self->less = py_ptr<PyObject>(less, true);
+            self->maintain_tracking(less);
+            try {
+                self->reset(new aggregate_tree(py_less(self->less)));
+            } catch (std::exception &e) {
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+                return -1;
+            }
+        } else if (!Py_IsNone(less)) {
+            PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
+            return -1;
+        }
+    }
+
+    if (tuple) {
+        try {
+            if (py_tuple_check(tuple)) {
+                py_tuple_for_each(tuple, [self] (PyObject *item) {
+                    PyObject *key = py_tuple_get_item(item, 0);
+                    PyObject *value = py_tuple_get_item(item, 1);
+                    if (!key || !value)
+                        throw std::runtime_error("Invalie key/value pair");
+                    if (mp_ass_subscript(self, key, value) < 0)
+                        throw std::runtime_error("Insert item error");
+                });
+            } else {
+                PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+                return -1;
+            }
+        } catch (std::exception &e) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+PyObject *pystdcxx_aggregate_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) pystdcxx_aggregate_map());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create aggregate map object failure");
+        return nullptr;
+    }
+}
+
+static int traverse_nodes(const aggregate_tree::node *n, visitproc visit, void *arg)
+{
+    if (!n)
+        return 0;
+
+    Py_VISIT(n->key.get());
+    Py_VISIT(n->value.get());
+
+    int result = traverse_nodes(n->left, visit, arg);
+    if (result)
+        return result;
+
+    return traverse_nodes(n->right, visit, arg);
+}
+
+int pystdcxx_aggregate_map::tp_traverse(pystdcxx_aggregate_map *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (self->less.get())
+        Py_VISIT(self->less.get());
+
+    if (self->tree->key_comp().less.get())
+        Py_VISIT(self->tree->key_comp().less.get());
+
+    return traverse_nodes(self->tree->root(), visit, arg);
+}
+
+// Swap in a new tree and free the old nodes afterwards, since releasing
+// keys and values may run arbitrary code which uses this map.
+void pystdcxx_aggregate_map::reset(aggregate_tree *tree)
+{
+    std::unique_ptr<aggregate_tree> old(tree);
+    old.swap(this->tree);
+    ++version;
+}
+
+int pystdcxx_aggregate_map::tp_clear(pystdcxx_aggregate_map *self)
+{
+    aggregate_tree::node *root = self->tree->release();
+    py_ptr<PyObject> less(self->less.release());
+    ++self->version;
+    aggregate_tree::destroy(root);
+    return 0;
+}
+
+PyObject *pystdcxx_aggregate_map::tp_repr(pystdcxx_aggregate_map *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        std::vector<const aggregate_tree::node *> stack;
+        const aggregate_tree::node *n = self->tree->root();
+        while (n || !stack.empty()) {
+            for (; n; n = n->left)
+                stack.push_back(n);
+
+            n = stack.back();
+            stack.pop_back();
+
+            repr += comma;
+            repr += "(";
+            repr += py_repr(n->key.get());
+            repr += ", ";
+            repr += py_repr(n->value.get());
+            repr += ")";
+            comma = ", ";
+
+            n = n->right;
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_aggregate_map::tp_iter(pystdcxx_aggregate_map *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_aggregate_map::mp_length(pystdcxx_aggregate_map *self)
+{
+    return self->tree->size();
+}
+
+PyObject *pystdcxx_aggregate_map::mp_subscript(pystdcxx_aggregate_map *self, PyObject *key)
+{
+    try {
+        const aggregate_tree::node *n = self->tree->find(py_ptr<PyObject>(key, true));
+        if (!n) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+
+        PyObject *value = n->value.get();
+        Py_INCREF(value);
+        return value;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+// Convert a value to a number, an int which fits in int64 is kept exactly
+static bool to_numeric(PyObject *value, aggregate_tree::numeric &number)
+{
+    number.exact = false;
+    if (PyLong_Check(value)) {
+        int overflow;
+        long long n = PyLong_AsLongLongAndOverflow(value, &overflow);
+        if (n == -1 && PyErr_Occurred())
+            return false;
+
+        if (!overflow) {
+            number.real = static_cast<double>(n);
+            number.integer = n;
+            number.exact = true;
+            return true;
+        }
+    }
+
+    number.real = PyFloat_AsDouble(value);
+    return !(number.real == -1.0 && PyErr_Occurred());
+}
+
+// Sum of an aggregate, an int if every value in it is an exact int
+static PyObject *make_sum(const aggregate_tree::aggregate &result)
+{
+    if (result.inexact)
+        return PyFloat_FromDouble(result.sum);
+
+    __int128 sum = result.exact_sum;
+    if (sum >= INT64_MIN && sum <= INT64_MAX)
+        return PyLong_FromLongLong(static_cast<long long>(sum));
+
+    // high * 2**64 + low, high keeps the sign
+    py_ptr<PyObject> high(PyLong_FromLongLong(static_cast<long long>(sum >> 64)));
+    py_ptr<PyObject> low(PyLong_FromUnsignedLongLong(static_cast<unsigned long long>(sum)));
+    py_ptr<PyObject> bits(PyLong_FromLong(64));
+    if (!high.get() || !low.get() || !bits.get())
+        return nullptr;
+
+    py_ptr<PyObject> shifted(PyNumber_Lshift(high.get(), bits.get()));
+    if (!shifted.get())
+        return nullptr;
+
+    return PyNumber_Add(shifted.get(), low.get());
+}
+
+int pystdcxx_aggregate_map::mp_ass_subscript(pystdcxx_aggregate_map *self, PyObject *key, PyObject *value)
+{
+    try {
+        if (!value) {
+            aggregate_tree::node *erased = self->tree->erase(py_ptr<PyObject>(key, true));
+            if (!erased) {
+                PyErr_SetString(PyExc_KeyError, "Key error");
+                return -1;
+            }
+            ++self->version;
+            aggregate_tree::destroy(erased);
+        } else {
+            aggregate_tree::numeric number;
+            if (!to_numeric(value, number))
+                return -1;
+
+            py_ptr<PyObject> old;
+            if (self->tree->insert(py_ptr<PyObject>(key, true), py_ptr<PyObject>(value, true), number, old))
+                ++self->version;
+            self->maintain_tracking(key);
+            self->maintain_tracking(value);
+        }
+
+        return 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+PyObject *pystdcxx_aggregate_map::clear(pystdcxx_aggregate_map *self, PyObject *Py_UNUSED(args))
+{
+    aggregate_tree::node *root = self->tree->release();
+    if (root)
+        ++self->version;
+    aggregate_tree::destroy(root);
+    Py_RETURN_NONE;
+}
+
+// Parse (lower, upper) where None means unbounded and run the query
+bool pystdcxx_aggregate_map::query(PyObject *args, aggregate_tree::aggregate &result)
+{
+    PyObject *lower = Py_None, *upper = Py_None;
+    if (!PyArg_ParseTuple(args, "|OO", &lower, &upper))
+        return false;
+
+    try {
+        py_ptr<PyObject> lower_key(lower, true), upper_key(upper, true);
+        result = tree->query(Py_IsNone(lower) ? nullptr : std::addressof(lower_key),
+                             Py_IsNone(upper) ? nullptr : std::addressof(upper_key));
+        return true;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return false;
+    }
+}
+
+PyObject *pystdcxx_aggregate_map::range_sum(pystdcxx_aggregate_map *self, PyObject *args)
+{
+    aggregate_tree::aggregate result;
+    if (!self->query(args, result))
+        return nullptr;
+
+    return make_sum(result);
+}
+
+PyObject *pystdcxx_aggregate_map::range_min(pystdcxx_aggregate_map *self, PyObject *args)
+{
+    aggregate_tree::aggregate result;
+    if (!self->query(args, result))
+        return nullptr;
+
+    if (!result.min)
+        Py_RETURN_NONE;
+
+    Py_INCREF(result.min->value.get());
+    return result.min->value.get();
+}
+
+PyObject *pystdcxx_aggregate_map::range_max(pystdcxx_aggregate_map *self, PyObject *args)
+{
+    aggregate_tree::aggregate result;
+    if (!self->query(args, result))
+        return nullptr;
+
+    if (!result.max)
+        Py_RETURN_NONE;
+
+    Py_INCREF(result.max->value.get());
+    return result.max->value.get();
+}
+
+PyObject *pystdcxx_aggregate_map::range_count(pystdcxx_aggregate_map *self, PyObject *args)
+{
+    aggregate_tree::aggregate result;
+    if (!self->query(args, result))
+        return nullptr;
+
+    return PyLong_FromSize_t(result.count);
+}
+
+PyObject *pystdcxx_aggregate_map::prefix_sum(pystdcxx_aggregate_map *self, PyObject *key)
+{
+    try {
+        py_ptr<PyObject> upper(key, true);
+        return make_sum(self->tree->query(nullptr, std::addressof(upper)));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_aggregate_map::iterator::tp_iter(pystdcxx_aggregate_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_aggregate_map::iterator::tp_iternext(pystdcxx_aggregate_map::iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+        return nullptr;
+    }
+
+    if (self->stack.empty())
+        return nullptr;
+
+    const aggregate_tree::node *n = self->stack.back();
+    self->stack.pop_back();
+    self->push_left(n->right);
+
+    return PyTuple_Pack(2, n->key.get(), n->value.get());
+}
@@ -0,0 +1,386 @@
+#ifndef PYSTDCXX_AGGREGATE_MAP_HPP
+#define PYSTDCXX_AGGREGATE_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "utils.hpp"
+
+// AVL tree whose nodes cache count, sum, min and max of the numeric values
+// in their subtree, so aggregates over a key range are answered by walking
+// two root to leaf paths instead of visiting every item in the range.
+//
+// Ints which fit in int64 are also summed exactly in 128 bits, which can't
+// overflow however many items there are. A sum over such ints only is
+// exact, once a float or a bigger int is in the range the sum is a double
+// and loses precision beyond 2**53.
+class aggregate_tree
+{
+public:
+    struct node;
+
+    // Numeric value of an item, integer is valid only if exact is true
+    struct numeric
+    {
+        double real;
+        int64_t integer;
+        bool exact;
+    };
+
+    struct aggregate
+    {
+        aggregate(): count(0), inexact(0), sum(0.0), exact_sum(0), min(nullptr), max(nullptr) {}
+
+        void add(const node *n)
+        {
+            ++count;
+            sum += n->number.real;
+            if (n->number.exact)
+                exact_sum += n->number.integer;
+            else
+                ++inexact;
+            if (!min || less(n, min))
+                min = n;
+            if (!max || less(max, n))
+                max = n;
+        }
+
+        void add(const aggregate &rhs)
+        {
+            count += rhs.count;
+            inexact += rhs.inexact;
+            sum += rhs.sum;
+            exact_sum += rhs.exact_sum;
+            if (rhs.min && (!min || less(rhs.min, min)))
+                min = rhs.min;
+            if (rhs.max && (!max || less(max, rhs.max)))
+                max = rhs.max;
+        }
+
+        size_t count;
+        size_t inexact;             // Values not summed in exact_sum
+        double sum;
+        __int128 exact_sum;
+        const node *min, *max;
+    };
+
+    struct node
+    {
+        node(const py_ptr<PyObject> &key, const py_ptr<PyObject> &value, const numeric &number):
+            key(key), value(value), number(number), left(nullptr), right(nullptr), height(1)
+        {
+            total.add(this);
+        }
+
+        py_ptr<PyObject> key;
+        py_ptr<PyObject> value;
+        numeric number;
+        node *left, *right;
+        int height;
+        aggregate total;
+    };
+
+    explicit aggregate_tree(const py_less &less): root_(nullptr), less_(less) {}
+    aggregate_tree(const aggregate_tree &) = delete;
+    aggregate_tree &operator=(const aggregate_tree &) = delete;
+
+    ~aggregate_tree()
+    {
+        destroy(root_);
+    }
+
+    const py_less &key_comp() const { return less_; }
+    const node *root() const { return root_; }
+    size_t size() const { return root_ ? root_->total.count : 0; }
+
+    const node *find(const py_ptr<PyObject> &key) const
+    {
+        node *n = root_;
+        while (n) {
+            if (less_(key, n->key))
+                n = n->left;
+            else if (less_(n->key, key))
+                n = n->right;
+            else
+                break;
+        }
+
+        return n;
+    }
+
+    // Insert or replace, return true if key is new. The replaced value is
+    // handed back through old so it's released after the tree is consistent.
+    bool insert(const py_ptr<PyObject> &key, const py_ptr<PyObject> &value, const numeric &number, py_ptr<PyObject> &old)
+    {
+        bool inserted = false;
+        root_ = insert(root_, key, value, number, inserted, old);
+        return inserted;
+    }
+
+    // Erase key, return the unlinked node which should be deleted by caller
+    // once the tree is consistent, or nullptr if key doesn't exist.
+    node *erase(const py_ptr<PyObject> &key)
+    {
+        node *erased = nullptr;
+        root_ = erase(root_, key, erased);
+        return erased;
+    }
+
+    node *release()
+    {
+        node *n = root_;
+        root_ = nullptr;
+        return n;
+    }
+
+    // Aggregate over keys in [lower, upper), nullptr means unbounded
+    aggregate query(const py_ptr<PyObject> *lower, const py_ptr<PyObject> *upper) const
+    {
+        aggregate result;
+
+        const node *n = root_;
+        while (n) {
+            if (lower && less_(n->key, *lower))
+                n = n->right;
+            else if (upper && !less_(n->key, *upper))
+                n = n->left;
+            else
+                break;
+        }
+
+        if (!n)
+            return result;
+
+        for (const node *l = n->left; l;) {
+            if (lower && less_(l->key, *lower)) {
+                l = l->right;
+            } else {
+                if (l->right)
+                    result.add(l->right->total);
+                result.add(l);
+                l = l->left;
+            }
+        }
+
+        result.add(n);
+
+        for (const node *r = n->right; r;) {
+            if (upper && !less_(r->key, *upper)) {
+                r = r->left;
+            } else {
+                if (r->left)
+                    result.add(r->left->total);
+                result.add(r);
+                r = r->right;
+            }
+        }
+
+        return result;
+    }
+
+    static void destroy(node *n)
+    {
+        if (!n)
+            return;
+
+        destroy(n->left);
+        destroy(n->right);
+        delete n;
+    }
+
+private:
+    static int height(const node *n) { return n ? n->height : 0; }
+
+    // Exact ints are compared exactly, doubles can't tell big ones apart
+    static bool less(const node *a, const node *b)
+    {
+        if (a->number.exact && b->number.exact)
+            return a->number.integer < b->number.integer;
+        return a->number.real < b->number.real;
+    }
+
+    static void update(node *n)
+    {
+        n->height = 1 + std::max(height(n->left), height(n->right));
+        n->total = aggregate();
+        if (n->left)
+            n->total.add(n->left->total);
+        n->total.add(n);
+        if (n->right)
+            n->total.add(n->right->total);
+    }
+
+    static node *rotate_right(node *n)
+    {
+        node *l = n->left;
+        n->left = l->right;
+        l->right = n;
+        update(n);
+        update(l);
+        return l;
+    }
+
+    static node *rotate_left(node *n)
+    {
+        node *r = n->right;
+        n->right = r->left;
+        r->left = n;
+        update(n);
+        update(r);
+        return r;
+    }
+
+    static node *balance(node *n)
+    {
+        update(n);
+
+        int factor = height(n->left) - height(n->right);
+        if (factor > 1) {
+            if (height(n->left->left) < height(n->left->right))
+                n->left = rotate_left(n->left);
+            return rotate_right(n);
+        } else if (factor < -1) {
+            if (height(n->right->right) < height(n->right->left))
+                n->right = rotate_right(n->right);
+            return rotate_left(n);
+        }
+
+        return n;
+    }
+
+    // Comparisons are only made on the way down, so an exception raised
+    // by the comparator leaves the tree untouched.
+    node *insert(node *n, const py_ptr<PyObject> &key, const py_ptr<PyObject> &value, const numeric &number,
+                 bool &inserted, py_ptr<PyObject> &old)
+    {
+        if (!n) {
+            inserted = true;
+            return new node(key, value, number);
+        }
+
+        if (less_(key, n->key)) {
+            n->left = insert(n->left, key, value, number, inserted, old);
+        } else if (less_(n->key, key)) {
+            n->right = insert(n->right, key, value, number, inserted, old);
+        } else {
+            old = n->value;
+            n->value = value;
+            n->number = number;
+        }
+
+        return balance(n);
+    }
+
+    static node *remove_min(node *n, node *&min)
+    {
+        if (!n->left) {
+            min = n;
+            return n->right;
+        }
+
+        n->left = remove_min(n->left, min);
+        return balance(n);
+    }
+
+    node *erase(node *n, const py_ptr<PyObject> &key, node *&erased)
+    {
+        if (!n)
+            return nullptr;
+
+        if (less_(key, n->key)) {
+            n->left = erase(n->left, key, erased);
+        } else if (less_(n->key, key)) {
+            n->right = erase(n->right, key, erased);
+        } else {
+            erased = n;
+            node *left = n->left, *right = n->right;
+            n->left = n->right = nullptr;
+            if (!right)
+                return left;
+
+            node *min = nullptr;
+            right = remove_min(right, min);
+            min->left = left;
+            min->right = right;
+            return balance(min);
+        }
+
+        return balance(n);
+    }
+
+    node *root_;
+    py_less less_;
+};
+
+class pystdcxx_aggregate_map: public py_object<pystdcxx_aggregate_map>
+{
+public:
+    pystdcxx_aggregate_map(): version(0), tree(new aggregate_tree(py_less(py_ptr<PyObject>())))
+    {
+        maintain_tracking();
+    }
+
+    ~pystdcxx_aggregate_map()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static const char *tp_name() { return "pystdcxx.aggregate_map"; }
+    static const char *tp_doc() { return "Ordered map of numeric values with O(log n) range aggregates"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(pystdcxx_aggregate_map *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_aggregate_map *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_aggregate_map *self);
+    static PyObject *tp_repr(pystdcxx_aggregate_map *self);
+    static PyObject *tp_iter(pystdcxx_aggregate_map *self);
+    static Py_ssize_t mp_length(pystdcxx_aggregate_map *self);
+    static PyObject *mp_subscript(pystdcxx_aggregate_map *self, PyObject *key);
+    static int mp_ass_subscript(pystdcxx_aggregate_map *self, PyObject *key, PyObject *value);
+    static PyObject *clear(pystdcxx_aggregate_map *self, PyObject *args);
+    static PyObject *range_sum(pystdcxx_aggregate_map *self, PyObject *args);
+    static PyObject *range_min(pystdcxx_aggregate_map *self, PyObject *args);
+    static PyObject *range_max(pystdcxx_aggregate_map *self, PyObject *args);
+    static PyObject *range_count(pystdcxx_aggregate_map *self, PyObject *args);
+    static PyObject *prefix_sum(pystdcxx_aggregate_map *self, PyObject *key);
+
+private:
+    bool query(PyObject *args, aggregate_tree::aggregate &result);
+    void reset(aggregate_tree *tree);
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_aggregate_map *owner):
+            owner(owner, true),
+            version(owner->version)
+        {
+            push_left(owner->tree->root());
+        }
+
+        static const char *tp_name() { return "pystdcxx.aggregate_map_iterator"; }
+        static const char *tp_doc() { return "In order iterator of aggregate map"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        void push_left(const aggregate_tree::node *n)
+        {
+            for (; n; n = n->left)
+                stack.push_back(n);
+        }
+
+        py_ptr<pystdcxx_aggregate_map> owner;
+        uint32_t version;
+        std::vector<const aggregate_tree::node *> stack;
+    };
+
+    unsigned int version;
+    std::unique_ptr<aggregate_tree> tree;
+    py_ptr<PyObject> less;
+};
+
+#endif // PYSTDCXX_AGGREGATE_MAP_HPP
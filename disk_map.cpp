@@ -0,0 +1,1212 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "disk_map.hpp"
+
+disk_run::~disk_run()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+std::shared_ptr<disk_run> disk_run::open(const std::string &path, uint64_t seq)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Open run file error");
+
+    std::shared_ptr<disk_run> run(new disk_run(path, seq, fd));
+
+    // Rebuild the sparse index of a run written by an earlier session
+    disk_run_reader reader(run, 0);
+    std::string key;
+    disk_record record;
+    for (size_t count = 0; ; ++count) {
+        uint64_t offset = reader.tell();
+        if (!reader.next(key, record))
+            break;
+        if (count % index_interval == 0)
+            run->index_.push_back({ key, offset });
+    }
+
+    run->bytes_ = reader.tell();
+    return run;
+}
+
+bool disk_run::get(const std::string &key, disk_record &record) const
+{
+    std::vector<index_entry>::const_iterator iter = std::upper_bound(index_.begin(), index_.end(), key,
+        [] (const std::string &k, const index_entry &entry) { return k < entry.key; });
+    if (iter == index_.begin())
+        return false;
+
+    disk_run_reader reader(shared_from_this(), (--iter)->offset);
+    std::string k;
+    for (int i = 0; i < index_interval && reader.next(k, record); ++i) {
+        if (k == key)
+            return true;
+        if (key < k)
+            break;
+    }
+
+    return false;
+}
+
+uint64_t disk_run::seek(const std::string &key) const
+{
+    std::vector<index_entry>::const_iterator iter = std::lower_bound(index_.begin(), index_.end(), key,
+        [] (const index_entry &entry, const std::string &k) { return entry.key < k; });
+    if (iter == index_.begin())
+        return 0;
+
+    return (--iter)->offset;
+}
+
+bool disk_run_reader::fill(size_t n)
+{
+    while (buffer_.size() - pos_ < n) {
+        if (pos_) {
+            buffer_.erase(0, pos_);
+            pos_ = 0;
+        }
+
+        size_t size = buffer_.size();
+        size_t want = std::max<size_t>(n - size, 64 * 1024);
+        buffer_.resize(size + want);
+        ssize_t result = ::pread(run_->fd(), &buffer_[size], want, offset_);
+        buffer_.resize(size + std::max<ssize_t>(result, 0));
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Read run file error");
+        }
+
+        if (result == 0)
+            return false;
+
+        offset_ += result;
+    }
+
+    return true;
+}
+
+uint32_t disk_run_reader::get_u32()
+{
+    uint32_t n;
+    std::memcpy(&n, buffer_.data() + pos_, sizeof(n));
+    pos_ += sizeof(n);
+    return n;
+}
+
+bool disk_run_reader::next(std::string &key, disk_record &record)
+{
+    if (!fill(sizeof(uint32_t))) {
+        if (buffer_.size() != pos_)
+            throw std::runtime_error("Corrupted run file");
+        return false;
+    }
+
+    uint32_t key_size = get_u32();
+    if (!fill(key_size + 1 + sizeof(uint32_t)))
+        throw std::runtime_error("Corrupted run file");
+
+    key.assign(buffer_, pos_, key_size);
+    pos_ += key_size;
+    record.tombstone = buffer_[pos_++] != 0;
+
+    uint32_t value_size = get_u32();
+    if (!fill(value_size))
+        throw std::runtime_error("Corrupted run file");
+
+    record.value.assign(buffer_, pos_, value_size);
+    pos_ += value_size;
+    return true;
+}
+
+disk_run_writer::disk_run_writer(const std::string &path, uint64_t seq):
+    path_(path),
+    tmp_(path + ".tmp"),
+    seq_(seq),
+    file_(std::fopen(tmp_.c_str(), "wb")),
+    offset_(0),
+    count_(0)
+{
+    if (!file_)
+        throw std::runtime_error("Create run file error");
+}
+
+disk_run_writer::~disk_run_writer()
+{
+    if (file_) {
+        std::fclose(file_);
+        ::unlink(tmp_.c_str());
+    }
+}
+
+void disk_run_writer::put_u32(uint32_t n)
+{
+    std::fwrite(&n, sizeof(n), 1, file_);
+}
+
+void disk_run_writer::add(const std::string &key, const disk_record &record)
+{
+    if (count_ % disk_run::index_interval == 0)
+        index_.push_back({ key, offset_ });
+
+    put_u32(key.size());
+    std::fwrite(key.data(), 1, key.size(), file_);
+    std::fputc(record.tombstone ? 1 : 0, file_);
+    put_u32(record.value.size());
+    std::fwrite(record.value.data(), 1, record.value.size(), file_);
+    if (std::ferror(file_))
+        throw std::runtime_error("Write run file error");
+
+    offset_ += sizeof(uint32_t) * 2 + 1 + key.size() + record.value.size();
+    ++count_;
+}
+
+std::shared_ptr<disk_run> disk_run_writer::finish()
+{
+    bool failed = std::fflush(file_) != 0 || ::fsync(fileno(file_)) != 0;
+    failed = std::fclose(file_) != 0 || failed;
+    file_ = nullptr;
+
+    if (failed || ::rename(tmp_.c_str(), path_.c_str()) != 0) {
+        ::unlink(tmp_.c_str());
+        throw std::runtime_error("Write run file error");
+    }
+
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Open run file error");
+
+    std::shared_ptr<disk_run> run(new disk_run(path_, seq_, fd));
+    run->bytes_ = offset_;
+    run->index_.swap(index_);
+    return run;
+}
+
+disk_merger::disk_merger(const disk_memtable *memtable, const disk_tables &tables,
+                         const std::vector<std::shared_ptr<disk_run>> &runs, const std::string *lower)
+{
+    sources_.reserve(runs.size() + tables.size() + 1);
+
+    if (memtable) {
+        sources_.emplace_back();
+        source &s = sources_.back();
+        s.first = lower ? memtable->lower_bound(*lower) : memtable->begin();
+        s.last = memtable->end();
+        advance(s);
+    }
+
+    for (const std::shared_ptr<const disk_memtable> &table: tables) {
+        sources_.emplace_back();
+        source &s = sources_.back();
+        s.table = table;
+        s.first = lower ? table->lower_bound(*lower) : table->begin();
+        s.last = table->end();
+        advance(s);
+    }
+
+    for (const std::shared_ptr<disk_run> &run: runs) {
+        sources_.emplace_back();
+        source &s = sources_.back();
+        s.reader.reset(new disk_run_reader(run, lower ? run->seek(*lower) : 0));
+        do {
+            advance(s);
+        } while (s.valid && lower && s.key < *lower);
+    }
+}
+
+void disk_merger::advance(source &s)
+{
+    if (s.reader) {
+        s.valid = s.reader->next(s.key, s.record);
+    } else if (s.first != s.last) {
+        s.key = s.first->first;
+        s.record = s.first->second;
+        ++s.first;
+        s.valid = true;
+    } else {
+        s.valid = false;
+    }
+}
+
+bool disk_merger::next(std::string &key, disk_record &record)
+{
+    source *best = nullptr;
+    for (source &s: sources_) {
+        if (s.valid && (!best || s.key < best->key))
+            best = &s;
+    }
+
+    if (!best)
+        return false;
+
+    key = best->key;
+    record = best->record;
+
+    for (source &s: sources_) {
+        if (s.valid && s.key == key)
+            advance(s);
+    }
+
+    return true;
+}
+
+disk_store::disk_store(const std::string &dir, size_t memtable_limit, size_t max_runs):
+    dir_(dir),
+    memtable_limit_(memtable_limit),
+    max_runs_(std::max<size_t>(max_runs, 2)),
+    memtable_bytes_(0),
+    next_seq_(1),
+    compacting_(false)
+{
+    if (::mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST)
+        throw std::runtime_error("Create disk map directory error");
+
+    std::unique_ptr<DIR, int (*)(DIR *)> d(::opendir(dir.c_str()), ::closedir);
+    if (!d)
+        throw std::runtime_error("Open disk map directory error");
+
+    // Run files are named by hex sequence number, larger is newer
+    std::vector<uint64_t> seqs;
+    while (struct dirent *entry = ::readdir(d.get())) {
+        std::string name(entry->d_name);
+        if (name.size() == 24 && name.compare(16, 8, ".run.tmp") == 0) {
+            ::unlink((dir_ + "/" + name).c_str());
+        } else if (name.size() == 20 && name.compare(16, 4, ".run") == 0) {
+            char *end;
+            uint64_t seq = std::strtoull(name.substr(0, 16).c_str(), &end, 16);
+            if (*end == '\0')
+                seqs.push_back(seq);
+        }
+    }
+
+    std::sort(seqs.rbegin(), seqs.rend());
+    for (uint64_t seq: seqs)
+        runs_.push_back(disk_run::open(run_path(seq), seq));
+
+    if (!seqs.empty())
+        next_seq_ = seqs.front() + 1;
+}
+
+disk_store::~disk_store()
+{
+    try {
+        wait();
+    } catch ( ... ) {
+    }
+
+    try {
+        detach();
+        flush();
+    } catch ( ... ) {
+    }
+}
+
+std::string disk_store::run_path(uint64_t seq) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.run", static_cast<unsigned long long>(seq));
+    return dir_ + name;
+}
+
+// Flushing tables and runs are taken under one lock, a table is dropped
+// in the same step its run is published so it's always seen once.
+disk_merger disk_store::merge(const std::string *lower) const
+{
+    disk_tables tables;
+    std::vector<std::shared_ptr<disk_run>> runs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tables = flushing_;
+        runs = runs_;
+    }
+
+    return disk_merger(&memtable_, tables, runs, lower);
+}
+
+bool disk_store::get(const std::string &key, disk_record &record) const
+{
+    disk_memtable::const_iterator iter = memtable_.find(key);
+    if (iter != memtable_.end()) {
+        record = iter->second;
+        return true;
+    }
+
+    disk_tables tables;
+    std::vector<std::shared_ptr<disk_run>> runs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tables = flushing_;
+        runs = runs_;
+    }
+
+    for (const std::shared_ptr<const disk_memtable> &table: tables) {
+        iter = table->find(key);
+        if (iter != table->end()) {
+            record = iter->second;
+            return true;
+        }
+    }
+
+    for (const std::shared_ptr<disk_run> &run: runs) {
+        if (run->get(key, record))
+            return true;
+    }
+
+    return false;
+}
+
+bool disk_store::put(const std::string &key, const disk_record &record)
+{
+    disk_memtable::iterator iter = memtable_.find(key);
+    if (iter != memtable_.end()) {
+        memtable_bytes_ -= iter->second.value.size();
+        iter->second = record;
+    } else {
+        memtable_.emplace(key, record);
+        memtable_bytes_ += key.size();
+    }
+
+    memtable_bytes_ += record.value.size();
+    return memtable_bytes_ >= memtable_limit_;
+}
+
+std::shared_ptr<const disk_memtable> disk_store::detach()
+{
+    if (memtable_.empty())
+        return nullptr;
+
+    std::shared_ptr<disk_memtable> table(new disk_memtable());
+    table->swap(memtable_);
+    memtable_bytes_ = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushing_.insert(flushing_.begin(), table);
+    return table;
+}
+
+// A table which failed to be written stays in flushing_, so it's still
+// read and the next flush() retries it.
+void disk_store::write(const std::shared_ptr<const disk_memtable> &table)
+{
+    std::lock_guard<std::mutex> guard(write_mutex_);
+
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (std::find(flushing_.begin(), flushing_.end(), table) == flushing_.end())
+            return;
+        seq = next_seq_++;
+    }
+
+    // Tombstones are written too, they shadow records in older runs
+    disk_run_writer writer(run_path(seq), seq);
+    for (disk_memtable::const_iterator iter = table->begin(); iter != table->end(); ++iter)
+        writer.add(iter->first, iter->second);
+
+    std::shared_ptr<disk_run> run = writer.finish();
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushing_.erase(std::find(flushing_.begin(), flushing_.end(), table));
+    runs_.insert(runs_.begin(), run);
+}
+
+void disk_store::flush()
+{
+    disk_tables tables;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tables = flushing_;
+    }
+
+    // Oldest first, so the runs keep the order of the tables
+    for (disk_tables::reverse_iterator iter = tables.rbegin(); iter != tables.rend(); ++iter)
+        write(*iter);
+}
+
+void disk_store::clear()
+{
+    wait();
+
+    // A table written meanwhile would publish its run after the clear
+    std::lock_guard<std::mutex> guard(write_mutex_);
+    std::vector<std::shared_ptr<disk_run>> runs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        runs.swap(runs_);
+        flushing_.clear();
+    }
+
+    memtable_.clear();
+    memtable_bytes_ = 0;
+
+    // Readers still holding the runs keep their files open
+    for (const std::shared_ptr<disk_run> &run: runs)
+        ::unlink(run->path().c_str());
+}
+
+// Size tiered choice of runs to merge, so a run is rewritten about once
+// each time the data grows by a tier instead of on every compaction. The
+// newest window of adjacent runs where the largest is at most twice the
+// smallest is taken, or else the adjacent pair of the least bytes. Inputs
+// are adjacent so the merged run takes their place in the order.
+std::vector<std::shared_ptr<disk_run>> disk_store::pick_inputs(bool all) const
+{
+    if (runs_.size() < 2 || (!all && runs_.size() < max_runs_))
+        return std::vector<std::shared_ptr<disk_run>>();
+
+    if (all)
+        return runs_;
+
+    for (size_t i = 0; i + 1 < runs_.size(); ++i) {
+        uint64_t smallest = std::max<uint64_t>(runs_[i]->bytes(), 1), largest = smallest;
+        size_t j = i + 1;
+        for (; j < runs_.size(); ++j) {
+            uint64_t bytes = std::max<uint64_t>(runs_[j]->bytes(), 1);
+            if (std::max(largest, bytes) > 2 * std::min(smallest, bytes))
+                break;
+            smallest = std::min(smallest, bytes);
+            largest = std::max(largest, bytes);
+        }
+
+        if (j - i >= 2)
+            return std::vector<std::shared_ptr<disk_run>>(runs_.begin() + i, runs_.begin() + j);
+    }
+
+    size_t best = 0;
+    for (size_t i = 1; i + 1 < runs_.size(); ++i) {
+        if (runs_[i]->bytes() + runs_[i + 1]->bytes() < runs_[best]->bytes() + runs_[best + 1]->bytes())
+            best = i;
+    }
+
+    return std::vector<std::shared_ptr<disk_run>>(runs_.begin() + best, runs_.begin() + best + 2);
+}
+
+void disk_store::compact(bool all)
+{
+    if (compacting_)
+        return;
+
+    std::lock_guard<std::mutex> guard(thread_mutex_);
+    if (compacting_)
+        return;
+
+    if (compaction_.joinable())
+        compaction_.join();
+
+    std::vector<std::shared_ptr<disk_run>> inputs;
+    bool drop_tombstones;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inputs = pick_inputs(all);
+        if (inputs.empty())
+            return;
+
+        // Nothing older is left for tombstones to shadow
+        drop_tombstones = inputs.back() == runs_.back();
+    }
+
+    compacting_ = true;
+    try {
+        compaction_ = std::thread(&disk_store::compaction, this, std::move(inputs), drop_tombstones);
+    } catch ( ... ) {
+        compacting_ = false;
+        throw;
+    }
+}
+
+// The merged run takes the sequence of the newest input and replaces its
+// file, so it's newer than the other inputs and older than every run
+// newer than the inputs, including those flushed while merging.
+void disk_store::compaction(std::vector<std::shared_ptr<disk_run>> inputs, bool drop_tombstones)
+{
+    try {
+        uint64_t seq = inputs.front()->seq();
+        disk_merger merger(nullptr, disk_tables(), inputs, nullptr);
+        disk_run_writer writer(run_path(seq), seq);
+        std::string key;
+        disk_record record;
+        while (merger.next(key, record)) {
+            if (!record.tombstone || !drop_tombstones)
+                writer.add(key, record);
+        }
+
+        std::shared_ptr<disk_run> run = writer.finish();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<std::shared_ptr<disk_run>>::iterator first = std::find(runs_.begin(), runs_.end(), inputs.front());
+            first = runs_.erase(first, first + inputs.size());
+            runs_.insert(first, run);
+        }
+
+        // Readers still holding the inputs keep their files open
+        for (size_t i = 1; i < inputs.size(); ++i)
+            ::unlink(inputs[i]->path().c_str());
+    } catch (std::exception &e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = e.what();
+    }
+
+    compacting_ = false;
+}
+
+void disk_store::wait()
+{
+    {
+        std::lock_guard<std::mutex> guard(thread_mutex_);
+        if (compaction_.joinable())
+            compaction_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_.empty()) {
+        std::string error;
+        error.swap(error_);
+        throw std::runtime_error(error);
+    }
+}
+
+PyMethodDef *pystdcxx_disk_map::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "get",          (PyCFunction)pystdcxx_disk_map::get,      METH_VARARGS, "Return value of key, or default if key doesn't exist" },
+        { "setdefault",   (PyCFunction)pystdcxx_disk_map::setdefault, METH_VARARGS, "Return value of key, insert default first if key doesn't exist" },
+        { "pop",          (PyCFunction)pystdcxx_disk_map::pop,      METH_VARARGS, "Remove key and return its value, or default if key doesn't exist" },
+        { "popitem",      (PyCFunction)pystdcxx_disk_map::popitem,  METH_VARARGS | METH_KEYWORDS, "Pop and remove the first/last item, the last one takes a full scan" },
+        { "find",         (PyCFunction)pystdcxx_disk_map::find,     METH_O,       "Find an item and return an iterator" },
+        { "clear",        (PyCFunction)pystdcxx_disk_map::clear,    METH_NOARGS,  "Remove all items and run files" },
+        { "flush",        (PyCFunction)pystdcxx_disk_map::flush,    METH_NOARGS,  "Write the in memory table to a new run file" },
+        { "compact",      (PyCFunction)pystdcxx_disk_map::compact,  METH_NOARGS,  "Merge all run files into one and wait for it" },
+        { "close",        (PyCFunction)pystdcxx_disk_map::close,    METH_NOARGS,  "Flush and close the map" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+int pystdcxx_disk_map::tp_init(pystdcxx_disk_map *self, PyObject *args, PyObject *kwds)
+{
+    const char *path;
+    Py_ssize_t memtable_size = 4 * 1024 * 1024, max_runs = 4;
+    PyObject *dumps = nullptr, *loads = nullptr;
+    static const char *kwlist[] = { "path", "memtable_size", "max_runs", "dumps", "loads", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|$nnOO", const_cast<char **>(kwlist),
+                                     &path, &memtable_size, &max_runs, &dumps, &loads))
+        return -1;
+
+    if (memtable_size <= 0 || max_runs <= 0) {
+        PyErr_SetString(PyExc_ValueError, "memtable_size and max_runs should be positive");
+        return -1;
+    }
+
+    if ((dumps && !Py_IsNone(dumps) && !PyCallable_Check(dumps)) ||
+        (loads && !Py_IsNone(loads) && !PyCallable_Check(loads))) {
+        PyErr_SetString(PyExc_ValueError, "dumps and loads arguments should be callable type");
+        return -1;
+    }
+
+    self->close_store();
+    self->dumps = (dumps && !Py_IsNone(dumps)) ? py_ptr<PyObject>(dumps, true) : py_ptr<PyObject>();
+    self->loads = (loads && !Py_IsNone(loads)) ? py_ptr<PyObject>(loads, true) : py_ptr<PyObject>();
+    self->maintain_tracking(dumps);
+    self->maintain_tracking(loads);
+
+    try {
+        self->store = std::make_shared<disk_store>(path, memtable_size, max_runs);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+PyObject *pystdcxx_disk_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) pystdcxx_disk_map());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create disk map object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_disk_map::tp_traverse(pystdcxx_disk_map *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (self->dumps.get())
+        Py_VISIT(self->dumps.get());
+
+    if (self->loads.get())
+        Py_VISIT(self->loads.get());
+
+    return 0;
+}
+
+int pystdcxx_disk_map::tp_clear(pystdcxx_disk_map *self)
+{
+    py_ptr<PyObject> dumps(self->dumps.release());
+    py_ptr<PyObject> loads(self->loads.release());
+    return 0;
+}
+
+bool pystdcxx_disk_map::check_open()
+{
+    if (!store) {
+        PyErr_SetString(PyExc_ValueError, "Disk map is closed");
+        return false;
+    }
+
+    return true;
+}
+
+void pystdcxx_disk_map::close_store()
+{
+    if (!store)
+        return;
+
+    ++version;
+    store.reset();
+}
+
+// Keys are encoded so that comparing the bytes gives the order of Python
+// objects of the same type: a type tag followed by a big endian integer
+// with the sign bit flipped, or the raw bytes or UTF8 of a string.
+void pystdcxx_disk_map::encode_key(PyObject *key, std::string &data)
+{
+    if (PyLong_Check(key)) {
+        long long n = PyLong_AsLongLong(key);
+        if (n == -1 && PyErr_Occurred())
+            throw std::runtime_error("Encode key error");
+
+        uint64_t u = static_cast<uint64_t>(n) ^ (1ULL << 63);
+        data.assign(1, 'i');
+        for (int i = 7; i >= 0; --i)
+            data += static_cast<char>((u >> (i * 8)) & 0xff);
+    } else if (PyBytes_Check(key)) {
+        data.assign(1, 'b');
+        data.append(PyBytes_AS_STRING(key), PyBytes_GET_SIZE(key));
+    } else if (PyUnicode_Check(key)) {
+        Py_ssize_t size;
+        const char *str = PyUnicode_AsUTF8AndSize(key, &size);
+        if (!str)
+            throw std::runtime_error("Encode key error");
+        data.assign(1, 's');
+        data.append(str, size);
+    } else {
+        PyErr_Format(PyExc_TypeError, "disk_map key should be int, bytes or str, not %s", Py_TYPE(key)->tp_name);
+        throw std::runtime_error("Invalid key type");
+    }
+}
+
+PyObject *pystdcxx_disk_map::decode_key(const std::string &data)
+{
+    switch (data.empty() ? 0 : data[0]) {
+    case 'i': {
+        uint64_t u = 0;
+        for (size_t i = 1; i < data.size(); ++i)
+            u = (u << 8) | static_cast<unsigned char>(data[i]);
+        return PyLong_FromLongLong(static_cast<long long>(u ^ (1ULL << 63)));
+    }
+    case 'b':
+        return PyBytes_FromStringAndSize(data.data() + 1, data.size() - 1);
+    case 's':
+        return PyUnicode_DecodeUTF8(data.data() + 1, data.size() - 1, "strict");
+    default:
+        PyErr_SetString(PyExc_ValueError, "Corrupted key in disk map");
+        return nullptr;
+    }
+}
+
+void pystdcxx_disk_map::encode_value(PyObject *value, std::string &data)
+{
+    if (PyBytes_Check(value)) {
+        data.assign(1, 'b');
+        data.append(PyBytes_AS_STRING(value), PyBytes_GET_SIZE(value));
+    } else if (PyUnicode_Check(value)) {
+        Py_ssize_t size;
+        const char *str = PyUnicode_AsUTF8AndSize(value, &size);
+        if (!str)
+            throw std::runtime_error("Encode value error");
+        data.assign(1, 's');
+        data.append(str, size);
+    } else if (dumps.get()) {
+        py_ptr<PyObject> bytes(PyObject_CallOneArg(dumps.get(), value));
+        if (!bytes.get())
+            throw std::runtime_error("Serialize value error");
+        if (!PyBytes_Check(bytes.get())) {
+            PyErr_SetString(PyExc_TypeError, "dumps should return bytes");
+            throw std::runtime_error("Serialize value error");
+        }
+        data.assign(1, 'o');
+        data.append(PyBytes_AS_STRING(bytes.get()), PyBytes_GET_SIZE(bytes.get()));
+    } else {
+        PyErr_Format(PyExc_TypeError, "disk_map value should be bytes or str without dumps, not %s", Py_TYPE(value)->tp_name);
+        throw std::runtime_error("Invalid value type");
+    }
+}
+
+PyObject *pystdcxx_disk_map::decode_value(const std::string &data)
+{
+    switch (data.empty() ? 0 : data[0]) {
+    case 'b':
+        return PyBytes_FromStringAndSize(data.data() + 1, data.size() - 1);
+    case 's':
+        return PyUnicode_DecodeUTF8(data.data() + 1, data.size() - 1, "strict");
+    case 'o': {
+        if (!loads.get()) {
+            PyErr_SetString(PyExc_TypeError, "loads is required to decode serialized value");
+            return nullptr;
+        }
+        py_ptr<PyObject> bytes(PyBytes_FromStringAndSize(data.data() + 1, data.size() - 1));
+        if (!bytes.get())
+            return nullptr;
+        return PyObject_CallOneArg(loads.get(), bytes.get());
+    }
+    default:
+        PyErr_SetString(PyExc_ValueError, "Corrupted value in disk map");
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::tp_iter(pystdcxx_disk_map *self)
+{
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self, nullptr, nullptr));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+int pystdcxx_disk_map::sq_contains(pystdcxx_disk_map *self, PyObject *key)
+{
+    if (!self->check_open())
+        return -1;
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+        disk_record record;
+        return self->store->get(data, record) && !record.tombstone;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+// Counting merges every run, it's O(n)
+Py_ssize_t pystdcxx_disk_map::mp_length(pystdcxx_disk_map *self)
+{
+    if (!self->check_open())
+        return -1;
+
+    try {
+        disk_merger merger(self->store->merge(nullptr));
+        std::string key;
+        disk_record record;
+        Py_ssize_t n = 0;
+        while (merger.next(key, record)) {
+            if (!record.tombstone)
+                ++n;
+        }
+
+        return n;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+// Slice returns an iterator over keys in [start, stop)
+PyObject *pystdcxx_disk_map::range(PyObject *slice)
+{
+    PySliceObject *s = reinterpret_cast<PySliceObject *>(slice);
+    if (!Py_IsNone(s->step)) {
+        long step = PyLong_AsLong(s->step);
+        if (step == -1 && PyErr_Occurred())
+            return nullptr;
+        if (step != 1) {
+            PyErr_SetString(PyExc_ValueError, "disk_map slice step should be 1");
+            return nullptr;
+        }
+    }
+
+    try {
+        std::string lower, upper;
+        if (!Py_IsNone(s->start))
+            encode_key(s->start, lower);
+        if (!Py_IsNone(s->stop))
+            encode_key(s->stop, upper);
+
+        return reinterpret_cast<PyObject *>(new(this) iterator(this,
+                                                               Py_IsNone(s->start) ? nullptr : std::addressof(lower),
+                                                               Py_IsNone(s->stop) ? nullptr : std::addressof(upper)));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::mp_subscript(pystdcxx_disk_map *self, PyObject *key)
+{
+    if (!self->check_open())
+        return nullptr;
+
+    if (PySlice_Check(key))
+        return self->range(key);
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+        disk_record record;
+        if (!self->store->get(data, record) || record.tombstone) {
+            PyErr_SetObject(PyExc_KeyError, key);
+            return nullptr;
+        }
+
+        return self->decode_value(record.value);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+int pystdcxx_disk_map::mp_ass_subscript(pystdcxx_disk_map *self, PyObject *key, PyObject *value)
+{
+    if (!self->check_open())
+        return -1;
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+
+        disk_record record;
+        if (!value) {
+            if (!self->store->get(data, record) || record.tombstone) {
+                PyErr_SetObject(PyExc_KeyError, key);
+                return -1;
+            }
+            record = disk_record(std::string(), true);
+        } else {
+            self->encode_value(value, record.value);
+        }
+
+        self->put(data, record);
+        return 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+// Iterators of memtable are only invalidated when it's detached. A full
+// memtable is written with the GIL released, like close() does, since
+// writing ends with an fsync.
+void pystdcxx_disk_map::put(const std::string &key, const disk_record &record)
+{
+    if (!store->put(key, record))
+        return;
+
+    ++version;
+    std::shared_ptr<disk_store> store(this->store);
+    std::shared_ptr<const disk_memtable> table(store->detach());
+    py_without_gil([store, table] () {
+        store->write(table);
+        store->compact(false);
+    });
+}
+
+PyObject *pystdcxx_disk_map::get(pystdcxx_disk_map *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+        disk_record record;
+        if (!self->store->get(data, record) || record.tombstone) {
+            Py_INCREF(def);
+            return def;
+        }
+
+        return self->decode_value(record.value);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::setdefault(pystdcxx_disk_map *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+        disk_record record;
+        if (self->store->get(data, record) && !record.tombstone)
+            return self->decode_value(record.value);
+
+        self->encode_value(def, record.value);
+        record.tombstone = false;
+        self->put(data, record);
+        Py_INCREF(def);
+        return def;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::pop(pystdcxx_disk_map *self, PyObject *args)
+{
+    PyObject *key, *def = nullptr;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+        disk_record record;
+        if (!self->store->get(data, record) || record.tombstone) {
+            if (!def) {
+                PyErr_SetObject(PyExc_KeyError, key);
+                return nullptr;
+            }
+            Py_INCREF(def);
+            return def;
+        }
+
+        py_ptr<PyObject> value(self->decode_value(record.value));
+        if (!value.get())
+            return nullptr;
+
+        self->put(data, disk_record(std::string(), true));
+        return value.release();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+// Runs can only be read forwards, so the last item takes a full merge
+PyObject *pystdcxx_disk_map::popitem(pystdcxx_disk_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *is_last = nullptr;
+    static const char *kwlist[] = { "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &is_last))
+        return nullptr;
+
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        bool last = is_last && PyObject_IsTrue(is_last);
+        disk_merger merger(self->store->merge(nullptr));
+        std::string key, data;
+        disk_record record, found;
+        bool exists = false;
+        while (merger.next(key, record)) {
+            if (record.tombstone)
+                continue;
+
+            data.swap(key);
+            found.value.swap(record.value);
+            exists = true;
+            if (!last)
+                break;
+        }
+
+        if (!exists) {
+            PyErr_SetString(PyExc_ValueError, "Empty map");
+            return nullptr;
+        }
+
+        py_ptr<PyObject> k(self->decode_key(data));
+        if (!k.get())
+            return nullptr;
+        py_ptr<PyObject> v(self->decode_value(found.value));
+        if (!v.get())
+            return nullptr;
+
+        PyObject *tuple = PyTuple_Pack(2, k.get(), v.get());
+        if (!tuple)
+            return nullptr;
+
+        self->put(data, disk_record(std::string(), true));
+        return tuple;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+// Iterator from key to the end, or an exhausted one if key doesn't exist
+PyObject *pystdcxx_disk_map::find(pystdcxx_disk_map *self, PyObject *key)
+{
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        std::string data;
+        self->encode_key(key, data);
+        disk_record record;
+        bool exists = self->store->get(data, record) && !record.tombstone;
+        return reinterpret_cast<PyObject *>(new(self) iterator(self, &data, exists ? nullptr : &data));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::clear(pystdcxx_disk_map *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        // Memtable is only touched with GIL held, so just the wait drops it
+        ++self->version;
+        std::shared_ptr<disk_store> store(self->store);
+        py_without_gil([store] () { store->wait(); });
+        store->clear();
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::flush(pystdcxx_disk_map *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        ++self->version;
+        std::shared_ptr<disk_store> store(self->store);
+        store->detach();
+        py_without_gil([store] () { store->flush(); });
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::compact(pystdcxx_disk_map *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->check_open())
+        return nullptr;
+
+    try {
+        // A background compaction of some runs may be running, merge all
+        // of them once it's done
+        std::shared_ptr<disk_store> store(self->store);
+        py_without_gil([store] () {
+            store->wait();
+            store->compact(true);
+            store->wait();
+        });
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::close(pystdcxx_disk_map *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->store)
+        Py_RETURN_NONE;
+
+    ++self->version;
+    std::shared_ptr<disk_store> store(std::move(self->store));
+    try {
+        py_without_gil([store] () {
+            store->wait();
+            store->detach();
+            store->flush();
+        });
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_disk_map::iterator::tp_iter(pystdcxx_disk_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_disk_map::iterator::tp_iternext(pystdcxx_disk_map::iterator *self)
+{
+    if (!self->owner->store || self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't flush or close disk map while iterating");
+        return nullptr;
+    }
+
+    try {
+        std::string key;
+        disk_record record;
+        while (self->merger.next(key, record)) {
+            if (self->has_upper && !(key < self->upper))
+                return nullptr;
+            if (record.tombstone)
+                continue;
+
+            py_ptr<PyObject> k(self->owner->decode_key(key));
+            if (!k.get())
+                return nullptr;
+            py_ptr<PyObject> v(self->owner->decode_value(record.value));
+            if (!v.get())
+                return nullptr;
+
+            return PyTuple_Pack(2, k.get(), v.get());
+        }
+
+        return nullptr;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
@@ -0,0 +1,292 @@
+#ifndef PYSTDCXX_DISK_MAP_HPP
+#define PYSTDCXX_DISK_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include "utils.hpp"
+
+// Storage of disk map, a log structured merge tree of encoded keys and
+// values. Writes go to an in memory table which is spilled to a sorted
+// immutable run file once it grows beyond a limit, runs are merged in a
+// background thread when there are too many of them. Keys are compared
+// as bytes, so nothing here needs the GIL.
+//
+// A full memtable is detached with the GIL held and written without it.
+// Until its run is published it stays readable as a flushing table, so
+// readers running meanwhile never miss its records.
+
+struct disk_record
+{
+    disk_record(): tombstone(false) {}
+    disk_record(const std::string &value, bool tombstone): value(value), tombstone(tombstone) {}
+
+    std::string value;
+    bool tombstone;
+};
+
+// Sorted run of records in a local file. Only the key of every
+// index_interval-th record is kept in memory, so a lookup reads at most
+// one block of records from the file.
+class disk_run: public std::enable_shared_from_this<disk_run>
+{
+public:
+    enum { index_interval = 64 };
+
+    struct index_entry
+    {
+        std::string key;
+        uint64_t offset;
+    };
+
+    ~disk_run();
+
+    static std::shared_ptr<disk_run> open(const std::string &path, uint64_t seq);
+
+    const std::string &path() const { return path_; }
+    uint64_t seq() const { return seq_; }
+    int fd() const { return fd_; }
+    uint64_t bytes() const { return bytes_; }
+
+    bool get(const std::string &key, disk_record &record) const;
+
+    // Offset of the block which holds the first key not less than key
+    uint64_t seek(const std::string &key) const;
+
+private:
+    friend class disk_run_writer;
+
+    disk_run(const std::string &path, uint64_t seq, int fd): path_(path), seq_(seq), fd_(fd), bytes_(0) {}
+
+    std::string path_;
+    uint64_t seq_;
+    int fd_;
+    uint64_t bytes_;
+    std::vector<index_entry> index_;
+};
+
+class disk_run_reader
+{
+public:
+    disk_run_reader(const std::shared_ptr<const disk_run> &run, uint64_t offset):
+        run_(run), offset_(offset), pos_(0)
+    {
+    }
+
+    // Read next record, return false at the end of run
+    bool next(std::string &key, disk_record &record);
+
+    // Offset of the record which next() will read
+    uint64_t tell() const { return offset_ - (buffer_.size() - pos_); }
+
+private:
+    bool fill(size_t n);
+    uint32_t get_u32();
+
+    std::shared_ptr<const disk_run> run_;
+    uint64_t offset_;
+    std::string buffer_;
+    size_t pos_;
+};
+
+// Write records in ascending order of key into a temporary file, which is
+// renamed to path when finished so a run file is either complete or absent.
+class disk_run_writer
+{
+public:
+    disk_run_writer(const std::string &path, uint64_t seq);
+    ~disk_run_writer();
+
+    void add(const std::string &key, const disk_record &record);
+    std::shared_ptr<disk_run> finish();
+
+private:
+    void put_u32(uint32_t n);
+
+    std::string path_, tmp_;
+    uint64_t seq_;
+    FILE *file_;
+    uint64_t offset_;
+    size_t count_;
+    std::vector<disk_run::index_entry> index_;
+};
+
+typedef std::map<std::string, disk_record> disk_memtable;
+
+typedef std::vector<std::shared_ptr<const disk_memtable>> disk_tables;
+
+// Merge sorted sources into one sorted stream, a source earlier in the
+// list shadows records of the same key in later ones.
+class disk_merger
+{
+public:
+    disk_merger(const disk_memtable *memtable, const disk_tables &tables,
+                const std::vector<std::shared_ptr<disk_run>> &runs, const std::string *lower);
+
+    // Return the newest record of next key, tombstones included
+    bool next(std::string &key, disk_record &record);
+
+private:
+    struct source
+    {
+        bool valid;
+        std::string key;
+        disk_record record;
+        disk_memtable::const_iterator first, last;
+        std::shared_ptr<const disk_memtable> table;    // Keeps a flushing table alive
+        std::unique_ptr<disk_run_reader> reader;
+    };
+
+    void advance(source &s);
+
+    std::vector<source> sources_;
+};
+
+class disk_store
+{
+public:
+    disk_store(const std::string &dir, size_t memtable_limit, size_t max_runs);
+    ~disk_store();
+
+    disk_store(const disk_store &) = delete;
+    disk_store &operator=(const disk_store &) = delete;
+
+    // Merge the memtable, flushing tables and runs from lower on
+    disk_merger merge(const std::string *lower) const;
+
+    bool get(const std::string &key, disk_record &record) const;
+
+    // Return true if memtable is full and should be detached and written
+    bool put(const std::string &key, const disk_record &record);
+
+    // Move the memtable to the flushing tables, which invalidates its
+    // iterators. Return nullptr if it's empty.
+    std::shared_ptr<const disk_memtable> detach();
+
+    // Write a detached table to a new run, no GIL needed. Tables are
+    // written one at a time, so runs keep the order of their tables.
+    void write(const std::shared_ptr<const disk_memtable> &table);
+
+    // Write every flushing table, the memtable is detached by the caller
+    void flush();
+
+    // Drop the memtable and all runs, wait for compaction first
+    void clear();
+
+    // Start merging runs in background unless it's running. All runs are
+    // merged if all is true, else the newest runs of similar size once
+    // there are max_runs runs.
+    void compact(bool all);
+
+    // Wait for background compaction, throw if it failed
+    void wait();
+
+private:
+    std::vector<std::shared_ptr<disk_run>> pick_inputs(bool all) const;
+    void compaction(std::vector<std::shared_ptr<disk_run>> inputs, bool drop_tombstones);
+    std::string run_path(uint64_t seq) const;
+
+    std::string dir_;
+    size_t memtable_limit_, max_runs_;
+    disk_memtable memtable_;
+    size_t memtable_bytes_;
+
+    mutable std::mutex mutex_;
+    disk_tables flushing_;      // Detached tables not written yet, newest first
+    std::vector<std::shared_ptr<disk_run>> runs_;
+    uint64_t next_seq_;
+    std::string error_;
+
+    std::mutex write_mutex_;    // Serializes writing detached tables
+
+    std::mutex thread_mutex_;   // Guards joining and starting compaction_
+    std::thread compaction_;
+    std::atomic<bool> compacting_;
+};
+
+class pystdcxx_disk_map: public py_object<pystdcxx_disk_map>
+{
+public:
+    pystdcxx_disk_map(): version(0)
+    {
+        maintain_tracking();
+    }
+
+    ~pystdcxx_disk_map()
+    {
+        PyObject_GC_UnTrack(this);
+        close_store();
+    }
+
+    static const char *tp_name() { return "pystdcxx.disk_map"; }
+    static const char *tp_doc() { return "Ordered map which spills to sorted run files on local disk"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(pystdcxx_disk_map *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_disk_map *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_disk_map *self);
+    static PyObject *tp_iter(pystdcxx_disk_map *self);
+    static int sq_contains(pystdcxx_disk_map *self, PyObject *key);
+    static Py_ssize_t mp_length(pystdcxx_disk_map *self);
+    static PyObject *mp_subscript(pystdcxx_disk_map *self, PyObject *key);
+    static int mp_ass_subscript(pystdcxx_disk_map *self, PyObject *key, PyObject *value);
+    static PyObject *get(pystdcxx_disk_map *self, PyObject *args);
+    static PyObject *setdefault(pystdcxx_disk_map *self, PyObject *args);
+    static PyObject *pop(pystdcxx_disk_map *self, PyObject *args);
+    static PyObject *popitem(pystdcxx_disk_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *find(pystdcxx_disk_map *self, PyObject *key);
+    static PyObject *clear(pystdcxx_disk_map *self, PyObject *args);
+    static PyObject *flush(pystdcxx_disk_map *self, PyObject *args);
+    static PyObject *compact(pystdcxx_disk_map *self, PyObject *args);
+    static PyObject *close(pystdcxx_disk_map *self, PyObject *args);
+
+private:
+    bool check_open();
+    void close_store();
+    void encode_key(PyObject *key, std::string &data);
+    PyObject *decode_key(const std::string &data);
+    void encode_value(PyObject *value, std::string &data);
+    PyObject *decode_value(const std::string &data);
+    PyObject *range(PyObject *slice);
+    void put(const std::string &key, const disk_record &record);
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_disk_map *owner, const std::string *lower, const std::string *upper):
+            owner(owner, true),
+            version(owner->version),
+            merger(owner->store->merge(lower)),
+            has_upper(upper != nullptr),
+            upper(upper ? *upper : std::string())
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.disk_map_iterator"; }
+        static const char *tp_doc() { return "Merging iterator of disk map"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_disk_map> owner;
+        unsigned int version;
+        disk_merger merger;
+        bool has_upper;
+        std::string upper;
+    };
+
+    unsigned int version;
+    std::shared_ptr<disk_store> store;  // Shared with calls waiting without GIL
+    py_ptr<PyObject> dumps;
+    py_ptr<PyObject> loads;
+};
+
+#endif // PYSTDCXX_DISK_MAP_HPP
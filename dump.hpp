@@ -0,0 +1,239 @@
+#ifndef PYSTDCXX_DUMP_HPP
+#define PYSTDCXX_DUMP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <marshal.h>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "utils.hpp"
+
+// Serialize container items into a bounded buffer and hand it over to
+// the write() method of a file like object every time the buffer grows
+// beyond chunk_size, so memory usage doesn't depend on container size.
+class py_dump_writer
+{
+public:
+    enum format_type { JSONL, CSV, BINARY };
+
+    py_dump_writer(PyObject *file, const char *format, Py_ssize_t chunk_size):
+        write_(PyObject_GetAttrString(file, "write")),
+        chunk_size_(chunk_size > 0 ? chunk_size : 1)
+    {
+        if (!write_.get())
+            throw std::runtime_error("File object has no write method");
+
+        if (!std::strcmp(format, "jsonl")) {
+            format_ = JSONL;
+        } else if (!std::strcmp(format, "csv")) {
+            format_ = CSV;
+        } else if (!std::strcmp(format, "binary")) {
+            format_ = BINARY;
+        } else {
+            PyErr_SetString(PyExc_ValueError, "format should be one of jsonl, csv or binary");
+            throw std::runtime_error("Invalid dump format");
+        }
+
+        buffer_.reserve(chunk_size_);
+    }
+
+    // Append an item of set
+    void put(PyObject *item)
+    {
+        switch (format_) {
+        case JSONL:
+            put_json(item);
+            buffer_ += '\n';
+            break;
+        case CSV:
+            put_csv(item);
+            buffer_ += '\n';
+            break;
+        case BINARY:
+            put_binary(item);
+            break;
+        }
+
+        check_flush();
+    }
+
+    // Append a key/value pair of map
+    void put(PyObject *key, PyObject *value)
+    {
+        switch (format_) {
+        case JSONL:
+            buffer_ += '[';
+            put_json(key);
+            buffer_ += ", ";
+            put_json(value);
+            buffer_ += "]\n";
+            break;
+        case CSV:
+            put_csv(key);
+            buffer_ += ',';
+            put_csv(value);
+            buffer_ += '\n';
+            break;
+        case BINARY:
+            put_binary(key);
+            put_binary(value);
+            break;
+        }
+
+        check_flush();
+    }
+
+    void flush()
+    {
+        if (buffer_.empty())
+            return;
+
+        py_ptr<PyObject> chunk;
+        if (format_ == BINARY)
+            chunk = py_ptr<PyObject>(PyBytes_FromStringAndSize(buffer_.data(), buffer_.size()));
+        else
+            chunk = py_ptr<PyObject>(PyUnicode_DecodeUTF8(buffer_.data(), buffer_.size(), "strict"));
+        if (!chunk.get())
+            throw std::runtime_error("Create chunk object error");
+
+        py_ptr<PyObject> result(PyObject_CallOneArg(write_.get(), chunk.get()));
+        if (!result.get())
+            throw std::runtime_error("Write chunk error");
+
+        buffer_.clear();
+    }
+
+private:
+    void check_flush()
+    {
+        if (buffer_.size() >= static_cast<size_t>(chunk_size_))
+            flush();
+    }
+
+    void put_utf8(PyObject *ob)
+    {
+        Py_ssize_t size;
+        const char *str = PyUnicode_AsUTF8AndSize(ob, &size);
+        if (!str)
+            throw std::runtime_error("Get UTF8 string of object error");
+        buffer_.append(str, size);
+    }
+
+    void put_json_string(PyObject *ob)
+    {
+        Py_ssize_t size;
+        const char *str = PyUnicode_AsUTF8AndSize(ob, &size);
+        if (!str)
+            throw std::runtime_error("Get UTF8 string of object error");
+
+        buffer_ += '"';
+        for (Py_ssize_t i = 0; i < size; ++i) {
+            unsigned char c = str[i];
+            switch (c) {
+            case '"': buffer_ += "\\\""; break;
+            case '\\': buffer_ += "\\\\"; break;
+            case '\n': buffer_ += "\\n"; break;
+            case '\r': buffer_ += "\\r"; break;
+            case '\t': buffer_ += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    static const char hex[] = "0123456789abcdef";
+                    buffer_ += "\\u00";
+                    buffer_ += hex[c >> 4];
+                    buffer_ += hex[c & 0xf];
+                } else {
+                    buffer_ += static_cast<char>(c);
+                }
+            }
+        }
+        buffer_ += '"';
+    }
+
+    void put_json(PyObject *ob)
+    {
+        if (Py_IsNone(ob)) {
+            buffer_ += "null";
+        } else if (PyBool_Check(ob)) {
+            buffer_ += Py_IsTrue(ob) ? "true" : "false";
+        } else if (PyLong_Check(ob)) {
+            py_ptr<PyObject> str(PyLong_Type.tp_repr(ob));
+            if (!str.get())
+                throw std::runtime_error("Get representation of integer error");
+            put_utf8(str.get());
+        } else if (PyFloat_Check(ob)) {
+            double value = PyFloat_AS_DOUBLE(ob);
+            if (std::isnan(value)) {
+                buffer_ += "NaN";
+            } else if (std::isinf(value)) {
+                buffer_ += value > 0 ? "Infinity" : "-Infinity";
+            } else {
+                buffer_ += py_repr(ob);
+            }
+        } else if (PyUnicode_Check(ob)) {
+            put_json_string(ob);
+        } else if (py_tuple_check(ob)) {
+            const char *comma = "";
+            buffer_ += '[';
+            py_tuple_for_each(ob, [this, &comma] (PyObject *item) {
+                buffer_ += comma;
+                put_json(item);
+                comma = ", ";
+            });
+            buffer_ += ']';
+        } else {
+            PyErr_Format(PyExc_TypeError, "Object of type %s is not JSON serializable", Py_TYPE(ob)->tp_name);
+            throw std::runtime_error("Object is not JSON serializable");
+        }
+    }
+
+    void put_csv(PyObject *ob)
+    {
+        if (Py_IsNone(ob))
+            return;
+
+        py_ptr<PyObject> str(PyObject_Str(ob));
+        if (!str.get())
+            throw std::runtime_error("Get string of object error");
+
+        Py_ssize_t size;
+        const char *s = PyUnicode_AsUTF8AndSize(str.get(), &size);
+        if (!s)
+            throw std::runtime_error("Get UTF8 string of object error");
+
+        if (std::string::npos == std::string(s, size).find_first_of(",\"\r\n")) {
+            buffer_.append(s, size);
+            return;
+        }
+
+        buffer_ += '"';
+        for (Py_ssize_t i = 0; i < size; ++i) {
+            if (s[i] == '"')
+                buffer_ += '"';
+            buffer_ += s[i];
+        }
+        buffer_ += '"';
+    }
+
+    // Each record is a 4 bytes little endian length followed by the
+    // marshal data of the object.
+    void put_binary(PyObject *ob)
+    {
+        py_ptr<PyObject> data(PyMarshal_WriteObjectToString(ob, Py_MARSHAL_VERSION));
+        if (!data.get())
+            throw std::runtime_error("Marshal object error");
+
+        uint32_t size = PyBytes_GET_SIZE(data.get());
+        for (int i = 0; i < 4; ++i)
+            buffer_ += static_cast<char>((size >> (i * 8)) & 0xff);
+        buffer_.append(PyBytes_AS_STRING(data.get()), size);
+    }
+
+    py_ptr<PyObject> write_;
+    format_type format_;
+    Py_ssize_t chunk_size_;
+    std::string buffer_;
+};
+
+#endif // PYSTDCXX_DUMP_HPP
@@ -0,0 +1,264 @@
+#include <map>
+#include "frozen_map.hpp"
+
+PyMethodDef *pystdcxx_frozen_map::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "get",          (PyCFunction)pystdcxx_frozen_map::get,   METH_VARARGS, "Return value of key, or default if key doesn't exist" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_frozen_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr, *less = nullptr, *cmp = nullptr;
+    static const char *kwlist[] = { "tuple", "less", "cmp", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$OO", const_cast<char **>(kwlist), &tuple, &less, &cmp))
+        return nullptr;
+
+    py_ptr<PyObject> comp, three_way;
+    if (less && PyCallable_Check(less)) {
+        comp = py_ptr<PyObject>(less, true);
+    } else if (less && !Py_IsNone(less)) {
+        PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
+        return nullptr;
+    }
+
+    if (cmp && PyCallable_Check(cmp)) {
+        three_way = py_ptr<PyObject>(cmp, true);
+    } else if (cmp && !Py_IsNone(cmp)) {
+        PyErr_SetString(PyExc_ValueError, "cmp argument should be callable type");
+        return nullptr;
+    }
+
+    if (comp.get() && three_way.get()) {
+        PyErr_SetString(PyExc_ValueError, "less and cmp can't be both given");
+        return nullptr;
+    }
+
+    if (tuple && !py_tuple_check(tuple)) {
+        PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+        return nullptr;
+    }
+
+    try {
+        // Sort and deduplicate with a temporary tree, later items win
+        std::map<py_ptr<PyObject>, py_ptr<PyObject>, py_less> items{py_less(comp, three_way)};
+        if (tuple) {
+            py_tuple_for_each(tuple, [&items] (PyObject *item) {
+                PyObject *key = py_tuple_get_item(item, 0);
+                PyObject *value = py_tuple_get_item(item, 1);
+                if (!key || !value)
+                    throw std::runtime_error("Invalie key/value pair");
+                items.insert_or_assign(py_ptr<PyObject>(key, true), py_ptr<PyObject>(value, true));
+            });
+        }
+
+        py_ptr<pystdcxx_frozen_map> self(new(type) pystdcxx_frozen_map(items.key_comp()));
+        self->reserve(items.size());
+        for (auto iter = items.begin(); iter != items.end(); ++iter)
+            self->append(iter->first, iter->second);
+
+        return reinterpret_cast<PyObject *>(self.release());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create frozen map object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_frozen_map::tp_traverse(pystdcxx_frozen_map *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (self->less.get())
+        Py_VISIT(self->less.get());
+
+    if (self->cmp.get())
+        Py_VISIT(self->cmp.get());
+
+    for (size_t i = 0; i < self->keys.size(); ++i) {
+        Py_VISIT(self->keys[i].get());
+        Py_VISIT(self->values[i].get());
+    }
+
+    return 0;
+}
+
+int pystdcxx_frozen_map::tp_clear(pystdcxx_frozen_map *self)
+{
+    std::vector<py_ptr<PyObject>> keys(std::move(self->keys));
+    std::vector<py_ptr<PyObject>> values(std::move(self->values));
+    py_ptr<PyObject> less(self->less.release());
+    py_ptr<PyObject> cmp(self->cmp.release());
+    return 0;
+}
+
+PyObject *pystdcxx_frozen_map::tp_repr(pystdcxx_frozen_map *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        for (size_t i = 0; i < self->keys.size(); ++i) {
+            repr += comma;
+            repr += "(";
+            repr += py_repr(self->keys[i].get());
+            repr += ", ";
+            repr += py_repr(self->values[i].get());
+            repr += ")";
+            comma = ", ";
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+Py_hash_t pystdcxx_frozen_map::tp_hash(pystdcxx_frozen_map *self)
+{
+    if (self->hash != -1)
+        return self->hash;
+
+    try {
+        py_hasher hasher;
+        for (size_t i = 0; i < self->keys.size(); ++i) {
+            hasher.add(self->keys[i].get());
+            hasher.add(self->values[i].get());
+        }
+
+        self->hash = hasher.result();
+        return self->hash;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+static int equal_objects(const std::vector<py_ptr<PyObject>> &lhs, const std::vector<py_ptr<PyObject>> &rhs)
+{
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        int result = PyObject_RichCompareBool(lhs[i].get(), rhs[i].get(), Py_EQ);
+        if (result <= 0)
+            return result;
+    }
+
+    return 1;
+}
+
+PyObject *pystdcxx_frozen_map::tp_richcompare(pystdcxx_frozen_map *self, PyObject *other, int op)
+{
+    if ((op != Py_EQ && op != Py_NE) || !py_type<pystdcxx_frozen_map>::check(other))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    pystdcxx_frozen_map *rhs = reinterpret_cast<pystdcxx_frozen_map *>(other);
+    int result = 0;
+    if (self->keys.size() == rhs->keys.size() &&
+        (self->hash == -1 || rhs->hash == -1 || self->hash == rhs->hash)) {
+        result = equal_objects(self->keys, rhs->keys);
+        if (result > 0)
+            result = equal_objects(self->values, rhs->values);
+        if (result < 0)
+            return nullptr;
+    }
+
+    return PyBool_FromLong(op == Py_EQ ? result : !result);
+}
+
+PyObject *pystdcxx_frozen_map::tp_iter(pystdcxx_frozen_map *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_frozen_map::sq_length(pystdcxx_frozen_map *self)
+{
+    return self->keys.size();
+}
+
+int pystdcxx_frozen_map::sq_contains(pystdcxx_frozen_map *self, PyObject *key)
+{
+    try {
+        return self->find(py_ptr<PyObject>(key, true)) >= 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+Py_ssize_t pystdcxx_frozen_map::mp_length(pystdcxx_frozen_map *self)
+{
+    return self->keys.size();
+}
+
+PyObject *pystdcxx_frozen_map::mp_subscript(pystdcxx_frozen_map *self, PyObject *key)
+{
+    try {
+        Py_ssize_t index = self->find(py_ptr<PyObject>(key, true));
+        if (index < 0) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+
+        return py_ptr<PyObject>(self->values[index]).release();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_frozen_map::get(pystdcxx_frozen_map *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    try {
+        Py_ssize_t index = self->find(py_ptr<PyObject>(key, true));
+        if (index < 0) {
+            Py_INCREF(def);
+            return def;
+        }
+
+        return py_ptr<PyObject>(self->values[index]).release();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_frozen_map::iterator::tp_iter(pystdcxx_frozen_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_frozen_map::iterator::tp_iternext(pystdcxx_frozen_map::iterator *self)
+{
+    if (self->index >= self->owner->keys.size())
+        return nullptr;
+
+    PyObject *tuple = PyTuple_Pack(2, self->owner->keys[self->index].get(), self->owner->values[self->index].get());
+    ++self->index;
+
+    return tuple;
+}
@@ -0,0 +1,96 @@
+#ifndef PYSTDCXX_FROZEN_MAP_HPP
+#define PYSTDCXX_FROZEN_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <vector>
+#include <algorithm>
+#include "utils.hpp"
+
+// Immutable map stored as sorted arrays of keys and values. Lookups are a
+// binary search over contiguous memory and iteration needs no version
+// check, the hash is computed on first use and cached.
+class pystdcxx_frozen_map: public py_object<pystdcxx_frozen_map>
+{
+public:
+    explicit pystdcxx_frozen_map(const py_less &comp): less(comp.less), cmp(comp.cmp), hash(-1)
+    {
+        maintain_tracking();
+        maintain_tracking(less.get());
+        maintain_tracking(cmp.get());
+    }
+
+    ~pystdcxx_frozen_map()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    void reserve(size_t n)
+    {
+        keys.reserve(n);
+        values.reserve(n);
+    }
+
+    // Items should be appended in ascending order of key
+    void append(const py_ptr<PyObject> &key, const py_ptr<PyObject> &value)
+    {
+        keys.push_back(key);
+        values.push_back(value);
+        maintain_tracking(key.get());
+        maintain_tracking(value.get());
+    }
+
+    static const char *tp_name() { return "pystdcxx.frozen_map"; }
+    static const char *tp_doc() { return "Immutable and hashable map stored as sorted arrays"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_frozen_map *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_frozen_map *self);
+    static PyObject *tp_repr(pystdcxx_frozen_map *self);
+    static Py_hash_t tp_hash(pystdcxx_frozen_map *self);
+    static PyObject *tp_richcompare(pystdcxx_frozen_map *self, PyObject *other, int op);
+    static PyObject *tp_iter(pystdcxx_frozen_map *self);
+    static Py_ssize_t sq_length(pystdcxx_frozen_map *self);
+    static int sq_contains(pystdcxx_frozen_map *self, PyObject *key);
+    static Py_ssize_t mp_length(pystdcxx_frozen_map *self);
+    static PyObject *mp_subscript(pystdcxx_frozen_map *self, PyObject *key);
+    static PyObject *get(pystdcxx_frozen_map *self, PyObject *args);
+
+private:
+    // Index of key, or -1 if it doesn't exist
+    Py_ssize_t find(const py_ptr<PyObject> &key) const
+    {
+        std::vector<py_ptr<PyObject>>::const_iterator iter = py_sorted_find(keys.begin(), keys.end(), key, py_less(less, cmp));
+        if (iter == keys.end())
+            return -1;
+        return iter - keys.begin();
+    }
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_frozen_map *owner):
+            owner(owner, true),
+            index(0)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.frozen_map_iterator"; }
+        static const char *tp_doc() { return "Iterator of frozen map"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_frozen_map> owner;
+        size_t index;
+    };
+
+    std::vector<py_ptr<PyObject>> keys;
+    std::vector<py_ptr<PyObject>> values;
+    py_ptr<PyObject> less;
+    py_ptr<PyObject> cmp;
+    Py_hash_t hash;
+};
+
+#endif // PYSTDCXX_FROZEN_MAP_HPP
@@ -0,0 +1,188 @@
+#include <set>
+#include "frozen_set.hpp"
+
+PyObject *pystdcxx_frozen_set::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr, *less = nullptr, *cmp = nullptr;
+    static const char *kwlist[] = { "tuple", "less", "cmp", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$OO", const_cast<char **>(kwlist), &tuple, &less, &cmp))
+        return nullptr;
+
+    py_ptr<PyObject> comp, three_way;
+    if (less && PyCallable_Check(less)) {
+        comp = py_ptr<PyObject>(less, true);
+    } else if (less && !Py_IsNone(less)) {
+        PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
+        return nullptr;
+    }
+
+    if (cmp && PyCallable_Check(cmp)) {
+        three_way = py_ptr<PyObject>(cmp, true);
+    } else if (cmp && !Py_IsNone(cmp)) {
+        PyErr_SetString(PyExc_ValueError, "cmp argument should be callable type");
+        return nullptr;
+    }
+
+    if (comp.get() && three_way.get()) {
+        PyErr_SetString(PyExc_ValueError, "less and cmp can't be both given");
+        return nullptr;
+    }
+
+    if (tuple && !py_tuple_check(tuple)) {
+        PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+        return nullptr;
+    }
+
+    try {
+        // Sort and deduplicate with a temporary tree
+        std::set<py_ptr<PyObject>, py_less> items{py_less(comp, three_way)};
+        if (tuple) {
+            py_tuple_for_each(tuple, [&items] (PyObject *item) {
+                items.insert(py_ptr<PyObject>(item, true));
+            });
+        }
+
+        py_ptr<pystdcxx_frozen_set> self(new(type) pystdcxx_frozen_set(items.key_comp()));
+        self->reserve(items.size());
+        for (auto iter = items.begin(); iter != items.end(); ++iter)
+            self->append(*iter);
+
+        return reinterpret_cast<PyObject *>(self.release());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create frozen set object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_frozen_set::tp_traverse(pystdcxx_frozen_set *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (self->less.get())
+        Py_VISIT(self->less.get());
+
+    if (self->cmp.get())
+        Py_VISIT(self->cmp.get());
+
+    for (size_t i = 0; i < self->keys.size(); ++i)
+        Py_VISIT(self->keys[i].get());
+
+    return 0;
+}
+
+int pystdcxx_frozen_set::tp_clear(pystdcxx_frozen_set *self)
+{
+    std::vector<py_ptr<PyObject>> keys(std::move(self->keys));
+    py_ptr<PyObject> less(self->less.release());
+    py_ptr<PyObject> cmp(self->cmp.release());
+    return 0;
+}
+
+PyObject *pystdcxx_frozen_set::tp_repr(pystdcxx_frozen_set *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        for (size_t i = 0; i < self->keys.size(); ++i) {
+            repr += comma;
+            repr += py_repr(self->keys[i].get());
+            comma = ", ";
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+Py_hash_t pystdcxx_frozen_set::tp_hash(pystdcxx_frozen_set *self)
+{
+    if (self->hash != -1)
+        return self->hash;
+
+    try {
+        py_hasher hasher;
+        for (size_t i = 0; i < self->keys.size(); ++i)
+            hasher.add(self->keys[i].get());
+
+        self->hash = hasher.result();
+        return self->hash;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+PyObject *pystdcxx_frozen_set::tp_richcompare(pystdcxx_frozen_set *self, PyObject *other, int op)
+{
+    if ((op != Py_EQ && op != Py_NE) || !py_type<pystdcxx_frozen_set>::check(other))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    pystdcxx_frozen_set *rhs = reinterpret_cast<pystdcxx_frozen_set *>(other);
+    int result = 0;
+    if (self->keys.size() == rhs->keys.size() &&
+        (self->hash == -1 || rhs->hash == -1 || self->hash == rhs->hash)) {
+        result = 1;
+        for (size_t i = 0; result > 0 && i < self->keys.size(); ++i)
+            result = PyObject_RichCompareBool(self->keys[i].get(), rhs->keys[i].get(), Py_EQ);
+        if (result < 0)
+            return nullptr;
+    }
+
+    return PyBool_FromLong(op == Py_EQ ? result : !result);
+}
+
+PyObject *pystdcxx_frozen_set::tp_iter(pystdcxx_frozen_set *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_frozen_set::sq_length(pystdcxx_frozen_set *self)
+{
+    return self->keys.size();
+}
+
+int pystdcxx_frozen_set::sq_contains(pystdcxx_frozen_set *self, PyObject *key)
+{
+    try {
+        return self->find(py_ptr<PyObject>(key, true)) >= 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+PyObject *pystdcxx_frozen_set::iterator::tp_iter(pystdcxx_frozen_set::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_frozen_set::iterator::tp_iternext(pystdcxx_frozen_set::iterator *self)
+{
+    if (self->index >= self->owner->keys.size())
+        return nullptr;
+
+    PyObject *item = self->owner->keys[self->index].get();
+    ++self->index;
+
+    Py_INCREF(item);
+    return item;
+}
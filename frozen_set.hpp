@@ -0,0 +1,86 @@
+#ifndef PYSTDCXX_FROZEN_SET_HPP
+#define PYSTDCXX_FROZEN_SET_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <vector>
+#include <algorithm>
+#include "utils.hpp"
+
+// Immutable set stored as a sorted array, see pystdcxx_frozen_map.
+class pystdcxx_frozen_set: public py_object<pystdcxx_frozen_set>
+{
+public:
+    explicit pystdcxx_frozen_set(const py_less &comp): less(comp.less), cmp(comp.cmp), hash(-1)
+    {
+        maintain_tracking();
+        maintain_tracking(less.get());
+        maintain_tracking(cmp.get());
+    }
+
+    ~pystdcxx_frozen_set()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    void reserve(size_t n)
+    {
+        keys.reserve(n);
+    }
+
+    // Items should be appended in ascending order
+    void append(const py_ptr<PyObject> &key)
+    {
+        keys.push_back(key);
+        maintain_tracking(key.get());
+    }
+
+    static const char *tp_name() { return "pystdcxx.frozen_set"; }
+    static const char *tp_doc() { return "Immutable and hashable set stored as a sorted array"; }
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_frozen_set *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_frozen_set *self);
+    static PyObject *tp_repr(pystdcxx_frozen_set *self);
+    static Py_hash_t tp_hash(pystdcxx_frozen_set *self);
+    static PyObject *tp_richcompare(pystdcxx_frozen_set *self, PyObject *other, int op);
+    static PyObject *tp_iter(pystdcxx_frozen_set *self);
+    static Py_ssize_t sq_length(pystdcxx_frozen_set *self);
+    static int sq_contains(pystdcxx_frozen_set *self, PyObject *key);
+
+private:
+    // Index of key, or -1 if it doesn't exist
+    Py_ssize_t find(const py_ptr<PyObject> &key) const
+    {
+        std::vector<py_ptr<PyObject>>::const_iterator iter = py_sorted_find(keys.begin(), keys.end(), key, py_less(less, cmp));
+        if (iter == keys.end())
+            return -1;
+        return iter - keys.begin();
+    }
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_frozen_set *owner):
+            owner(owner, true),
+            index(0)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.frozen_set_iterator"; }
+        static const char *tp_doc() { return "Iterator of frozen set"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_frozen_set> owner;
+        size_t index;
+    };
+
+    std::vector<py_ptr<PyObject>> keys;
+    py_ptr<PyObject> less;
+    py_ptr<PyObject> cmp;
+    Py_hash_t hash;
+};
+
+#endif // PYSTDCXX_FROZEN_SET_HPP
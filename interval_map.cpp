@@ -0,0 +1,347 @@
+#include "interval_map.hpp"
+
+PyMethodDef *pystdcxx_interval_map::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "assign",       (PyCFunction)pystdcxx_interval_map::assign,       METH_VARARGS, "Assign value to [lower, upper), splitting and coalescing intervals" },
+        { "erase",        (PyCFunction)pystdcxx_interval_map::erase,        METH_VARARGS, "Erase [lower, upper), splitting intervals on the boundary" },
+        { "clear",        (PyCFunction)pystdcxx_interval_map::clear,        METH_NOARGS,  "Clear all intervals" },
+        { "containing",   (PyCFunction)pystdcxx_interval_map::containing,   METH_O,       "Return (lower, upper, value) of the interval containing key or None" },
+        { "overlapping",  (PyCFunction)pystdcxx_interval_map::overlapping,  METH_VARARGS, "Return list of (lower, upper, value) overlapping [lower, upper)" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+int pystdcxx_interval_map::tp_init(pystdcxx_interval_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr, *less = nullptr;
+    static const char *kwlist[] = { "tuple", "less", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$O", const_cast<char **>(kwlist), &tuple, &less))
+        return -1;
+
+    if (less) {
+        if (PyCallable_Check(less)) {
+            self->less = py_ptr<PyObject>(less, true);
+            self->maintain_tracking(less);
+            self->map = stdcxx_map(py_less(self->less));
+            ++self->version;
+        } else if (!Py_IsNone(less)) {
+            PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
+            return -1;
+        }
+    }
+
+    if (tuple) {
+        try {
+            if (py_tuple_check(tuple)) {
+                py_tuple_for_each(tuple, [self] (PyObject *item) {
+                    if (py_tuple_get_size(item) != 3)
+                        throw std::runtime_error("Invalid lower/upper/value triple");
+                    py_ptr<PyObject> triple(PySequence_Tuple(item));
+                    if (!triple.get())
+                        throw std::runtime_error("Invalid lower/upper/value triple");
+                    py_ptr<PyObject> result(assign(self, triple.get()));
+                    if (!result.get())
+                        throw std::runtime_error("Assign interval error");
+                });
+            } else {
+                PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+                return -1;
+            }
+        } catch (std::exception &e) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+PyObject *pystdcxx_interval_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) pystdcxx_interval_map());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create interval map object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_interval_map::tp_traverse(pystdcxx_interval_map *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (self->less.get())
+        Py_VISIT(self->less.get());
+
+    if (self->map.key_comp().less.get())
+        Py_VISIT(self->map.key_comp().less.get());
+
+    for (stdcxx_map::iterator iter = self->map.begin(); iter != self->map.end(); ++iter) {
+        Py_VISIT(iter->first.get());
+        Py_VISIT(iter->second.upper.get());
+        Py_VISIT(iter->second.value.get());
+    }
+
+    return 0;
+}
+
+int pystdcxx_interval_map::tp_clear(pystdcxx_interval_map *self)
+{
+    stdcxx_map map(std::move(self->map));
+    py_ptr<PyObject> less(self->less.release());
+    ++self->version;
+    return 0;
+}
+
+PyObject *pystdcxx_interval_map::tp_repr(pystdcxx_interval_map *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        for (stdcxx_map::iterator iter = self->map.begin(); iter != self->map.end(); ++iter) {
+            repr += comma;
+            repr += "[";
+            repr += py_repr(iter->first.get());
+            repr += ", ";
+            repr += py_repr(iter->second.upper.get());
+            repr += "): ";
+            repr += py_repr(iter->second.value.get());
+            comma = ", ";
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_interval_map::tp_iter(pystdcxx_interval_map *self)
+{
+    return reinterpret_cast<PyObject *>(new(self) iterator(self, self->map.begin(), self->map.end()));
+}
+
+Py_ssize_t pystdcxx_interval_map::mp_length(pystdcxx_interval_map *self)
+{
+    return self->map.size();
+}
+
+PyObject *pystdcxx_interval_map::mp_subscript(pystdcxx_interval_map *self, PyObject *key)
+{
+    try {
+        stdcxx_map::iterator iter = self->find_containing(py_ptr<PyObject>(key, true));
+        if (iter == self->map.end()) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+
+        PyObject *value = iter->second.value.get();
+        Py_INCREF(value);
+        return value;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+pystdcxx_interval_map::stdcxx_map::iterator pystdcxx_interval_map::find_containing(const py_ptr<PyObject> &key)
+{
+    stdcxx_map::iterator iter = map.upper_bound(key);
+    if (iter == map.begin())
+        return map.end();
+
+    --iter;
+    if (!map.key_comp()(key, iter->second.upper))
+        return map.end();
+
+    return iter;
+}
+
+// Make key a boundary by cutting the interval which strictly contains it
+void pystdcxx_interval_map::split(const py_ptr<PyObject> &key)
+{
+    stdcxx_map::iterator iter = find_containing(key);
+    if (iter == map.end() || !map.key_comp()(iter->first, key))
+        return;
+
+    map.emplace_hint(std::next(iter), key, interval{ iter->second.upper, iter->second.value });
+    iter->second.upper = key;
+}
+
+void pystdcxx_interval_map::erase_range(const py_ptr<PyObject> &lower, const py_ptr<PyObject> &upper)
+{
+    split(lower);
+    split(upper);
+    map.erase(map.lower_bound(lower), map.lower_bound(upper));
+}
+
+// Merge an interval with adjacent neighbours holding an equal value
+void pystdcxx_interval_map::coalesce(stdcxx_map::iterator iter)
+{
+    if (iter != map.begin()) {
+        stdcxx_map::iterator prev = std::prev(iter);
+        if (equal(prev->second.upper, iter->first)) {
+            int result = PyObject_RichCompareBool(prev->second.value.get(), iter->second.value.get(), Py_EQ);
+            if (result < 0)
+                throw std::runtime_error("Compare two object error");
+            if (result) {
+                prev->second.upper = iter->second.upper;
+                map.erase(iter);
+                iter = prev;
+            }
+        }
+    }
+
+    stdcxx_map::iterator next = std::next(iter);
+    if (next != map.end() && equal(iter->second.upper, next->first)) {
+        int result = PyObject_RichCompareBool(iter->second.value.get(), next->second.value.get(), Py_EQ);
+        if (result < 0)
+            throw std::runtime_error("Compare two object error");
+        if (result) {
+            iter->second.upper = next->second.upper;
+            map.erase(next);
+        }
+    }
+}
+
+PyObject *pystdcxx_interval_map::assign(pystdcxx_interval_map *self, PyObject *args)
+{
+    PyObject *lower, *upper, *value;
+    if (!PyArg_ParseTuple(args, "OOO", &lower, &upper, &value))
+        return nullptr;
+
+    try {
+        py_ptr<PyObject> lower_key(lower, true), upper_key(upper, true);
+        if (!self->map.key_comp()(lower_key, upper_key)) {
+            PyErr_SetString(PyExc_ValueError, "lower should be less than upper");
+            return nullptr;
+        }
+
+        ++self->version;
+        self->erase_range(lower_key, upper_key);
+        stdcxx_map::iterator iter = self->map.emplace(lower_key, interval{ upper_key, py_ptr<PyObject>(value, true) }).first;
+        self->maintain_tracking(lower);
+        self->maintain_tracking(upper);
+        self->maintain_tracking(value);
+        self->coalesce(iter);
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_interval_map::erase(pystdcxx_interval_map *self, PyObject *args)
+{
+    PyObject *lower, *upper;
+    if (!PyArg_ParseTuple(args, "OO", &lower, &upper))
+        return nullptr;
+
+    try {
+        py_ptr<PyObject> lower_key(lower, true), upper_key(upper, true);
+        if (!self->map.key_comp()(lower_key, upper_key))
+            Py_RETURN_NONE;
+
+        ++self->version;
+        self->erase_range(lower_key, upper_key);
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_interval_map::clear(pystdcxx_interval_map *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->map.empty())
+        ++self->version;
+    self->map.clear();
+    Py_RETURN_NONE;
+}
+
+static PyObject *make_triple(PyObject *lower, PyObject *upper, PyObject *value)
+{
+    return PyTuple_Pack(3, lower, upper, value);
+}
+
+PyObject *pystdcxx_interval_map::containing(pystdcxx_interval_map *self, PyObject *key)
+{
+    try {
+        stdcxx_map::iterator iter = self->find_containing(py_ptr<PyObject>(key, true));
+        if (iter == self->map.end())
+            Py_RETURN_NONE;
+
+        return make_triple(iter->first.get(), iter->second.upper.get(), iter->second.value.get());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_interval_map::overlapping(pystdcxx_interval_map *self, PyObject *args)
+{
+    PyObject *lower, *upper;
+    if (!PyArg_ParseTuple(args, "OO", &lower, &upper))
+        return nullptr;
+
+    py_ptr<PyObject> list(PyList_New(0));
+    if (!list.get())
+        return nullptr;
+
+    try {
+        py_ptr<PyObject> lower_key(lower, true), upper_key(upper, true);
+        if (!self->map.key_comp()(lower_key, upper_key))
+            return list.release();
+
+        // Intervals are disjoint, only the one before lower_bound may reach into the range
+        stdcxx_map::iterator iter = self->map.lower_bound(lower_key);
+        if (iter != self->map.begin() && self->map.key_comp()(lower_key, std::prev(iter)->second.upper))
+            --iter;
+
+        for (; iter != self->map.end() && self->map.key_comp()(iter->first, upper_key); ++iter) {
+            py_ptr<PyObject> item(make_triple(iter->first.get(), iter->second.upper.get(), iter->second.value.get()));
+            if (!item.get() || PyList_Append(list.get(), item.get()) < 0)
+                return nullptr;
+        }
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    return list.release();
+}
+
+PyObject *pystdcxx_interval_map::iterator::tp_iter(pystdcxx_interval_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_interval_map::iterator::tp_iternext(pystdcxx_interval_map::iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change interval map while iterating");
+        return nullptr;
+    }
+
+    if (self->first == self->last)
+        return nullptr;
+
+    PyObject *triple = make_triple(self->first->first.get(), self->first->second.upper.get(), self->first->second.value.get());
+    ++self->first;
+
+    return triple;
+}
@@ -0,0 +1,98 @@
+#ifndef PYSTDCXX_INTERVAL_MAP_HPP
+#define PYSTDCXX_INTERVAL_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <map>
+#include <iterator>
+#include "utils.hpp"
+
+// Map of disjoint half open intervals [lower, upper) to values, like a
+// range map rather than an interval tree. Intervals never overlap: assign()
+// overwrites whatever part of [lower, upper) was assigned before, splitting
+// the intervals on its boundaries and coalescing equal neighbours. Storing
+// overlapping intervals isn't supported.
+//
+// As intervals are disjoint, at most one contains a key and the intervals
+// overlapping a range are consecutive in order of lower bound. A std::map
+// keyed by the lower bound answers both queries with one descent plus a
+// walk over the results, without a subtree max-end augmentation.
+class pystdcxx_interval_map: public py_object<pystdcxx_interval_map>
+{
+private:
+    struct interval
+    {
+        py_ptr<PyObject> upper;
+        py_ptr<PyObject> value;
+    };
+
+    typedef std::map<py_ptr<PyObject>, interval, py_less> stdcxx_map;
+
+public:
+    pystdcxx_interval_map(): version(0), map(py_less(py_ptr<PyObject>()))
+    {
+        maintain_tracking();
+    }
+
+    ~pystdcxx_interval_map()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static const char *tp_name() { return "pystdcxx.interval_map"; }
+    static const char *tp_doc() { return "Map of disjoint half open intervals to values, overlapping intervals are overwritten"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(pystdcxx_interval_map *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_interval_map *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_interval_map *self);
+    static PyObject *tp_repr(pystdcxx_interval_map *self);
+    static PyObject *tp_iter(pystdcxx_interval_map *self);
+    static Py_ssize_t mp_length(pystdcxx_interval_map *self);
+    static PyObject *mp_subscript(pystdcxx_interval_map *self, PyObject *key);
+    static PyObject *assign(pystdcxx_interval_map *self, PyObject *args);
+    static PyObject *erase(pystdcxx_interval_map *self, PyObject *args);
+    static PyObject *clear(pystdcxx_interval_map *self, PyObject *args);
+    static PyObject *containing(pystdcxx_interval_map *self, PyObject *key);
+    static PyObject *overlapping(pystdcxx_interval_map *self, PyObject *args);
+
+private:
+    bool equal(const py_ptr<PyObject> &lhs, const py_ptr<PyObject> &rhs) const
+    {
+        return !map.key_comp()(lhs, rhs) && !map.key_comp()(rhs, lhs);
+    }
+
+    stdcxx_map::iterator find_containing(const py_ptr<PyObject> &key);
+    void split(const py_ptr<PyObject> &key);
+    void erase_range(const py_ptr<PyObject> &lower, const py_ptr<PyObject> &upper);
+    void coalesce(stdcxx_map::iterator iter);
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_interval_map *owner, stdcxx_map::iterator first, stdcxx_map::iterator last):
+            owner(owner, true),
+            version(owner->version),
+            first(first),
+            last(last)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.interval_map_iterator"; }
+        static const char *tp_doc() { return "Python wrapper for std::map::iterator of interval map"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_interval_map> owner;
+        uint32_t version;
+        stdcxx_map::iterator first, last;
+    };
+
+    unsigned int version;
+    stdcxx_map map;
+    py_ptr<PyObject> less;
+};
+
+#endif // PYSTDCXX_INTERVAL_MAP_HPP
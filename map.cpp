@@ -5,8 +5,26 @@ PyMethodDef *pystdcxx_map::tp_methods()
     static PyMethodDef methods[] = {
         { "clear",        (PyCFunction)pystdcxx_map::clear,    METH_NOARGS,  "Clear all items" },
         { "reverse",      (PyCFunction)pystdcxx_map::reverse,  METH_NOARGS,  "Find an item and return an iterator" },
+        { "iter_chunks",  (PyCFunction)pystdcxx_map::iter_chunks,      METH_VARARGS | METH_KEYWORDS,   "Return an iterator of lists of up to count items" },
         { "find",         (PyCFunction)pystdcxx_map::find,     METH_O,       "Find an item and return an iterator" },
         { "popitem",      (PyCFunction)pystdcxx_map::popitem,  METH_VARARGS | METH_KEYWORDS,       "Pop and remove the first/last item" },
+        { "pop_n",        (PyCFunction)pystdcxx_map::pop_n,    METH_VARARGS | METH_KEYWORDS,       "Pop and remove up to count first/last items as a list" },
+        { "pop_range",    (PyCFunction)pystdcxx_map::pop_range, METH_VARARGS, "Pop and remove items in [first, last) as a list" },
+        { "pop_until",    (PyCFunction)pystdcxx_map::pop_until, METH_O,       "Pop and remove items less than key as a list" },
+        { "pop_while",    (PyCFunction)pystdcxx_map::pop_while, METH_O,       "Pop and remove leading items while predicate(item) is true" },
+        { "cursor",       (PyCFunction)pystdcxx_map::cursor,   METH_VARARGS | METH_KEYWORDS,       "Create a cursor which survives modification, optionally seeking to key" },
+        { "freeze",       (PyCFunction)pystdcxx_map::freeze,   METH_NOARGS,  "Return an immutable and hashable copy stored as a sorted array" },
+        { "snapshot",     (PyCFunction)pystdcxx_map::snapshot, METH_NOARGS,  "Return a read only view of the current items in O(1)" },
+        { "diff",         (PyCFunction)pystdcxx_map::diff,     METH_O,       "Return (added, removed, changed) items of other compared with this map" },
+        { "join",         (PyCFunction)pystdcxx_map::join,     METH_VARARGS | METH_KEYWORDS,       "Join with other map by key, how is inner/left/outer" },
+        { "dump",         (PyCFunction)pystdcxx_map::dump,     METH_VARARGS | METH_KEYWORDS,       "Write items to file object in jsonl/csv/binary format" },
+        { "get",          (PyCFunction)pystdcxx_map::get,      METH_VARARGS, "Return value of key, or default if key doesn't exist" },
+        { "setdefault",   (PyCFunction)pystdcxx_map::setdefault, METH_VARARGS, "Return value of key, insert default first if key doesn't exist" },
+        { "pop",          (PyCFunction)pystdcxx_map::pop,      METH_VARARGS, "Remove key and return its value, or default if key doesn't exist" },
+        { "append",       (PyCFunction)pystdcxx_map::append,   METH_VARARGS, "Insert an item whose key is greater than all keys in the map" },
+        { "incr",         (PyCFunction)pystdcxx_map::incr,     METH_VARARGS | METH_KEYWORDS,       "Add delta to value of key, which starts from 0, and return the result" },
+        { "upsert",       (PyCFunction)pystdcxx_map::upsert,   METH_VARARGS | METH_KEYWORDS,       "Set value of key to fn(value), value is default if key doesn't exist" },
+        { "changes_since", (PyCFunction)pystdcxx_map::changes_since, METH_O, "Return (version, changes) after version, changes is None if the caller must rescan" },
         { nullptr },
     };
 
@@ -15,20 +33,73 @@ PyMethodDef *pystdcxx_map::tp_methods()
 
 int pystdcxx_map::tp_init(pystdcxx_map *self, PyObject *args, PyObject *kwds)
 {
-    PyObject *tuple = nullptr, *less = nullptr;
-    static const char *kwlist[] = { "tuple", "less", nullptr };
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$O", const_cast<char **>(kwlist), &tuple, &less))
+    PyObject *tuple = nullptr, *less = nullptr, *cmp = nullptr, *changelog = nullptr;
+    int intern = 0;
+    static const char *kwlist[] = { "tuple", "less", "cmp", "changelog", "intern", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$OOOp", const_cast<char **>(kwlist), &tuple, &less, &cmp, &changelog, &intern))
         return -1;
 
+    if (!self->prepare_modify())
+        return -1;
+
+    if (changelog && !Py_IsNone(changelog)) {
+        Py_ssize_t n = PyLong_AsSsize_t(changelog);
+        if (n == -1 && PyErr_Occurred())
+            return -1;
+        if (n < 0) {
+            PyErr_SetString(PyExc_ValueError, "changelog should not be negative");
+            return -1;
+        }
+        if (n == 0)
+            self->changelog.reset();
+        else if (self->changelog)
+            self->changelog->limit = n;
+        else
+            self->changelog.reset(new change_log(n));
+    }
+
+    if (intern) {
+        intern_table *table = py_intern_table(reinterpret_cast<PyObject *>(self));
+        if (!table)
+            return -1;
+        self->interned = py_ptr<intern_table>(table, true);
+    }
+
+    // A new comparator starts an empty tree, consumers of the log must
+    // drop the items of the old one
+    bool had_items = !self->map.empty();
     if (less) {
         if (PyCallable_Check(less)) {
             self->less = py_ptr<PyObject>(less, true);
+            self->map = stdcxx_map(py_less(self->less), self->map.tree().node_type());
+            self->maintain_tracking(less);
+            ++self->version;
         } else if (!Py_IsNone(less)) {
             PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
             return -1;
         }
     }
 
+    if (cmp) {
+        if (less && !Py_IsNone(less) && !Py_IsNone(cmp)) {
+            PyErr_SetString(PyExc_ValueError, "less and cmp can't be both given");
+            return -1;
+        }
+
+        if (PyCallable_Check(cmp)) {
+            self->cmp = py_ptr<PyObject>(cmp, true);
+            self->map = stdcxx_map(py_less(self->less, self->cmp), self->map.tree().node_type());
+            self->maintain_tracking(cmp);
+            ++self->version;
+        } else if (!Py_IsNone(cmp)) {
+            PyErr_SetString(PyExc_ValueError, "cmp argument should be callable type");
+            return -1;
+        }
+    }
+
+    if (had_items && self->map.empty())
+        self->record_change('c', nullptr, nullptr);
+
     if (tuple) {
         try {
             if (py_tuple_check(tuple)) {
@@ -37,7 +108,7 @@ int pystdcxx_map::tp_init(pystdcxx_map *self, PyObject *args, PyObject *kwds)
                     PyObject *value = py_tuple_get_item(item, 1);
                     if (!key || !value)
                         throw std::runtime_error("Invalie key/value pair");
-                    self->map.emplace(py_ptr<PyObject>(key, true), py_ptr<PyObject>(value, true));
+                    self->insert(key, value, false);
                 });
             } else {
                 PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
@@ -66,9 +137,36 @@ PyObject *pystdcxx_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwd
 
 int pystdcxx_map::tp_traverse(pystdcxx_map *self, visitproc visit, void *arg)
 {
+    // Instances of heap types own a reference to their type
+    Py_VISIT(Py_TYPE(self));
+
     if (self->less.get())
         Py_VISIT(self->less.get());
 
+    if (self->cmp.get())
+        Py_VISIT(self->cmp.get());
+
+    if (self->interned.get())
+        Py_VISIT(self->interned.get());
+
+    if (self->changelog) {
+        for (auto iter = self->changelog->changes.begin(); iter != self->changelog->changes.end(); ++iter) {
+            Py_VISIT(iter->key.get());
+            Py_VISIT(iter->value.get());
+        }
+    }
+
+    if (self->map.key_comp().less.get())
+        Py_VISIT(self->map.key_comp().less.get());
+
+    if (self->map.key_comp().cmp.get())
+        Py_VISIT(self->map.key_comp().cmp.get());
+
+    // Items of a big map are held by its tree nodes, which may be shared
+    // with snapshots and visit their items on their own
+    if (!self->map.small())
+        return self->map.tree().traverse(visit, arg);
+
     for (stdcxx_map::iterator iter = self->map.begin(); iter != self->map.end(); ++iter) {
         Py_VISIT(iter->first.get());
         Py_VISIT(iter->second.get());
@@ -77,10 +175,18 @@ int pystdcxx_map::tp_traverse(pystdcxx_map *self, visitproc visit, void *arg)
     return 0;
 }
 
+// Items are released after the map is empty, their finalizers may look
+// at it
 int pystdcxx_map::tp_clear(pystdcxx_map *self)
 {
     stdcxx_map map(std::move(self->map));
-    py_ptr<PyObject> less(self->less);
+    self->map = stdcxx_map(py_less(py_ptr<PyObject>()), map.tree().node_type());
+
+    py_ptr<PyObject> less(self->less.release());
+    py_ptr<PyObject> cmp(self->cmp.release());
+    py_ptr<intern_table> interned(self->interned.release());
+    std::unique_ptr<change_log> changelog(std::move(self->changelog));
+    ++self->version;
     return 0;
 }
 
@@ -111,7 +217,7 @@ PyObject *pystdcxx_map::tp_repr(pystdcxx_map *self)
 
 PyObject *pystdcxx_map::tp_iter(pystdcxx_map *self)
 {
-    return reinterpret_cast<PyObject *>(new iterator(self, self->map.begin(), self->map.end()));
+    return reinterpret_cast<PyObject *>(new(self) iterator(self, self->map.begin(), self->map.end()));
 }
 
 Py_ssize_t pystdcxx_map::sq_length(pystdcxx_map *self)
@@ -126,8 +232,9 @@ int pystdcxx_map::sq_contains(pystdcxx_map *self, PyObject *value)
 
 PyObject *pystdcxx_map::sq_inplace_concat(pystdcxx_map *self, PyObject *tuple)
 {
-    size_t size = self->map.size();
-    
+    if (!self->prepare_modify())
+        return nullptr;
+
     try {
         if (py_tuple_check(tuple)) {
             py_tuple_for_each(tuple, [self] (PyObject *item) {
@@ -135,23 +242,18 @@ PyObject *pystdcxx_map::sq_inplace_concat(pystdcxx_map *self, PyObject *tuple)
                 PyObject *value = py_tuple_get_item(item, 1);
                 if (!key || !value)
                     throw std::runtime_error("Invalie key/value pair");
-                self->map.emplace(py_ptr<PyObject>(key, true), py_ptr<PyObject>(value, true));
+                self->insert(key, value, false);
             });
         } else {
             PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
             return nullptr;
         }
     } catch (std::exception &e) {
-        if (size != self->map.size())
-            ++self->version;
         if (!PyErr_Occurred())
             PyErr_SetString(PyExc_RuntimeError, e.what());
         return nullptr;
     }
 
-    if (size != self->map.size())
-        ++self->version;
-
     Py_INCREF(self);
     return reinterpret_cast<PyObject *>(self);
 }
@@ -163,6 +265,9 @@ Py_ssize_t pystdcxx_map::mp_length(pystdcxx_map *self)
 
 PyObject *pystdcxx_map::mp_subscript(pystdcxx_map *self, PyObject *key)
 {
+    if (PySlice_Check(key))
+        return self->slice(py_key_range(), key);
+
     try {
         stdcxx_map::iterator iter = self->map.find(py_ptr<PyObject>(key, true));
         if (iter == self->map.end()) {
@@ -187,13 +292,18 @@ PyObject *pystdcxx_map::mp_subscript(pystdcxx_map *self, PyObject *key)
 int pystdcxx_map::mp_ass_subscript(pystdcxx_map *self, PyObject *key, PyObject *value)
 {
     try {
+        if (!self->prepare_modify())
+            return -1;
+
         if (!value) {
             if (self->map.erase(py_ptr<PyObject>(key, true)) <= 0) {
                 PyErr_SetString(PyExc_KeyError, "Key error");
                 return -1;
             }
+            ++self->version;
+            self->record_change('d', key, nullptr);
         } else {
-            self->map[py_ptr<PyObject>(key, true)] = py_ptr<PyObject>(value, true);
+            self->insert(key, value, true);
         }
 
         return 0;
@@ -210,19 +320,51 @@ int pystdcxx_map::mp_ass_subscript(pystdcxx_map *self, PyObject *key, PyObject *
 
 PyObject *pystdcxx_map::clear(pystdcxx_map *self, PyObject *Py_UNUSED(args))
 {
+    if (self->readonly) {
+        PyErr_SetString(PyExc_TypeError, "Can't change map snapshot");
+        return nullptr;
+    }
+
+    if (self->map.empty())
+        Py_RETURN_NONE;
+
+    ++self->version;
     self->map.clear();
+    self->record_change('c', nullptr, nullptr);
     Py_RETURN_NONE;
 }
 
 PyObject *pystdcxx_map::reverse(pystdcxx_map *self, PyObject *Py_UNUSED(args))
 {
-    return reinterpret_cast<PyObject *>(new reverse_iterator(self, self->map.rbegin(), self->map.rend()));
+    return reinterpret_cast<PyObject *>(new(self) reverse_iterator(self, self->map.rbegin(), self->map.rend()));
+}
+
+PyObject *pystdcxx_map::iter_chunks(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    Py_ssize_t count;
+    int reverse = 0;
+    static const char *kwlist[] = { "count", "reverse", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|$p", const_cast<char **>(kwlist), &count, &reverse))
+        return nullptr;
+
+    if (count <= 0) {
+        PyErr_SetString(PyExc_ValueError, "count should be positive");
+        return nullptr;
+    }
+
+    if (reverse) {
+        py_ptr<reverse_iterator> inner(new(self) reverse_iterator(self, self->map.rbegin(), self->map.rend()));
+        return reinterpret_cast<PyObject *>(new(self) chunk_iterator<reverse_iterator>(inner.get(), count));
+    }
+
+    py_ptr<iterator> inner(new(self) iterator(self, self->map.begin(), self->map.end()));
+    return reinterpret_cast<PyObject *>(new(self) chunk_iterator<iterator>(inner.get(), count));
 }
 
 PyObject *pystdcxx_map::find(pystdcxx_map *self, PyObject *key)
 {
     try {
-        return reinterpret_cast<PyObject*>(new iterator(self,
+        return reinterpret_cast<PyObject*>(new(self) iterator(self,
                                                         self->map.find(py_ptr<PyObject>(key, true)),
                                                         self->map.end()));
     } catch (std::exception &e) {
@@ -260,6 +402,14 @@ PyObject *pystdcxx_map::popitem(pystdcxx_map *self, PyObject *args, PyObject *kw
         return NULL;
     }
 
+    try {
+        if (!self->prepare_modify())
+            return NULL;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+
     stdcxx_map::iterator iter;
     if (is_last && PyObject_IsTrue(is_last)) {
         iter = self->map.end();
@@ -269,51 +419,1223 @@ PyObject *pystdcxx_map::popitem(pystdcxx_map *self, PyObject *args, PyObject *kw
     }
 
     PyObject *tuple = make_tuple(iter->first.get(), iter->second.get());
+    self->record_change('d', iter->first.get(), nullptr);
     self->map.erase(iter);
+    ++self->version;
 
     return tuple;
 }
 
-PyObject *pystdcxx_map::iterator::tp_iter(pystdcxx_map::iterator *self)
+// Create a view of base range narrowed by slice
+PyObject *pystdcxx_map::slice(const py_key_range &base, PyObject *slice)
 {
-    Py_INCREF(self);
-    return reinterpret_cast<PyObject *>(self);
+    try {
+        py_key_range range(base);
+        if (!range.narrow(map.key_comp(), slice))
+            return nullptr;
+
+        return reinterpret_cast<PyObject *>(new(this) range_view(this, range));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
 }
 
-PyObject *pystdcxx_map::iterator::tp_iternext(pystdcxx_map::iterator *self)
+PyObject *pystdcxx_map::erase_to_list(stdcxx_map::iterator first, stdcxx_map::iterator last, bool reverse)
 {
-    if (self->version != self->owner->version) {
-        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+    py_ptr<PyObject> list(PyList_New(std::distance(first, last)));
+    if (!list.get())
         return nullptr;
+
+    Py_ssize_t index = reverse ? PyList_GET_SIZE(list.get()) - 1 : 0;
+    for (stdcxx_map::iterator iter = first; iter != last; ++iter) {
+        PyObject *item = make_tuple(iter->first.get(), iter->second.get());
+        if (!item)
+            return nullptr;
+        PyList_SET_ITEM(list.get(), index, item);
+        index += reverse ? -1 : 1;
     }
 
-    if (self->first == self->last)
+    for (stdcxx_map::iterator iter = first; iter != last; ++iter)
+        record_change('d', iter->first.get(), nullptr);
+
+    if (first != last) {
+        map.erase(first, last);
+        ++version;
+    }
+
+    return list.release();
+}
+
+PyObject *pystdcxx_map::pop_n(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    Py_ssize_t count = 0;
+    PyObject *is_last = nullptr;
+    static const char *kwlist[] = { "count", "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|O", const_cast<char **>(kwlist), &count, &is_last))
         return nullptr;
 
-    PyObject *tuple = make_tuple(self->first->first.get(), self->first->second.get());
-    ++self->first;
+    if (count < 0) {
+        PyErr_SetString(PyExc_ValueError, "count should not be negative");
+        return nullptr;
+    }
 
-    return tuple;
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        count = std::min<size_t>(count, self->map.size());
+        if (is_last && PyObject_IsTrue(is_last))
+            return self->erase_to_list(std::prev(self->map.end(), count), self->map.end(), true);
+        else
+            return self->erase_to_list(self->map.begin(), std::next(self->map.begin(), count), false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
 }
 
-PyObject *pystdcxx_map::reverse_iterator::tp_iter(pystdcxx_map::reverse_iterator *self)
+PyObject *pystdcxx_map::pop_range(pystdcxx_map *self, PyObject *args)
 {
-    Py_INCREF(self);
-    return reinterpret_cast<PyObject *>(self);
+    PyObject *first, *last;
+    if (!PyArg_ParseTuple(args, "OO", &first, &last))
+        return nullptr;
+
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        py_ptr<PyObject> lower(first, true), upper(last, true);
+        if (self->map.key_comp()(upper, lower))
+            return PyList_New(0);
+
+        return self->erase_to_list(self->map.lower_bound(lower), self->map.lower_bound(upper), false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
 }
 
-PyObject *pystdcxx_map::reverse_iterator::tp_iternext(pystdcxx_map::reverse_iterator *self)
+PyObject *pystdcxx_map::pop_until(pystdcxx_map *self, PyObject *key)
 {
-    if (self->version != self->owner->version) {
-        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        return self->erase_to_list(self->map.begin(), self->map.lower_bound(py_ptr<PyObject>(key, true)), false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
         return nullptr;
     }
+}
 
-    if (self->first == self->last)
+PyObject *pystdcxx_map::pop_while(pystdcxx_map *self, PyObject *predicate)
+{
+    if (!PyCallable_Check(predicate)) {
+        PyErr_SetString(PyExc_ValueError, "predicate should be callable type");
         return nullptr;
+    }
 
-    PyObject *tuple = make_tuple(self->first->first.get(), self->first->second.get());
-    ++self->first;
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
 
-    return tuple;
+        unsigned int version = self->version;
+        stdcxx_map::iterator last = self->map.begin();
+        for (; last != self->map.end(); ++last) {
+            py_ptr<PyObject> item(make_tuple(last->first.get(), last->second.get()));
+            if (!item.get())
+                return nullptr;
+
+            py_ptr<PyObject> result(PyObject_CallOneArg(predicate, item.get()));
+            if (!result.get())
+                return nullptr;
+
+            if (version != self->version) {
+                PyErr_SetString(PyExc_RuntimeError, "Can't change map while popping");
+                return nullptr;
+            }
+
+            int is_true = PyObject_IsTrue(result.get());
+            if (is_true < 0)
+                return nullptr;
+            if (!is_true)
+                break;
+        }
+
+        return self->erase_to_list(self->map.begin(), last, false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::dump(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *file = nullptr, *first = nullptr, *last = nullptr;
+    const char *format = "jsonl";
+    Py_ssize_t chunk_size = 65536;
+    static const char *kwlist[] = { "file", "format", "chunk_size", "first", "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|sn$OO", const_cast<char **>(kwlist),
+                                     &file, &format, &chunk_size, &first, &last))
+        return nullptr;
+
+    try {
+        py_dump_writer writer(file, format, chunk_size);
+        unsigned int version = self->version;
+
+        // Formatting items runs Python code, which may change the map. Walk
+        // a copy, which shares the tree nodes, and check the version after
+        // every item.
+        stdcxx_map tree(self->map);
+        stdcxx_map::iterator iter = tree.begin(), end = tree.end();
+        if (first && !Py_IsNone(first))
+            iter = tree.lower_bound(py_ptr<PyObject>(first, true));
+        if (last && !Py_IsNone(last))
+            end = tree.lower_bound(py_ptr<PyObject>(last, true));
+        if (first && !Py_IsNone(first) && last && !Py_IsNone(last) &&
+            tree.key_comp()(py_ptr<PyObject>(last, true), py_ptr<PyObject>(first, true)))
+            end = iter;
+
+        for (; iter != end; ++iter) {
+            py_ptr<PyObject> key(iter->first), value(iter->second);
+            writer.put(key.get(), value.get());
+            if (version != self->version) {
+                PyErr_SetString(PyExc_RuntimeError, "Can't change map while dumping");
+                return nullptr;
+            }
+        }
+
+        writer.flush();
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::cursor(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *key = nullptr;
+    static const char *kwlist[] = { "key", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &key))
+        return nullptr;
+
+    try {
+        py_ptr<pystdcxx_map::cursor_iterator> result(new(self) pystdcxx_map::cursor_iterator(self));
+        if (key && !Py_IsNone(key)) {
+            py_ptr<PyObject> found(pystdcxx_map::cursor_iterator::seek(result.get(), key));
+            if (!found.get())
+                return nullptr;
+        }
+
+        return reinterpret_cast<PyObject *>(result.release());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::snapshot(pystdcxx_map *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) pystdcxx_map(*self, true));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create map snapshot failure");
+        return nullptr;
+    }
+}
+
+// Walk two trees ordered by the same comparator in one pass, callback is
+// called with the item of each side, or nullptr if the key is missing.
+template <typename M, typename F>
+static void merge_trees(const M &lhs, const M &rhs, F callback)
+{
+    typename M::key_compare less(lhs.key_comp());
+    typename M::const_iterator l = lhs.begin(), r = rhs.begin();
+
+    while (l != lhs.end() && r != rhs.end()) {
+        if (less(l->first, r->first)) {
+            callback(&*l, nullptr);
+            ++l;
+        } else if (less(r->first, l->first)) {
+            callback(nullptr, &*r);
+            ++r;
+        } else {
+            callback(&*l, &*r);
+            ++l;
+            ++r;
+        }
+    }
+
+    for (; l != lhs.end(); ++l)
+        callback(&*l, nullptr);
+
+    for (; r != rhs.end(); ++r)
+        callback(nullptr, &*r);
+}
+
+static void list_append(PyObject *list, PyObject *item)
+{
+    py_ptr<PyObject> holder(item);
+    if (!item || PyList_Append(list, item) < 0)
+        throw std::runtime_error("Append item to list error");
+}
+
+bool pystdcxx_map::check_same_order(pystdcxx_map *self, PyObject *other)
+{
+    if (!PyObject_TypeCheck(other, py_type<pystdcxx_map>::get(self))) {
+        PyErr_SetString(PyExc_TypeError, "Require map type");
+        return false;
+    }
+
+    pystdcxx_map *rhs = reinterpret_cast<pystdcxx_map *>(other);
+    if (self->less.get() != rhs->less.get() || self->cmp.get() != rhs->cmp.get()) {
+        PyErr_SetString(PyExc_ValueError, "Both maps should be ordered by the same less function");
+        return false;
+    }
+
+    return true;
+}
+
+PyObject *pystdcxx_map::diff(pystdcxx_map *self, PyObject *other)
+{
+    if (!check_same_order(self, other))
+        return nullptr;
+
+    py_ptr<PyObject> added(PyList_New(0)), removed(PyList_New(0)), changed(PyList_New(0));
+    if (!added.get() || !removed.get() || !changed.get())
+        return nullptr;
+
+    try {
+        // Walk copies, writes from comparators don't change the nodes they share
+        stdcxx_map lhs(self->map), rhs(reinterpret_cast<pystdcxx_map *>(other)->map);
+        merge_trees(lhs, rhs, [&] (const stdcxx_map::value_type *l, const stdcxx_map::value_type *r) {
+            if (!l) {
+                list_append(added.get(), make_tuple(r->first.get(), r->second.get()));
+            } else if (!r) {
+                list_append(removed.get(), make_tuple(l->first.get(), l->second.get()));
+            } else {
+                int equal = PyObject_RichCompareBool(l->second.get(), r->second.get(), Py_EQ);
+                if (equal < 0)
+                    throw std::runtime_error("Compare two object error");
+                if (!equal)
+                    list_append(changed.get(), PyTuple_Pack(3, l->first.get(), l->second.get(), r->second.get()));
+            }
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    return PyTuple_Pack(3, added.get(), removed.get(), changed.get());
+}
+
+PyObject *pystdcxx_map::join(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *other = nullptr;
+    const char *how = "inner";
+    static const char *kwlist[] = { "other", "how", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|s", const_cast<char **>(kwlist), &other, &how))
+        return nullptr;
+
+    bool keep_left, keep_right;
+    if (!strcmp(how, "inner")) {
+        keep_left = keep_right = false;
+    } else if (!strcmp(how, "left")) {
+        keep_left = true;
+        keep_right = false;
+    } else if (!strcmp(how, "outer")) {
+        keep_left = keep_right = true;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "how should be one of inner, left or outer");
+        return nullptr;
+    }
+
+    if (!check_same_order(self, other))
+        return nullptr;
+
+    py_ptr<PyObject> result(PyList_New(0));
+    if (!result.get())
+        return nullptr;
+
+    try {
+        stdcxx_map lhs(self->map), rhs(reinterpret_cast<pystdcxx_map *>(other)->map);
+        merge_trees(lhs, rhs, [&] (const stdcxx_map::value_type *l, const stdcxx_map::value_type *r) {
+            if (l && r)
+                list_append(result.get(), PyTuple_Pack(3, l->first.get(), l->second.get(), r->second.get()));
+            else if (l && keep_left)
+                list_append(result.get(), PyTuple_Pack(3, l->first.get(), l->second.get(), Py_None));
+            else if (r && keep_right)
+                list_append(result.get(), PyTuple_Pack(3, r->first.get(), Py_None, r->second.get()));
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    return result.release();
+}
+
+PyObject *pystdcxx_map::freeze(pystdcxx_map *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        py_ptr<pystdcxx_frozen_map> result(new(self) pystdcxx_frozen_map(self->map.key_comp()));
+        result->reserve(self->map.size());
+        for (stdcxx_map::iterator iter = self->map.begin(); iter != self->map.end(); ++iter)
+            result->append(iter->first, iter->second);
+
+        return reinterpret_cast<PyObject *>(result.release());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+int pystdcxx_map::api_check(PyObject *ob)
+{
+    return py_type<pystdcxx_map>::check(ob);
+}
+
+Py_ssize_t pystdcxx_map::api_size(PyObject *self)
+{
+    return reinterpret_cast<pystdcxx_map *>(self)->map.size();
+}
+
+int pystdcxx_map::api_insert(PyObject *self, PyObject *key, PyObject *value)
+{
+    pystdcxx_map *map = reinterpret_cast<pystdcxx_map *>(self);
+    try {
+        if (!map->prepare_modify())
+            return -1;
+
+        size_t size = map->map.size();
+        map->insert(key, value, true);
+        return size != map->map.size();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_map::api_find(PyObject *self, PyObject *key, PyObject **value)
+{
+    pystdcxx_map *map = reinterpret_cast<pystdcxx_map *>(self);
+    try {
+        stdcxx_map::iterator iter = map->map.find(py_ptr<PyObject>(key, true));
+        if (iter == map->map.end())
+            return 0;
+
+        *value = py_ptr<PyObject>(iter->second).release();
+        return 1;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_map::api_erase(PyObject *self, PyObject *key)
+{
+    pystdcxx_map *map = reinterpret_cast<pystdcxx_map *>(self);
+    try {
+        if (!map->prepare_modify())
+            return -1;
+
+        if (!map->map.erase(py_ptr<PyObject>(key, true)))
+            return 0;
+
+        ++map->version;
+        map->record_change('d', key, nullptr);
+        return 1;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_map::api_lower_bound(PyObject *self, PyObject *key, PyObject **found, PyObject **value)
+{
+    pystdcxx_map *map = reinterpret_cast<pystdcxx_map *>(self);
+    try {
+        stdcxx_map::iterator iter = map->map.lower_bound(py_ptr<PyObject>(key, true));
+        if (iter == map->map.end())
+            return 0;
+
+        *found = py_ptr<PyObject>(iter->first).release();
+        *value = py_ptr<PyObject>(iter->second).release();
+        return 1;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_map::api_for_each(PyObject *self, PyObject *lower, PyObject *upper, pystdcxx_visitproc visit, void *arg)
+{
+    // Keep the map alive and walk a copy of its items, the visitor may drop
+    // the last reference of the map or change it.
+    py_ptr<pystdcxx_map> map(reinterpret_cast<pystdcxx_map *>(self), true);
+    stdcxx_map tree(map->map);
+    uint32_t version = map->version;
+
+    try {
+        stdcxx_map::iterator first = lower ? tree.lower_bound(py_ptr<PyObject>(lower, true)) : tree.begin();
+        stdcxx_map::iterator last = upper ? tree.lower_bound(py_ptr<PyObject>(upper, true)) : tree.end();
+        if (lower && upper && tree.key_comp()(py_ptr<PyObject>(upper, true), py_ptr<PyObject>(lower, true)))
+            last = first;
+
+        for (; first != last; ++first) {
+            int result = visit(first->first.get(), first->second.get(), arg);
+            if (result)
+                return result < 0 ? -1 : 0;
+
+            if (version != map->version) {
+                PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+                return -1;
+            }
+        }
+
+        return 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+// Find key with a single descent, pos is where key is or would be inserted
+bool pystdcxx_map::locate(const py_ptr<PyObject> &key, stdcxx_map::iterator &pos)
+{
+    bool found;
+    pos = map.locate(key, found);
+    return found;
+}
+
+// Key object to store, equal str and bytes keys share one object if the
+// map was created with intern=True
+py_ptr<PyObject> pystdcxx_map::make_key(PyObject *key)
+{
+    if (interned.get())
+        return interned->intern(key);
+
+    return py_ptr<PyObject>(key, true);
+}
+
+// Insert an item with the end hint, keys arriving in increasing order as
+// timestamps or sequence numbers take two comparisons instead of a descent,
+// other keys pay one extra comparison before the usual descent. The value
+// of an existing key is replaced only if overwrite is true.
+bool pystdcxx_map::insert(PyObject *key, PyObject *value, bool overwrite)
+{
+    size_t size = map.size();
+    stdcxx_map::iterator iter = map.emplace_hint(map.end(), make_key(key), py_ptr<PyObject>(value, true));
+    if (size != map.size())
+        ++version;
+    else if (!overwrite)
+        return false;
+    else if (map.assign(iter, py_ptr<PyObject>(value, true)))
+        ++version;  // The path was shared and copied, iterators are stale
+
+    record_change('s', iter->first.get(), value);
+    maintain_tracking(key);
+    maintain_tracking(value);
+    return true;
+}
+
+// Set value at a position returned by locate, pos is the insertion hint
+// if key wasn't found so no second descent is needed.
+void pystdcxx_map::store(stdcxx_map::iterator pos, bool found, const py_ptr<PyObject> &key, PyObject *value)
+{
+    if (found) {
+        if (map.assign(pos, py_ptr<PyObject>(value, true)))
+            ++version;
+    } else {
+        pos = map.emplace_hint(pos, make_key(key.get()), py_ptr<PyObject>(value, true));
+        ++version;
+    }
+
+    record_change('s', pos->first.get(), value);
+    maintain_tracking(key.get());
+    maintain_tracking(value);
+}
+
+PyObject *pystdcxx_map::append(pystdcxx_map *self, PyObject *args)
+{
+    PyObject *key, *value;
+    if (!PyArg_ParseTuple(args, "OO", &key, &value))
+        return nullptr;
+
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        py_ptr<PyObject> k(key, true);
+        if (!self->map.empty() && !self->map.key_comp()(std::prev(self->map.end())->first, k)) {
+            PyErr_SetString(PyExc_ValueError, "Key should be greater than the last key");
+            return nullptr;
+        }
+
+        self->store(self->map.end(), false, k, value);
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::get(pystdcxx_map *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    try {
+        stdcxx_map::iterator pos;
+        PyObject *value = self->locate(py_ptr<PyObject>(key, true), pos) ? pos->second.get() : def;
+        Py_INCREF(value);
+        return value;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::setdefault(pystdcxx_map *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        py_ptr<PyObject> k(key, true);
+        stdcxx_map::iterator pos;
+        if (self->locate(k, pos))
+            return py_ptr<PyObject>(pos->second).release();
+
+        self->store(pos, false, k, def);
+        Py_INCREF(def);
+        return def;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::pop(pystdcxx_map *self, PyObject *args)
+{
+    PyObject *key, *def = nullptr;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    try {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        stdcxx_map::iterator pos;
+        if (!self->locate(py_ptr<PyObject>(key, true), pos)) {
+            if (!def) {
+                PyErr_SetString(PyExc_KeyError, "Key error");
+                return nullptr;
+            }
+            Py_INCREF(def);
+            return def;
+        }
+
+        py_ptr<PyObject> value(pos->second);
+        self->record_change('d', pos->first.get(), nullptr);
+        self->map.erase(pos);
+        ++self->version;
+        return value.release();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+// Replace value of key with fn(value), or with value + delta if fn is
+// nullptr, where value is def if key doesn't exist. Python code called
+// here may change the map, the position is looked up again if it did.
+PyObject *pystdcxx_map::update(PyObject *key, PyObject *fn, PyObject *delta, PyObject *def)
+{
+    try {
+        if (!prepare_modify())
+            return nullptr;
+
+        py_ptr<PyObject> k(key, true);
+        stdcxx_map::iterator pos;
+        bool found = locate(k, pos);
+
+        unsigned int before = version;
+        py_ptr<PyObject> value(found ? pos->second : py_ptr<PyObject>(def, true));
+        py_ptr<PyObject> result(fn ? PyObject_CallOneArg(fn, value.get()) : PyNumber_Add(value.get(), delta));
+        if (!result.get())
+            return nullptr;
+
+        if (before != version) {
+            if (!prepare_modify())
+                return nullptr;
+            found = locate(k, pos);
+        }
+
+        store(pos, found, k, result.get());
+        return result.release();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::incr(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *key, *delta = nullptr;
+    static const char *kwlist[] = { "key", "delta", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char **>(kwlist), &key, &delta))
+        return nullptr;
+
+    py_ptr<PyObject> one, zero(PyLong_FromLong(0));
+    if (!delta) {
+        one = py_ptr<PyObject>(PyLong_FromLong(1));
+        delta = one.get();
+    }
+    if (!delta || !zero.get())
+        return nullptr;
+
+    return self->update(key, nullptr, delta, zero.get());
+}
+
+PyObject *pystdcxx_map::upsert(pystdcxx_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *key, *fn, *def = Py_None;
+    static const char *kwlist[] = { "key", "fn", "default", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|O", const_cast<char **>(kwlist), &key, &fn, &def))
+        return nullptr;
+
+    if (!PyCallable_Check(fn)) {
+        PyErr_SetString(PyExc_ValueError, "fn should be callable type");
+        return nullptr;
+    }
+
+    return self->update(key, fn, nullptr, def);
+}
+
+// Append a change to the log if it's enabled. Once a clear is logged the
+// earlier changes are useless, a consumer of any version can catch up by
+// clearing its copy, so they are dropped without forcing a rescan.
+void pystdcxx_map::record_change(char op, PyObject *key, PyObject *value)
+{
+    if (!changelog)
+        return;
+
+    change_log &log = *changelog;
+    ++log.change_seq;
+    if (op == 'c') {
+        log.changes.clear();
+        log.dropped_seq = 0;
+    }
+
+    try {
+        log.changes.push_back(change_record{ log.change_seq, op,
+                                             key ? py_ptr<PyObject>(key, true) : py_ptr<PyObject>(),
+                                             value ? py_ptr<PyObject>(value, true) : py_ptr<PyObject>() });
+    } catch ( ... ) {
+        // Can't keep the log complete, make every consumer rescan
+        log.changes.clear();
+        log.dropped_seq = log.change_seq;
+        return;
+    }
+
+    while (log.changes.size() > log.limit) {
+        log.dropped_seq = log.changes.front().seq;
+        log.changes.pop_front();
+    }
+}
+
+PyObject *pystdcxx_map::changes_since(pystdcxx_map *self, PyObject *version)
+{
+    if (!self->changelog) {
+        PyErr_SetString(PyExc_ValueError, "Change log is not enabled");
+        return nullptr;
+    }
+
+    unsigned long long since = PyLong_AsUnsignedLongLong(version);
+    if (since == (unsigned long long)-1 && PyErr_Occurred())
+        return nullptr;
+
+    const change_log &log = *self->changelog;
+    if (since > log.change_seq) {
+        PyErr_SetString(PyExc_ValueError, "version is newer than the map");
+        return nullptr;
+    }
+
+    py_ptr<PyObject> current(PyLong_FromUnsignedLongLong(log.change_seq));
+    if (!current.get())
+        return nullptr;
+
+    if (since < log.dropped_seq)
+        return PyTuple_Pack(2, current.get(), Py_None);
+
+    // Sequence numbers in the log are contiguous, index directly. A
+    // version before a logged clear starts from the clear.
+    size_t first = 0;
+    if (log.change_seq - since < log.changes.size())
+        first = log.changes.size() - (log.change_seq - since);
+    py_ptr<PyObject> list(PyList_New(log.changes.size() - first));
+    if (!list.get())
+        return nullptr;
+
+    for (size_t i = first; i < log.changes.size(); ++i) {
+        const change_record &change = log.changes[i];
+        const char *op = change.op == 's' ? "set" : change.op == 'd' ? "del" : "clear";
+        PyObject *item = Py_BuildValue("(KsOO)", change.seq, op,
+                                       change.key.get() ? change.key.get() : Py_None,
+                                       change.value.get() ? change.value.get() : Py_None);
+        if (!item)
+            return nullptr;
+        PyList_SET_ITEM(list.get(), i - first, item);
+    }
+
+    return PyTuple_Pack(2, current.get(), list.get());
+}
+
+bool pystdcxx_map::prepare_modify()
+{
+    if (readonly) {
+        PyErr_SetString(PyExc_TypeError, "Can't change map snapshot");
+        return false;
+    }
+
+    return true;
+}
+
+// Build a list of up to count items and advance first past them. Nothing
+// here calls back into Python code, so the caller checks the version once
+// for the whole chunk.
+template<typename I>
+static PyObject *take_items(I &first, const I &last, Py_ssize_t count)
+{
+    py_ptr<PyObject> list(PyList_New(0));
+    if (!list.get())
+        return nullptr;
+
+    for (; count > 0 && first != last; --count, ++first) {
+        py_ptr<PyObject> item(make_tuple(first->first.get(), first->second.get()));
+        if (!item.get() || PyList_Append(list.get(), item.get()) < 0)
+            return nullptr;
+    }
+
+    return list.release();
+}
+
+static bool parse_count(PyObject *value, Py_ssize_t &count)
+{
+    count = PyLong_AsSsize_t(value);
+    if (count == -1 && PyErr_Occurred())
+        return false;
+
+    if (count < 0) {
+        PyErr_SetString(PyExc_ValueError, "count should not be negative");
+        return false;
+    }
+
+    return true;
+}
+
+PyMethodDef *pystdcxx_map::iterator::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "next_n",       (PyCFunction)pystdcxx_map::iterator::next_n,   METH_O,       "Return a list of up to count next items, empty at the end" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_map::iterator::take(Py_ssize_t count)
+{
+    if (version != owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+        return nullptr;
+    }
+
+    return take_items(first, last, count);
+}
+
+PyObject *pystdcxx_map::iterator::next_n(pystdcxx_map::iterator *self, PyObject *count)
+{
+    Py_ssize_t n;
+    if (!parse_count(count, n))
+        return nullptr;
+
+    return self->take(n);
+}
+
+PyObject *pystdcxx_map::iterator::tp_iter(pystdcxx_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_map::iterator::tp_iternext(pystdcxx_map::iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+        return nullptr;
+    }
+
+    if (self->first == self->last)
+        return nullptr;
+
+    PyObject *tuple = make_tuple(self->first->first.get(), self->first->second.get());
+    ++self->first;
+
+    return tuple;
+}
+
+PyMethodDef *pystdcxx_map::reverse_iterator::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "next_n",       (PyCFunction)pystdcxx_map::reverse_iterator::next_n,   METH_O,       "Return a list of up to count next items, empty at the end" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_map::reverse_iterator::take(Py_ssize_t count)
+{
+    if (version != owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+        return nullptr;
+    }
+
+    return take_items(first, last, count);
+}
+
+PyObject *pystdcxx_map::reverse_iterator::next_n(pystdcxx_map::reverse_iterator *self, PyObject *count)
+{
+    Py_ssize_t n;
+    if (!parse_count(count, n))
+        return nullptr;
+
+    return self->take(n);
+}
+
+PyObject *pystdcxx_map::reverse_iterator::tp_iter(pystdcxx_map::reverse_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_map::reverse_iterator::tp_iternext(pystdcxx_map::reverse_iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+        return nullptr;
+    }
+
+    if (self->first == self->last)
+        return nullptr;
+
+    PyObject *tuple = make_tuple(self->first->first.get(), self->first->second.get());
+    ++self->first;
+
+    return tuple;
+}
+
+template<typename I>
+PyObject *pystdcxx_map::chunk_iterator<I>::tp_iter(chunk_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+template<typename I>
+PyObject *pystdcxx_map::chunk_iterator<I>::tp_iternext(chunk_iterator *self)
+{
+    PyObject *list = self->inner->take(self->count);
+    if (list && PyList_GET_SIZE(list) == 0) {
+        Py_DECREF(list);
+        return nullptr;
+    }
+
+    return list;
+}
+
+PyObject *pystdcxx_map::range_view::tp_repr(pystdcxx_map::range_view *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+        auto append = [&] (stdcxx_map::iterator iter) {
+            repr += comma;
+            repr += "(";
+            repr += py_repr(iter->first.get());
+            repr += ", ";
+            repr += py_repr(iter->second.get());
+            repr += ")";
+            comma = ", ";
+        };
+
+        auto bounds = self->range.resolve(self->owner->map);
+        if (self->range.reverse) {
+            for (stdcxx_map::iterator iter = bounds.second; iter != bounds.first;)
+                append(--iter);
+        } else {
+            for (stdcxx_map::iterator iter = bounds.first; iter != bounds.second; ++iter)
+                append(iter);
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::range_view::tp_iter(pystdcxx_map::range_view *self)
+{
+    try {
+        auto bounds = self->range.resolve(self->owner->map);
+        if (self->range.reverse) {
+            return reinterpret_cast<PyObject *>(new(self) reverse_iterator(self->owner.get(),
+                                                                           stdcxx_map::reverse_iterator(bounds.second),
+                                                                           stdcxx_map::reverse_iterator(bounds.first)));
+        }
+
+        return reinterpret_cast<PyObject *>(new(self) iterator(self->owner.get(), bounds.first, bounds.second));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_map::range_view::sq_length(pystdcxx_map::range_view *self)
+{
+    try {
+        auto bounds = self->range.resolve(self->owner->map);
+        return std::distance(bounds.first, bounds.second);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_map::range_view::sq_contains(pystdcxx_map::range_view *self, PyObject *key)
+{
+    try {
+        py_ptr<PyObject> k(key, true);
+        return self->range.contains(self->owner->map.key_comp(), k) && self->owner->map.find(k) != self->owner->map.end();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+Py_ssize_t pystdcxx_map::range_view::mp_length(pystdcxx_map::range_view *self)
+{
+    return sq_length(self);
+}
+
+PyObject *pystdcxx_map::range_view::mp_subscript(pystdcxx_map::range_view *self, PyObject *key)
+{
+    if (PySlice_Check(key))
+        return self->owner->slice(self->range, key);
+
+    try {
+        if (!self->range.contains(self->owner->map.key_comp(), py_ptr<PyObject>(key, true))) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    return pystdcxx_map::mp_subscript(self->owner.get(), key);
+}
+
+PyMethodDef *pystdcxx_map::cursor_iterator::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "seek",          (PyCFunction)pystdcxx_map::cursor_iterator::seek,           METH_O,       "Move to the first item not less than key" },
+        { "next",          (PyCFunction)pystdcxx_map::cursor_iterator::next,           METH_NOARGS,  "Return the next item and move forward" },
+        { "prev",          (PyCFunction)pystdcxx_map::cursor_iterator::prev,           METH_NOARGS,  "Move backward and return the previous item" },
+        { "peek",          (PyCFunction)pystdcxx_map::cursor_iterator::peek,           METH_NOARGS,  "Return the next item without moving, None at the end" },
+        { "erase_current", (PyCFunction)pystdcxx_map::cursor_iterator::erase_current,  METH_NOARGS,  "Erase the item last returned by next/prev" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+void pystdcxx_map::cursor_iterator::sync()
+{
+    if (version == owner->version)
+        return;
+
+    stdcxx_map &map = owner->map;
+    if (!anchor.get())
+        pos = map.begin();
+    else if (inclusive)
+        pos = map.lower_bound(anchor);
+    else
+        pos = map.upper_bound(anchor);
+
+    if (has_current) {
+        current = map.find(anchor);
+        has_current = current != map.end();
+    }
+
+    version = owner->version;
+}
+
+PyObject *pystdcxx_map::cursor_iterator::tp_iter(pystdcxx_map::cursor_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_map::cursor_iterator::tp_iternext(pystdcxx_map::cursor_iterator *self)
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (self->pos == self->owner->map.end())
+        return nullptr;
+
+    self->current = self->pos;
+    self->has_current = true;
+    self->anchor = self->pos->first;
+    self->inclusive = false;
+    ++self->pos;
+
+    return make_tuple(self->current->first.get(), self->current->second.get());
+}
+
+PyObject *pystdcxx_map::cursor_iterator::seek(pystdcxx_map::cursor_iterator *self, PyObject *key)
+{
+    try {
+        py_ptr<PyObject> anchor(key, true);
+        self->pos = self->owner->map.lower_bound(anchor);
+        self->version = self->owner->version;
+        self->anchor = anchor;
+        self->inclusive = true;
+        self->has_current = false;
+        return PyBool_FromLong(self->pos != self->owner->map.end());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_map::cursor_iterator::next(pystdcxx_map::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    PyObject *item = tp_iternext(self);
+    if (!item && !PyErr_Occurred())
+        PyErr_SetNone(PyExc_StopIteration);
+    return item;
+}
+
+PyObject *pystdcxx_map::cursor_iterator::prev(pystdcxx_map::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (self->pos == self->owner->map.begin()) {
+        PyErr_SetNone(PyExc_StopIteration);
+        return nullptr;
+    }
+
+    --self->pos;
+    self->current = self->pos;
+    self->has_current = true;
+    self->anchor = self->pos->first;
+    self->inclusive = true;
+
+    return make_tuple(self->current->first.get(), self->current->second.get());
+}
+
+PyObject *pystdcxx_map::cursor_iterator::peek(pystdcxx_map::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (self->pos == self->owner->map.end())
+        Py_RETURN_NONE;
+
+    return make_tuple(self->pos->first.get(), self->pos->second.get());
+}
+
+PyObject *pystdcxx_map::cursor_iterator::erase_current(pystdcxx_map::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        if (!self->owner->prepare_modify())
+            return nullptr;
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (!self->has_current) {
+        PyErr_SetString(PyExc_KeyError, "No current item");
+        return nullptr;
+    }
+
+    // Current is either at or right before pos, erasing it leaves the
+    // next item at pos in both cases, which also holds after the array of
+    // a small map shifted.
+    self->owner->record_change('d', self->current->first.get(), nullptr);
+    self->pos = self->owner->map.erase(self->current);
+
+    self->has_current = false;
+    ++self->owner->version;
+    self->version = self->owner->version;
+    Py_RETURN_NONE;
 }
@@ -5,16 +5,39 @@
 #include <Python.h>
 #include <pyerrors.h>
 #include <map>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <iterator>
 #include "utils.hpp"
+#include "small_tree.hpp"
+#include "persistent_tree.hpp"
+#include "dump.hpp"
+#include "frozen_map.hpp"
+#include "pystdcxx_api.h"
 
 class pystdcxx_map: public py_object<pystdcxx_map>
 {
 private:
+    typedef small_tree<persistent_tree> stdcxx_map;
 
 public:
-    pystdcxx_map(): version(0), map(py_less(less))
+    pystdcxx_map():
+        version(0), map(py_less(py_ptr<PyObject>()), py_type<persistent_node>::get(this)), readonly(false)
     {
-        PyObject_GC_Track(this);
+        maintain_tracking();
+    }
+
+    // Read only view of the items of rhs. Copying a big map copies the
+    // root reference of its tree only, the nodes are shared until either
+    // side writes to them.
+    pystdcxx_map(const pystdcxx_map &rhs, bool readonly):
+        version(0), map(rhs.map), less(rhs.less), cmp(rhs.cmp), readonly(readonly)
+    {
+        maintain_tracking();
+        if (PyObject_GC_IsTracked(reinterpret_cast<PyObject *>(const_cast<pystdcxx_map *>(&rhs))) &&
+            !PyObject_GC_IsTracked(reinterpret_cast<PyObject *>(this)))
+            PyObject_GC_Track(this);
     }
 
     ~pystdcxx_map()
@@ -41,11 +64,47 @@ public:
     static PyObject *remove(pystdcxx_map *self, PyObject *value);
     static PyObject *clear(pystdcxx_map *self, PyObject *args);
     static PyObject *reverse(pystdcxx_map *self, PyObject *args);
+    static PyObject *iter_chunks(pystdcxx_map *self, PyObject *args, PyObject *kwds);
     static PyObject *find(pystdcxx_map *self, PyObject *value);
     static PyObject *popitem(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *pop_n(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *pop_range(pystdcxx_map *self, PyObject *args);
+    static PyObject *pop_until(pystdcxx_map *self, PyObject *key);
+    static PyObject *pop_while(pystdcxx_map *self, PyObject *predicate);
+    static PyObject *dump(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *cursor(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *freeze(pystdcxx_map *self, PyObject *args);
+    static PyObject *snapshot(pystdcxx_map *self, PyObject *args);
+    static PyObject *diff(pystdcxx_map *self, PyObject *other);
+    static PyObject *join(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *changes_since(pystdcxx_map *self, PyObject *version);
+    static PyObject *append(pystdcxx_map *self, PyObject *args);
+    static PyObject *get(pystdcxx_map *self, PyObject *args);
+    static PyObject *setdefault(pystdcxx_map *self, PyObject *args);
+    static PyObject *pop(pystdcxx_map *self, PyObject *args);
+    static PyObject *incr(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *upsert(pystdcxx_map *self, PyObject *args, PyObject *kwds);
+
+    // C API exported through capsule, see pystdcxx_api.h
+    static int api_check(PyObject *ob);
+    static Py_ssize_t api_size(PyObject *self);
+    static int api_insert(PyObject *self, PyObject *key, PyObject *value);
+    static int api_find(PyObject *self, PyObject *key, PyObject **value);
+    static int api_erase(PyObject *self, PyObject *key);
+    static int api_lower_bound(PyObject *self, PyObject *key, PyObject **found, PyObject **value);
+    static int api_for_each(PyObject *self, PyObject *lower, PyObject *upper, pystdcxx_visitproc visit, void *arg);
 
 private:
-    typedef std::map<py_ptr<PyObject>, py_ptr<PyObject>, py_less> stdcxx_map;
+    bool prepare_modify();
+    static bool check_same_order(pystdcxx_map *self, PyObject *other);
+    PyObject *slice(const py_key_range &base, PyObject *slice);
+    PyObject *erase_to_list(stdcxx_map::iterator first, stdcxx_map::iterator last, bool reverse);
+    void record_change(char op, PyObject *key, PyObject *value);
+    py_ptr<PyObject> make_key(PyObject *key);
+    bool insert(PyObject *key, PyObject *value, bool overwrite);
+    bool locate(const py_ptr<PyObject> &key, stdcxx_map::iterator &pos);
+    void store(stdcxx_map::iterator pos, bool found, const py_ptr<PyObject> &key, PyObject *value);
+    PyObject *update(PyObject *key, PyObject *fn, PyObject *delta, PyObject *def);
 
     class iterator: public py_object<iterator>
     {
@@ -60,8 +119,12 @@ private:
 
         static const char *tp_name() { return "pystdcxx.map_iterator"; }
         static const char *tp_doc() { return "Python wrapper for std::map::iterator"; }
+        static PyMethodDef *tp_methods();
         static PyObject *tp_iter(iterator *self);
         static PyObject *tp_iternext(iterator *self);
+        static PyObject *next_n(iterator *self, PyObject *count);
+
+        PyObject *take(Py_ssize_t count);
 
     private:
         py_ptr<pystdcxx_map> owner;
@@ -82,8 +145,12 @@ private:
 
         static const char *tp_name() { return "pystdcxx.map_reverse_iterator"; }
         static const char *tp_doc() { return "Python wrapper for std::map::reverse_iterator"; }
+        static PyMethodDef *tp_methods();
         static PyObject *tp_iter(reverse_iterator *self);
         static PyObject *tp_iternext(reverse_iterator *self);
+        static PyObject *next_n(reverse_iterator *self, PyObject *count);
+
+        PyObject *take(Py_ssize_t count);
 
     private:
         py_ptr<pystdcxx_map> owner;
@@ -91,9 +158,121 @@ private:
         stdcxx_map::reverse_iterator first, last;
     };
 
+    // Iterator of lists of up to count items taken from inner iterator
+    template<typename I>
+    class chunk_iterator: public py_object<chunk_iterator<I>>
+    {
+    public:
+        chunk_iterator(I *inner, Py_ssize_t count):
+            inner(inner, true),
+            count(count)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.map_chunk_iterator"; }
+        static const char *tp_doc() { return "Iterator of chunks of std::map items"; }
+        static PyObject *tp_iter(chunk_iterator *self);
+        static PyObject *tp_iternext(chunk_iterator *self);
+
+    private:
+        py_ptr<I> inner;
+        Py_ssize_t count;
+    };
+
+    // Lazy view of the items in a key range, taken by slicing. Bounds are
+    // resolved with lower_bound every time the view is used, so nothing
+    // is copied and the view follows later changes of the map.
+    class range_view: public py_object<range_view>
+    {
+    public:
+        range_view(pystdcxx_map *owner, const py_key_range &range):
+            owner(owner, true),
+            range(range)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.map_range"; }
+        static const char *tp_doc() { return "Lazy view of a key range of std::map"; }
+        static PyObject *tp_repr(range_view *self);
+        static PyObject *tp_iter(range_view *self);
+        static Py_ssize_t sq_length(range_view *self);
+        static int sq_contains(range_view *self, PyObject *key);
+        static Py_ssize_t mp_length(range_view *self);
+        static PyObject *mp_subscript(range_view *self, PyObject *key);
+
+    private:
+        py_ptr<pystdcxx_map> owner;
+        py_key_range range;
+    };
+
+    // A cursor sits between two items like a bidirectional iterator. It
+    // remembers the key it was anchored to, so when the map is changed
+    // by others it re-seeks with one lower_bound/upper_bound instead of
+    // becoming invalid.
+    class cursor_iterator: public py_object<cursor_iterator>
+    {
+    public:
+        cursor_iterator(pystdcxx_map *owner):
+            owner(owner, true),
+            version(owner->version),
+            pos(owner->map.begin()),
+            inclusive(false),
+            has_current(false)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.map_cursor"; }
+        static const char *tp_doc() { return "Cursor of std::map which survives modification of the map"; }
+        static PyMethodDef *tp_methods();
+        static PyObject *tp_iter(cursor_iterator *self);
+        static PyObject *tp_iternext(cursor_iterator *self);
+        static PyObject *seek(cursor_iterator *self, PyObject *key);
+        static PyObject *next(cursor_iterator *self, PyObject *args);
+        static PyObject *prev(cursor_iterator *self, PyObject *args);
+        static PyObject *peek(cursor_iterator *self, PyObject *args);
+        static PyObject *erase_current(cursor_iterator *self, PyObject *args);
+
+    private:
+        void sync();
+
+        py_ptr<pystdcxx_map> owner;
+        unsigned int version;
+        stdcxx_map::iterator pos, current;
+        py_ptr<PyObject> anchor;
+        bool inclusive;
+        bool has_current;
+    };
+
     unsigned int version;
-    stdcxx_map map;
-    py_ptr<PyObject> less;    
+    stdcxx_map map;                     // Copied by snapshots, sharing its tree nodes
+    py_ptr<PyObject> less;
+    py_ptr<PyObject> cmp;               // Three-way comparator, used instead of less
+    py_ptr<intern_table> interned;      // Intern table if created with intern=True
+    bool readonly;
+
+    // Bounded log of changes for incremental sync, enabled by changelog=N.
+    // Entries are numbered by change_seq without gaps, a consumer older
+    // than dropped_seq missed evicted entries and has to rescan the map.
+    struct change_record
+    {
+        unsigned long long seq;
+        char op;                        // 's'et, 'd'elete or 'c'lear
+        py_ptr<PyObject> key, value;
+    };
+
+    struct change_log
+    {
+        explicit change_log(size_t limit): limit(limit), change_seq(0), dropped_seq(0) {}
+
+        size_t limit;
+        unsigned long long change_seq;
+        unsigned long long dropped_seq;
+        std::deque<change_record> changes;
+    };
+
+    // Allocated only when the log is enabled, a std::deque allocates its
+    // first block on construction, which every map would pay for
+    std::unique_ptr<change_log> changelog;
 };
 
 #endif // PYSTDCXX_MAP_HPP
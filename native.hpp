@@ -0,0 +1,96 @@
+#ifndef PYSTDCXX_NATIVE_HPP
+#define PYSTDCXX_NATIVE_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <cmath>
+#include <cstdint>
+#include "utils.hpp"
+
+// Element types of typed containers. Keys and values are kept in their C
+// form and only boxed when they cross into Python, object() returns the
+// Python object a value holds, if any, for GC traversal.
+
+struct native_i64
+{
+    typedef int64_t type;
+    static constexpr bool is_object = false;
+
+    static bool unbox(PyObject *ob, type &value)
+    {
+        long long n = PyLong_AsLongLong(ob);
+        if (n == -1 && PyErr_Occurred())
+            return false;
+
+        value = n;
+        return true;
+    }
+
+    static PyObject *box(type value) { return PyLong_FromLongLong(value); }
+    static PyObject *object(type) { return nullptr; }
+};
+
+struct native_f64
+{
+    typedef double type;
+    static constexpr bool is_object = false;
+
+    // NaN has no place in a strict weak order, reject it as key
+    static bool unbox_key(PyObject *ob, type &value)
+    {
+        if (!unbox(ob, value))
+            return false;
+
+        if (std::isnan(value)) {
+            PyErr_SetString(PyExc_ValueError, "NaN can't be a key");
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool unbox(PyObject *ob, type &value)
+    {
+        value = PyFloat_AsDouble(ob);
+        return !(value == -1.0 && PyErr_Occurred());
+    }
+
+    static PyObject *box(type value) { return PyFloat_FromDouble(value); }
+    static PyObject *object(type) { return nullptr; }
+};
+
+struct native_obj
+{
+    typedef py_ptr<PyObject> type;
+    static constexpr bool is_object = true;
+
+    static bool unbox(PyObject *ob, type &value)
+    {
+        value = py_ptr<PyObject>(ob, true);
+        return true;
+    }
+
+    static PyObject *box(const type &value) { return py_ptr<PyObject>(value).release(); }
+    static PyObject *object(const type &value) { return value.get(); }
+};
+
+// Keys use unbox_key() where a type has one
+template<typename K>
+static inline auto native_unbox_key(PyObject *ob, typename K::type &value, int) -> decltype(K::unbox_key(ob, value))
+{
+    return K::unbox_key(ob, value);
+}
+
+template<typename K>
+static inline bool native_unbox_key(PyObject *ob, typename K::type &value, long)
+{
+    return K::unbox(ob, value);
+}
+
+template<typename K>
+static inline bool native_unbox_key(PyObject *ob, typename K::type &value)
+{
+    return native_unbox_key<K>(ob, value, 0);
+}
+
+#endif // PYSTDCXX_NATIVE_HPP
@@ -0,0 +1,715 @@
+#ifndef PYSTDCXX_PERSISTENT_TREE_HPP
+#define PYSTDCXX_PERSISTENT_TREE_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "utils.hpp"
+
+// Node of persistent_tree. Nodes are Python objects so a subtree can be
+// shared by several trees through its reference count, and the collector
+// sees every item once through the node holding it.
+class persistent_node: public py_object<persistent_node>
+{
+public:
+    typedef std::pair<const py_ptr<PyObject>, py_ptr<PyObject>> value_type;
+
+    template<typename... Args>
+    explicit persistent_node(Args&&... args):
+        item(std::forward<Args>(args)...), left(nullptr), right(nullptr), size(1), height(1), tracked(false)
+    {
+    }
+
+    ~persistent_node()
+    {
+        PyObject_GC_UnTrack(this);
+        Py_XDECREF(reinterpret_cast<PyObject *>(left));
+        Py_XDECREF(reinterpret_cast<PyObject *>(right));
+    }
+
+    static const char *tp_name() { return "pystdcxx.persistent_node"; }
+    static const char *tp_doc() { return "Node of a tree shared by a map and its snapshots"; }
+
+    static int tp_traverse(persistent_node *self, visitproc visit, void *arg)
+    {
+        Py_VISIT(Py_TYPE(self));
+        Py_VISIT(self->item.first.get());
+        Py_VISIT(self->item.second.get());
+        Py_VISIT(reinterpret_cast<PyObject *>(self->left));
+        Py_VISIT(reinterpret_cast<PyObject *>(self->right));
+        return 0;
+    }
+
+    // A node is tracked once it holds an object which may form a cycle or
+    // a tracked child, like the containers. The flag saves asking the
+    // collector on every update of the path.
+    void track()
+    {
+        if (!tracked) {
+            tracked = true;
+            PyObject_GC_Track(this);
+        }
+    }
+
+    void track_items()
+    {
+        if (py_may_be_tracked(item.first.get()) || py_may_be_tracked(item.second.get()))
+            track();
+    }
+
+    value_type item;
+    persistent_node *left;      // Owned references
+    persistent_node *right;
+    size_t size;                // Number of nodes in the subtree
+    int height;
+    bool tracked;
+};
+
+// AVL tree with the part of the std::map interface used by small_tree,
+// keyed by Python objects ordered by py_less. Copying a tree copies its
+// root reference only. A node referenced more than once is shared, and
+// writes copy the shared nodes on the path they change, so a snapshot
+// costs O(log n) nodes per write instead of a copy of the whole tree.
+//
+// Every node keeps the size of its subtree and iterators keep their rank,
+// positions are translated to ranks before a change, so restructuring the
+// tree never calls the comparator. Nodes are allocated with the collector
+// paused, a collection run from an allocation could run finalizers which
+// look at the tree while it's half changed. Like std::map, iterators are
+// invalidated by inserts and erases but not by value changes.
+class persistent_tree
+{
+public:
+    typedef py_ptr<PyObject> key_type;
+    typedef py_ptr<PyObject> mapped_type;
+    typedef persistent_node::value_type value_type;
+    typedef py_less key_compare;
+    typedef size_t size_type;
+
+    // An AVL tree of height 64 holds more than 2^44 nodes
+    enum { max_height = 64 };
+
+    template<bool Const>
+    class basic_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef persistent_tree::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type, value_type>::type *pointer;
+        typedef typename std::conditional<Const, const value_type, value_type>::type &reference;
+
+        basic_iterator(): tree_(nullptr), depth_(0), rank_(0) {}
+
+        basic_iterator(const basic_iterator &rhs) { assign(rhs); }
+
+        template<bool C = Const, typename std::enable_if<C, int>::type = 0>
+        basic_iterator(const basic_iterator<false> &rhs) { assign(rhs); }
+
+        basic_iterator &operator=(const basic_iterator &rhs)
+        {
+            assign(rhs);
+            return *this;
+        }
+
+        reference operator*() const { return path_[depth_ - 1]->item; }
+        pointer operator->() const { return &path_[depth_ - 1]->item; }
+
+        basic_iterator &operator++()
+        {
+            persistent_node *node = path_[depth_ - 1];
+            if (node->right) {
+                for (node = node->right; node; node = node->left)
+                    push(node);
+            } else {
+                // Climb until coming up from a left child
+                persistent_node *child;
+                do {
+                    child = path_[--depth_];
+                } while (depth_ > 0 && path_[depth_ - 1]->right == child);
+            }
+            ++rank_;
+            return *this;
+        }
+
+        basic_iterator &operator--()
+        {
+            persistent_node *node = depth_ ? path_[depth_ - 1]->left : tree_->root_;
+            if (node) {
+                for (; node; node = node->right)
+                    push(node);
+            } else {
+                persistent_node *child;
+                do {
+                    child = path_[--depth_];
+                } while (depth_ > 0 && path_[depth_ - 1]->left == child);
+            }
+            --rank_;
+            return *this;
+        }
+
+        basic_iterator operator++(int) { basic_iterator tmp(*this); ++*this; return tmp; }
+        basic_iterator operator--(int) { basic_iterator tmp(*this); --*this; return tmp; }
+
+        bool operator==(const basic_iterator &rhs) const { return node() == rhs.node(); }
+        bool operator!=(const basic_iterator &rhs) const { return !(*this == rhs); }
+
+    private:
+        friend class persistent_tree;
+        template<bool> friend class basic_iterator;
+
+        explicit basic_iterator(const persistent_tree *tree): tree_(tree), depth_(0), rank_(0) {}
+
+        template<bool C>
+        void assign(const basic_iterator<C> &rhs)
+        {
+            tree_ = rhs.tree_;
+            depth_ = rhs.depth_;
+            rank_ = rhs.rank_;
+            std::copy(rhs.path_, rhs.path_ + depth_, path_);
+        }
+
+        persistent_node *node() const { return depth_ ? path_[depth_ - 1] : nullptr; }
+
+        void push(persistent_node *node)
+        {
+            if (depth_ == max_height)
+                throw std::length_error("Tree is too high");
+            path_[depth_++] = node;
+        }
+
+        const persistent_tree *tree_;
+        size_t depth_;              // Nodes on the path, 0 at the end
+        size_t rank_;               // Number of items before the position
+        persistent_node *path_[max_height];
+    };
+
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+
+    persistent_tree(const key_compare &comp, PyTypeObject *node_type):
+        comp_(comp), node_type_(node_type), root_(nullptr), stamp_(0)
+    {
+        if (!node_type_)
+            throw std::runtime_error("Get tree node type error");
+    }
+
+    persistent_tree(const persistent_tree &rhs):
+        comp_(rhs.comp_), node_type_(rhs.node_type_), root_(rhs.root_), stamp_(0)
+    {
+        Py_XINCREF(object(root_));
+    }
+
+    persistent_tree(persistent_tree &&rhs):
+        comp_(rhs.comp_), node_type_(rhs.node_type_), root_(rhs.root_), stamp_(0)
+    {
+        rhs.root_ = nullptr;
+        ++rhs.stamp_;
+    }
+
+    persistent_tree &operator=(persistent_tree &&rhs)
+    {
+        if (this != &rhs) {
+            persistent_node *root = root_;
+            comp_ = rhs.comp_;
+            node_type_ = rhs.node_type_;
+            root_ = rhs.root_;
+            rhs.root_ = nullptr;
+            ++stamp_;
+            ++rhs.stamp_;
+            Py_XDECREF(object(root));
+            release_retired();
+        }
+        return *this;
+    }
+
+    persistent_tree &operator=(const persistent_tree &) = delete;
+
+    ~persistent_tree()
+    {
+        Py_XDECREF(object(root_));
+    }
+
+    key_compare key_comp() const { return comp_; }
+    PyTypeObject *node_type() const { return node_type_; }
+    size_type size() const { return size(root_); }
+    bool empty() const { return !root_; }
+
+    // Visit the nodes held by the tree, for tp_traverse of its owner
+    int traverse(visitproc visit, void *arg) const
+    {
+        Py_VISIT(object(root_));
+        for (const py_ptr<persistent_node> &node: retired_)
+            Py_VISIT(object(node.get()));
+        return 0;
+    }
+
+    iterator begin() { return select(0); }
+    iterator end() { return select(size()); }
+    const_iterator begin() const { return const_cast<persistent_tree *>(this)->select(0); }
+    const_iterator end() const { return const_cast<persistent_tree *>(this)->select(size()); }
+
+    // K is a key or a py_probe
+    template<typename K>
+    iterator lower_bound(const K &key)
+    {
+        iterator iter(this);
+        size_t depth = 0, rank = 0, found = size();
+        for (persistent_node *node = root_; node; ) {
+            iter.push(node);
+            if (!comp_(node->item.first, key)) {
+                depth = iter.depth_;
+                found = rank + size(node->left);
+                node = node->left;
+            } else {
+                rank += size(node->left) + 1;
+                node = node->right;
+            }
+        }
+
+        iter.depth_ = depth;
+        iter.rank_ = found;
+        return iter;
+    }
+
+    iterator upper_bound(const key_type &key)
+    {
+        iterator iter(this);
+        size_t depth = 0, rank = 0, found = size();
+        for (persistent_node *node = root_; node; ) {
+            iter.push(node);
+            if (comp_(key, node->item.first)) {
+                depth = iter.depth_;
+                found = rank + size(node->left);
+                node = node->left;
+            } else {
+                rank += size(node->left) + 1;
+                node = node->right;
+            }
+        }
+
+        iter.depth_ = depth;
+        iter.rank_ = found;
+        return iter;
+    }
+
+    // Insert an item unless its key exists, hint is checked as std::map
+    // does. The comparator may run Python code which changes the tree, the
+    // insert is refused then since the position found is stale.
+    template<typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args)
+    {
+        value_type item(std::forward<Args>(args)...);
+        size_t stamp = stamp_;
+        bool found;
+        size_t rank = position(hint, item.first, found);
+        if (stamp != stamp_)
+            throw std::runtime_error("Tree changed while comparing keys");
+
+        if (!found) {
+            gc_pause pause;
+            py_ptr<persistent_node> leaf(new(node_type_) persistent_node(std::move(item)));
+            leaf->track_items();
+            insert_at(rank, leaf);
+            ++stamp_;
+        }
+
+        iterator iter = select(rank);
+        if (!found)
+            release_retired();
+        return iter;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        size_t rank = pos.rank_;
+        py_ptr<persistent_node> removed;
+        {
+            gc_pause pause;
+            removed = py_ptr<persistent_node>(erase_at(rank));
+            ++stamp_;
+        }
+
+        iterator iter = select(rank);
+        release_retired();
+        return iter;
+    }
+
+    // Removed nodes are chained through their left child and released once
+    // the tree is consistent, releasing them may run finalizers.
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        size_t rank = first.rank_, count = last.rank_ - first.rank_;
+        if (count == 0)
+            return select(rank);
+
+        if (count == size()) {
+            clear();
+            return end();
+        }
+
+        persistent_node *removed = nullptr;
+        try {
+            gc_pause pause;
+            for (; count > 0; --count) {
+                persistent_node *node = erase_at(rank);
+                node->left = removed;
+                removed = node;
+            }
+        } catch ( ... ) {
+            ++stamp_;
+            release(removed);
+            throw;
+        }
+
+        ++stamp_;
+        iterator iter = select(rank);
+        release(removed);
+        release_retired();
+        return iter;
+    }
+
+    void clear()
+    {
+        if (!root_)
+            return;
+
+        persistent_node *root = root_;
+        root_ = nullptr;
+        ++stamp_;
+        Py_XDECREF(object(root));
+        release_retired();
+    }
+
+    // Replace the value at pos, pos is moved to the node holding it.
+    // Returns true if the path to pos was shared and copied, iterators
+    // other than pos are then stale and the caller must treat the write
+    // as a change of the tree. The nodes copied are retired rather than
+    // released, so stale iterators still point at live nodes until the
+    // next insert or erase frees them.
+    bool assign(iterator &pos, const mapped_type &value)
+    {
+        bool shared = false;
+        for (size_t i = 0; i < pos.depth_; ++i)
+            shared = shared || Py_REFCNT(object(pos.path_[i])) > 1;
+
+        if (!shared) {
+            mapped_type old(pos->second);
+            pos->second = value;
+            pos.path_[pos.depth_ - 1]->track_items();
+            for (size_t i = pos.depth_ - 1; i > 0 && pos.path_[i]->tracked; --i)
+                pos.path_[i - 1]->track();
+            return false;
+        }
+
+        {
+            gc_pause pause;
+            assign(root_, pos.rank_, value);
+        }
+        pos = select(pos.rank_);
+        return true;
+    }
+
+private:
+    // Pause the collector while nodes are allocated during a change
+    struct gc_pause
+    {
+        gc_pause(): enabled(PyGC_Disable()) {}
+        ~gc_pause() { if (enabled) PyGC_Enable(); }
+        int enabled;
+    };
+
+    static PyObject *object(persistent_node *node) { return reinterpret_cast<PyObject *>(node); }
+    static size_t size(persistent_node *node) { return node ? node->size : 0; }
+    static int height(persistent_node *node) { return node ? node->height : 0; }
+
+    static bool tracked(persistent_node *node) { return node && node->tracked; }
+
+    // Recompute size, height and tracking of node from its children
+    static void update(persistent_node *node)
+    {
+        node->size = size(node->left) + size(node->right) + 1;
+        node->height = std::max(height(node->left), height(node->right)) + 1;
+        if (tracked(node->left) || tracked(node->right))
+            node->track();
+    }
+
+    static void release(persistent_node *chain)
+    {
+        while (chain) {
+            persistent_node *next = chain->left;
+            chain->left = nullptr;
+            Py_DECREF(object(chain));
+            chain = next;
+        }
+    }
+
+    iterator select(size_t rank)
+    {
+        iterator iter(this);
+        iter.rank_ = rank;
+        if (rank >= size())
+            return iter;
+
+        for (persistent_node *node = root_; node; ) {
+            size_t left = size(node->left);
+            if (rank == left) {
+                iter.push(node);
+                return iter;
+            }
+
+            iter.push(node);
+            if (rank < left) {
+                node = node->left;
+            } else {
+                rank -= left + 1;
+                node = node->right;
+            }
+        }
+
+        iter.depth_ = 0;
+        return iter;
+    }
+
+    // Rank where key goes, found tells whether an item at rank has key
+    size_t position(const_iterator hint, const key_type &key, bool &found)
+    {
+        found = false;
+        if (!hint.node()) {
+            if (!root_)
+                return 0;
+
+            const_iterator last(hint);
+            --last;
+            if (comp_(last->first, key))
+                return hint.rank_;
+        } else if (comp_(key, hint->first)) {
+            if (hint.rank_ == 0)
+                return 0;
+
+            const_iterator before(hint);
+            --before;
+            if (comp_(before->first, key))
+                return hint.rank_;
+        } else if (comp_(hint->first, key)) {
+            const_iterator after(hint);
+            ++after;
+            if (!after.node() || comp_(key, after->first))
+                return after.rank_;
+        } else {
+            found = true;
+            return hint.rank_;
+        }
+
+        iterator iter = lower_bound(key);
+        found = iter.node() && !comp_(key, iter->first);
+        return iter.rank_;
+    }
+
+    // Make the node in slot referenced by slot only, a shared node is
+    // replaced by a copy sharing its children
+    void own(persistent_node *&slot, bool retire=false)
+    {
+        if (Py_REFCNT(object(slot)) == 1)
+            return;
+
+        if (retire)
+            retired_.reserve(retired_.size() + 1);
+
+        persistent_node *node = new(node_type_) persistent_node(slot->item);
+        node->left = slot->left;
+        node->right = slot->right;
+        node->size = slot->size;
+        node->height = slot->height;
+        Py_XINCREF(object(node->left));
+        Py_XINCREF(object(node->right));
+        if (slot->tracked)
+            node->track();
+
+        if (retire)
+            retired_.push_back(py_ptr<persistent_node>(slot));
+        else
+            Py_DECREF(object(slot));
+        slot = node;
+    }
+
+    // Called once the tree is consistent, releasing nodes may run finalizers
+    void release_retired()
+    {
+        std::vector<py_ptr<persistent_node>> retired;
+        retired.swap(retired_);
+    }
+
+    // Nodes are owned on the way down before anything is changed, so if a
+    // copy can't be allocated the tree is left as it was. On the way up
+    // only sizes change once a subtree keeps its height.
+    void insert_at(size_t rank, py_ptr<persistent_node> &leaf)
+    {
+        persistent_node **path[max_height];
+        size_t depth = 0;
+        persistent_node **slot = &root_;
+        while (*slot) {
+            own(*slot);
+            path[depth++] = slot;
+            persistent_node *node = *slot;
+            size_t left = size(node->left);
+            if (rank <= left) {
+                slot = &node->left;
+            } else {
+                rank -= left + 1;
+                slot = &node->right;
+            }
+        }
+
+        *slot = leaf.release();
+        bool tracked = (*slot)->tracked;
+        while (depth > 0) {
+            persistent_node *&node = *path[--depth];
+            int height = node->height;
+            rebalance(node);
+            if (node->height == height)
+                break;
+        }
+
+        for (; depth > 0; --depth) {
+            persistent_node *node = *path[depth - 1];
+            ++node->size;
+            if (tracked)
+                node->track();
+        }
+    }
+
+    // Unlink the node at rank and return it without children
+    persistent_node *erase_at(size_t rank)
+    {
+        persistent_node **path[max_height];
+        size_t depth = 0;
+        persistent_node **slot = &root_;
+        for (;;) {
+            own(*slot);
+            path[depth++] = slot;
+            persistent_node *node = *slot;
+            size_t left = size(node->left);
+            if (rank == left)
+                break;
+
+            if (rank < left) {
+                slot = &node->left;
+            } else {
+                rank -= left + 1;
+                slot = &node->right;
+            }
+        }
+
+        persistent_node *node = *slot, *removed = node;
+        if (node->left && node->right) {
+            // The successor takes the place of node and leaves with the
+            // item of node
+            for (slot = &node->right; ; slot = &(*slot)->left) {
+                own(*slot);
+                path[depth++] = slot;
+                if (!(*slot)->left)
+                    break;
+            }
+
+            removed = *slot;
+            value_type item(node->item);
+            node->item.~value_type();
+            new(&node->item) value_type(removed->item);
+            removed->item.~value_type();
+            new(&removed->item) value_type(item);
+            node->track_items();
+        }
+
+        *path[--depth] = removed->left ? removed->left : removed->right;
+        removed->left = removed->right = nullptr;
+
+        while (depth > 0) {
+            persistent_node *&node = *path[--depth];
+            int height = node->height;
+            rebalance(node);
+            if (node->height == height)
+                break;
+        }
+
+        for (; depth > 0; --depth)
+            --(*path[depth - 1])->size;
+        return removed;
+    }
+
+    void assign(persistent_node *&slot, size_t rank, const mapped_type &value)
+    {
+        own(slot, true);
+        size_t left = size(slot->left);
+        if (rank < left)
+            assign(slot->left, rank, value);
+        else if (rank > left)
+            assign(slot->right, rank - left - 1, value);
+        else {
+            slot->item.second = value;
+            slot->track_items();
+        }
+        update(slot);
+    }
+
+    // Rotations change the pivot too, it's owned first. If that copy can't
+    // be allocated the subtree stays unbalanced but ordered and counted.
+    void rebalance(persistent_node *&slot)
+    {
+        persistent_node *node = slot;
+        update(node);
+
+        try {
+            int balance = height(node->left) - height(node->right);
+            if (balance > 1) {
+                own(node->left);
+                if (height(node->left->left) < height(node->left->right)) {
+                    own(node->left->right);
+                    rotate_left(node->left);
+                }
+                rotate_right(slot);
+            } else if (balance < -1) {
+                own(node->right);
+                if (height(node->right->right) < height(node->right->left)) {
+                    own(node->right->left);
+                    rotate_right(node->right);
+                }
+                rotate_left(slot);
+            }
+        } catch (const std::bad_alloc &) {
+            PyErr_Clear();
+        }
+    }
+
+    static void rotate_left(persistent_node *&slot)
+    {
+        persistent_node *node = slot, *pivot = node->right;
+        node->right = pivot->left;
+        update(node);
+        pivot->left = node;
+        update(pivot);
+        slot = pivot;
+    }
+
+    static void rotate_right(persistent_node *&slot)
+    {
+        persistent_node *node = slot, *pivot = node->left;
+        node->left = pivot->right;
+        update(node);
+        pivot->right = node;
+        update(pivot);
+        slot = pivot;
+    }
+
+    key_compare comp_;
+    PyTypeObject *node_type_;
+    persistent_node *root_;
+    size_t stamp_;              // Changed by every insert and erase
+    std::vector<py_ptr<persistent_node>> retired_;
+};
+
+#endif // PYSTDCXX_PERSISTENT_TREE_HPP
@@ -0,0 +1,402 @@
+#include "priority_map.hpp"
+
+PyMethodDef *pystdcxx_priority_map::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "push",         (PyCFunction)pystdcxx_priority_map::push,     METH_VARARGS, "Add task with priority, task should not exist" },
+        { "update",       (PyCFunction)pystdcxx_priority_map::update,   METH_VARARGS, "Change priority of an existing task" },
+        { "pop_min",      (PyCFunction)pystdcxx_priority_map::pop_min,  METH_NOARGS,  "Pop and remove (task, priority) of the lowest priority" },
+        { "pop_max",      (PyCFunction)pystdcxx_priority_map::pop_max,  METH_NOARGS,  "Pop and remove (task, priority) of the highest priority" },
+        { "peek",         (PyCFunction)pystdcxx_priority_map::peek,     METH_VARARGS | METH_KEYWORDS,       "Return (task, priority) of the lowest/highest priority" },
+        { "clear",        (PyCFunction)pystdcxx_priority_map::clear,    METH_NOARGS,  "Clear all tasks" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_priority_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) pystdcxx_priority_map());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create priority map object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_priority_map::tp_init(pystdcxx_priority_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr, *less = nullptr, *cmp = nullptr;
+    static const char *kwlist[] = { "tuple", "less", "cmp", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$OO", const_cast<char **>(kwlist), &tuple, &less, &cmp))
+        return -1;
+
+    if (less && !Py_IsNone(less) && !PyCallable_Check(less)) {
+        PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
+        return -1;
+    }
+
+    if (cmp && !Py_IsNone(cmp) && !PyCallable_Check(cmp)) {
+        PyErr_SetString(PyExc_ValueError, "cmp argument should be callable type");
+        return -1;
+    }
+
+    if (less && cmp && !Py_IsNone(less) && !Py_IsNone(cmp)) {
+        PyErr_SetString(PyExc_ValueError, "less and cmp can't be both given");
+        return -1;
+    }
+
+    if ((less && !Py_IsNone(less)) || (cmp && !Py_IsNone(cmp))) {
+        self->less = less && !Py_IsNone(less) ? py_ptr<PyObject>(less, true) : py_ptr<PyObject>();
+        self->cmp = cmp && !Py_IsNone(cmp) ? py_ptr<PyObject>(cmp, true) : py_ptr<PyObject>();
+        self->maintain_tracking(self->less.get());
+        self->maintain_tracking(self->cmp.get());
+        self->index.clear();
+        self->queue = stdcxx_queue(py_less(self->less, self->cmp));
+        ++self->version;
+    }
+
+    if (tuple) {
+        if (!py_tuple_check(tuple)) {
+            PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+            return -1;
+        }
+
+        try {
+            py_tuple_for_each(tuple, [self] (PyObject *item) {
+                PyObject *task = py_tuple_get_item(item, 0);
+                PyObject *prio = py_tuple_get_item(item, 1);
+                if (!task || !prio)
+                    throw std::runtime_error("Invalid task/priority pair");
+                self->insert(py_ptr<PyObject>(task, true), py_ptr<PyObject>(prio, true), true);
+            });
+        } catch (std::exception &e) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int pystdcxx_priority_map::tp_traverse(pystdcxx_priority_map *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (self->less.get())
+        Py_VISIT(self->less.get());
+
+    if (self->cmp.get())
+        Py_VISIT(self->cmp.get());
+
+    if (self->queue.key_comp().less.get())
+        Py_VISIT(self->queue.key_comp().less.get());
+
+    if (self->queue.key_comp().cmp.get())
+        Py_VISIT(self->queue.key_comp().cmp.get());
+
+    // Tasks are referenced by both the queue and the index
+    for (stdcxx_queue::iterator iter = self->queue.begin(); iter != self->queue.end(); ++iter) {
+        Py_VISIT(iter->first.get());
+        Py_VISIT(iter->second.get());
+    }
+
+    for (stdcxx_index::iterator iter = self->index.begin(); iter != self->index.end(); ++iter)
+        Py_VISIT(iter->first.get());
+
+    return 0;
+}
+
+int pystdcxx_priority_map::tp_clear(pystdcxx_priority_map *self)
+{
+    stdcxx_index index(std::move(self->index));
+    stdcxx_queue queue(std::move(self->queue));
+    py_ptr<PyObject> less(self->less.release());
+    py_ptr<PyObject> cmp(self->cmp.release());
+    ++self->version;
+    return 0;
+}
+
+PyObject *pystdcxx_priority_map::tp_repr(pystdcxx_priority_map *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        for (stdcxx_queue::iterator iter = self->queue.begin(); iter != self->queue.end(); ++iter) {
+            repr += comma;
+            repr += "(";
+            repr += py_repr(iter->second.get());
+            repr += ", ";
+            repr += py_repr(iter->first.get());
+            repr += ")";
+            comma = ", ";
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_priority_map::tp_iter(pystdcxx_priority_map *self)
+{
+    return reinterpret_cast<PyObject *>(new(self) iterator(self, self->queue.begin(), self->queue.end()));
+}
+
+Py_ssize_t pystdcxx_priority_map::sq_length(pystdcxx_priority_map *self)
+{
+    return self->queue.size();
+}
+
+int pystdcxx_priority_map::sq_contains(pystdcxx_priority_map *self, PyObject *task)
+{
+    try {
+        return self->index.find(py_ptr<PyObject>(task, true)) != self->index.end();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+Py_ssize_t pystdcxx_priority_map::mp_length(pystdcxx_priority_map *self)
+{
+    return self->queue.size();
+}
+
+PyObject *pystdcxx_priority_map::mp_subscript(pystdcxx_priority_map *self, PyObject *task)
+{
+    try {
+        stdcxx_index::iterator pos = self->index.find(py_ptr<PyObject>(task, true));
+        if (pos == self->index.end()) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+
+        PyObject *prio = pos->second->first.get();
+        Py_INCREF(prio);
+        return prio;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+int pystdcxx_priority_map::mp_ass_subscript(pystdcxx_priority_map *self, PyObject *task, PyObject *prio)
+{
+    try {
+        if (prio) {
+            self->insert(py_ptr<PyObject>(task, true), py_ptr<PyObject>(prio, true), true);
+            return 0;
+        }
+
+        stdcxx_index::iterator pos = self->index.find(py_ptr<PyObject>(task, true));
+        if (pos == self->index.end()) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return -1;
+        }
+
+        self->remove(pos);
+        return 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+// Add task, or move it to prio if it exists and replace is true. Returns
+// false if task exists and replace is false.
+bool pystdcxx_priority_map::insert(const py_ptr<PyObject> &task, const py_ptr<PyObject> &prio, bool replace)
+{
+    std::pair<stdcxx_index::iterator, bool> result = index.try_emplace(task, queue.end());
+    if (!result.second) {
+        if (!replace)
+            return false;
+
+        move(result.first, prio);
+        return true;
+    }
+
+    try {
+        result.first->second = queue.emplace(prio, task);
+    } catch ( ... ) {
+        index.erase(result.first);
+        throw;
+    }
+
+    ++version;
+    maintain_tracking(task.get());
+    maintain_tracking(prio.get());
+    return true;
+}
+
+// The new node is placed before the old one is erased, so a failed
+// comparison leaves the task at its old priority.
+void pystdcxx_priority_map::move(stdcxx_index::iterator pos, const py_ptr<PyObject> &prio)
+{
+    stdcxx_queue::iterator iter = queue.emplace(prio, pos->first);
+    queue.erase(pos->second);
+    pos->second = iter;
+    ++version;
+    maintain_tracking(prio.get());
+}
+
+void pystdcxx_priority_map::remove(stdcxx_index::iterator pos)
+{
+    queue.erase(pos->second);
+    index.erase(pos);
+    ++version;
+}
+
+// Remove the task at iter and return (task, priority)
+PyObject *pystdcxx_priority_map::pop(stdcxx_queue::iterator iter)
+{
+    stdcxx_index::iterator pos = index.find(iter->second);
+    PyObject *item = PyTuple_Pack(2, iter->second.get(), iter->first.get());
+    if (item)
+        remove(pos);
+
+    return item;
+}
+
+PyObject *pystdcxx_priority_map::push(pystdcxx_priority_map *self, PyObject *args)
+{
+    PyObject *task, *prio;
+    if (!PyArg_ParseTuple(args, "OO", &task, &prio))
+        return nullptr;
+
+    try {
+        if (!self->insert(py_ptr<PyObject>(task, true), py_ptr<PyObject>(prio, true), false)) {
+            PyErr_SetString(PyExc_ValueError, "Task already exists");
+            return nullptr;
+        }
+
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_priority_map::update(pystdcxx_priority_map *self, PyObject *args)
+{
+    PyObject *task, *prio;
+    if (!PyArg_ParseTuple(args, "OO", &task, &prio))
+        return nullptr;
+
+    try {
+        stdcxx_index::iterator pos = self->index.find(py_ptr<PyObject>(task, true));
+        if (pos == self->index.end()) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+
+        self->move(pos, py_ptr<PyObject>(prio, true));
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_priority_map::pop_min(pystdcxx_priority_map *self, PyObject *Py_UNUSED(args))
+{
+    if (self->queue.empty()) {
+        PyErr_SetString(PyExc_ValueError, "Empty priority map");
+        return nullptr;
+    }
+
+    try {
+        return self->pop(self->queue.begin());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_priority_map::pop_max(pystdcxx_priority_map *self, PyObject *Py_UNUSED(args))
+{
+    if (self->queue.empty()) {
+        PyErr_SetString(PyExc_ValueError, "Empty priority map");
+        return nullptr;
+    }
+
+    try {
+        return self->pop(self->highest());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_priority_map::peek(pystdcxx_priority_map *self, PyObject *args, PyObject *kwds)
+{
+    int last = 0;
+    static const char *kwlist[] = { "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", const_cast<char **>(kwlist), &last))
+        return nullptr;
+
+    if (self->queue.empty()) {
+        PyErr_SetString(PyExc_ValueError, "Empty priority map");
+        return nullptr;
+    }
+
+    try {
+        stdcxx_queue::iterator iter = last ? self->highest() : self->queue.begin();
+        return PyTuple_Pack(2, iter->second.get(), iter->first.get());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+// Oldest task of the highest priority. Equal priorities are kept in the
+// order of insertion, so it's the first node of the last equal range.
+pystdcxx_priority_map::stdcxx_queue::iterator pystdcxx_priority_map::highest()
+{
+    return queue.lower_bound(std::prev(queue.end())->first);
+}
+
+PyObject *pystdcxx_priority_map::clear(pystdcxx_priority_map *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->queue.empty())
+        ++self->version;
+    self->index.clear();
+    self->queue.clear();
+    Py_RETURN_NONE;
+}
+
+PyObject *pystdcxx_priority_map::iterator::tp_iter(pystdcxx_priority_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_priority_map::iterator::tp_iternext(pystdcxx_priority_map::iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change priority map while iterating");
+        return nullptr;
+    }
+
+    if (self->first == self->last)
+        return nullptr;
+
+    PyObject *item = PyTuple_Pack(2, self->first->second.get(), self->first->first.get());
+    ++self->first;
+    return item;
+}
@@ -0,0 +1,119 @@
+#ifndef PYSTDCXX_PRIORITY_MAP_HPP
+#define PYSTDCXX_PRIORITY_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <map>
+#include <unordered_map>
+#include "utils.hpp"
+
+// Map of tasks to priorities ordered by priority. Tasks are hashed into an
+// index of the tree nodes holding them, so a task is moved to another
+// priority or removed without knowing its old priority. Tasks of equal
+// priority are popped in the order they were pushed or updated, from
+// either end: pop_max takes the oldest task of the highest priority.
+class pystdcxx_priority_map: public py_object<pystdcxx_priority_map>
+{
+private:
+    // Priority to task, the index points into it
+    typedef std::multimap<py_ptr<PyObject>, py_ptr<PyObject>, py_less> stdcxx_queue;
+
+    struct task_hash
+    {
+        size_t operator()(const py_ptr<PyObject> &task) const
+        {
+            Py_hash_t hash = PyObject_Hash(task.get());
+            if (hash == -1)
+                throw std::runtime_error("Hash object error");
+
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    struct task_equal
+    {
+        bool operator()(const py_ptr<PyObject> &lhs, const py_ptr<PyObject> &rhs) const
+        {
+            if (lhs.get() == rhs.get())
+                return true;
+
+            int result = PyObject_RichCompareBool(lhs.get(), rhs.get(), Py_EQ);
+            if (result == -1)
+                throw std::runtime_error("Compare two object error");
+
+            return result != 0;
+        }
+    };
+
+    typedef std::unordered_map<py_ptr<PyObject>, stdcxx_queue::iterator, task_hash, task_equal> stdcxx_index;
+
+public:
+    pystdcxx_priority_map(): version(0), queue(py_less(py_ptr<PyObject>()))
+    {
+        maintain_tracking();
+    }
+
+    ~pystdcxx_priority_map()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static const char *tp_name() { return "pystdcxx.priority_map"; }
+    static const char *tp_doc() { return "Map of tasks to priorities ordered by priority and indexed by task"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(pystdcxx_priority_map *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_priority_map *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_priority_map *self);
+    static PyObject *tp_repr(pystdcxx_priority_map *self);
+    static PyObject *tp_iter(pystdcxx_priority_map *self);
+    static Py_ssize_t sq_length(pystdcxx_priority_map *self);
+    static int sq_contains(pystdcxx_priority_map *self, PyObject *task);
+    static Py_ssize_t mp_length(pystdcxx_priority_map *self);
+    static PyObject *mp_subscript(pystdcxx_priority_map *self, PyObject *task);
+    static int mp_ass_subscript(pystdcxx_priority_map *self, PyObject *task, PyObject *prio);
+    static PyObject *push(pystdcxx_priority_map *self, PyObject *args);
+    static PyObject *update(pystdcxx_priority_map *self, PyObject *args);
+    static PyObject *pop_min(pystdcxx_priority_map *self, PyObject *args);
+    static PyObject *pop_max(pystdcxx_priority_map *self, PyObject *args);
+    static PyObject *peek(pystdcxx_priority_map *self, PyObject *args, PyObject *kwds);
+    static PyObject *clear(pystdcxx_priority_map *self, PyObject *args);
+
+private:
+    bool insert(const py_ptr<PyObject> &task, const py_ptr<PyObject> &prio, bool replace);
+    void move(stdcxx_index::iterator pos, const py_ptr<PyObject> &prio);
+    void remove(stdcxx_index::iterator pos);
+    PyObject *pop(stdcxx_queue::iterator iter);
+    stdcxx_queue::iterator highest();
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_priority_map *owner, stdcxx_queue::iterator first, stdcxx_queue::iterator last):
+            owner(owner, true),
+            version(owner->version),
+            first(first),
+            last(last)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.priority_map_iterator"; }
+        static const char *tp_doc() { return "Iterator of priority map in order of priority"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_priority_map> owner;
+        unsigned int version;
+        stdcxx_queue::iterator first, last;
+    };
+
+    unsigned int version;
+    stdcxx_queue queue;
+    stdcxx_index index;
+    py_ptr<PyObject> less;
+    py_ptr<PyObject> cmp;
+};
+
+#endif // PYSTDCXX_PRIORITY_MAP_HPP
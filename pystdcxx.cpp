@@ -3,37 +3,158 @@
 #include <pyerrors.h>
 #include "set.hpp"
 #include "map.hpp"
+#include "interval_map.hpp"
+#include "aggregate_map.hpp"
+#include "frozen_map.hpp"
+#include "frozen_set.hpp"
+#include "disk_map.hpp"
+#include "typed_map.hpp"
+#include "typed_set.hpp"
+#include "priority_map.hpp"
+#include "trie_map.hpp"
+#include "trie_set.hpp"
+#include "pystdcxx_api.h"
 
-static PyModuleDef pystdcxx_def = {
-    .m_base = PyModuleDef_HEAD_INIT,
-    .m_name = "stdcxx",
-    .m_doc = "Python wrapper for libstdc++",
-    .m_size = -1,
-    //.m_methods = pystdcxx_methods,
+static const pystdcxx_api pystdcxx_c_api = {
+    .version = PYSTDCXX_API_VERSION,
+    .map_check = pystdcxx_map::api_check,
+    .map_size = pystdcxx_map::api_size,
+    .map_insert = pystdcxx_map::api_insert,
+    .map_find = pystdcxx_map::api_find,
+    .map_erase = pystdcxx_map::api_erase,
+    .map_lower_bound = pystdcxx_map::api_lower_bound,
+    .map_for_each = pystdcxx_map::api_for_each,
+    .set_check = pystdcxx_set::api_check,
+    .set_size = pystdcxx_set::api_size,
+    .set_insert = pystdcxx_set::api_insert,
+    .set_find = pystdcxx_set::api_find,
+    .set_erase = pystdcxx_set::api_erase,
+    .set_lower_bound = pystdcxx_set::api_lower_bound,
+    .set_for_each = pystdcxx_set::api_for_each,
 };
 
-PyMODINIT_FUNC PyInit_stdcxx(void)
+template<typename T>
+static int pystdcxx_add_type(PyObject *module, const char *name)
 {
-    if (PyType_Ready(py_type<pystdcxx_set>::get()) < 0)
-        return NULL;
+    PyTypeObject *type = py_type<T>::get(module);
+    if (!type)
+        return -1;
+
+    return PyModule_AddObjectRef(module, name, reinterpret_cast<PyObject *>(type));
+}
+
+static int pystdcxx_exec(PyObject *module)
+{
+    py_module_state *state = static_cast<py_module_state *>(PyModule_GetState(module));
+    try {
+        state->interned = reinterpret_cast<PyObject *>(new(py_type<intern_table>::get(module)) intern_table());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_NoMemory();
+        return -1;
+    }
+
+    if (pystdcxx_add_type<pystdcxx_set>(module, "set") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_map>(module, "map") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_interval_map>(module, "interval_map") < 0)
+        return -1;
 
-    
-    if (PyType_Ready(py_type<pystdcxx_map>::get()) < 0)
-        return NULL;
+    if (pystdcxx_add_type<pystdcxx_aggregate_map>(module, "aggregate_map") < 0)
+        return -1;
 
-    py_ptr<PyObject> pystdcxx(PyModule_Create(&pystdcxx_def));
-    if (!pystdcxx.get())
-        return NULL;
+    if (pystdcxx_add_type<pystdcxx_frozen_map>(module, "frozen_map") < 0)
+        return -1;
 
-    py_ptr<PyTypeObject> pystdcxx_set_type(py_type<pystdcxx_set>::get(), true);
-    if (PyModule_AddObject(pystdcxx.get(), "set", (PyObject *)pystdcxx_set_type.get()) < 0)
-        return NULL;
+    if (pystdcxx_add_type<pystdcxx_frozen_set>(module, "frozen_set") < 0)
+        return -1;
 
-    py_ptr<PyTypeObject> pystdcxx_map_type(py_type<pystdcxx_map>::get(), true);
-    if (PyModule_AddObject(pystdcxx.get(), "map", (PyObject *)pystdcxx_map_type.get()) < 0)
-        return NULL;
+    if (pystdcxx_add_type<pystdcxx_disk_map>(module, "disk_map") < 0)
+        return -1;
 
-    pystdcxx_set_type.release();
-    pystdcxx_map_type.release();
-    return pystdcxx.release();
+    if (pystdcxx_add_type<pystdcxx_priority_map>(module, "priority_map") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_trie_map>(module, "trie_map") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_trie_set>(module, "trie_set") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_map_i64_i64>(module, "map_i64_i64") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_map_i64_f64>(module, "map_i64_f64") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_map_i64_obj>(module, "map_i64_obj") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_map_f64_f64>(module, "map_f64_f64") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_set_i64>(module, "set_i64") < 0)
+        return -1;
+
+    if (pystdcxx_add_type<pystdcxx_set_f64>(module, "set_f64") < 0)
+        return -1;
+
+    py_ptr<PyObject> capsule(PyCapsule_New(const_cast<pystdcxx_api *>(&pystdcxx_c_api), PYSTDCXX_API_CAPSULE, nullptr));
+    if (!capsule.get() || PyModule_AddObjectRef(module, "_C_API", capsule.get()) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int pystdcxx_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    py_module_state *state = static_cast<py_module_state *>(PyModule_GetState(module));
+    for (PyTypeObject *type: state->types)
+        Py_VISIT(type);
+    Py_VISIT(state->interned);
+
+    return 0;
+}
+
+static int pystdcxx_clear(PyObject *module)
+{
+    py_module_state *state = static_cast<py_module_state *>(PyModule_GetState(module));
+    for (PyTypeObject *&type: state->types)
+        Py_CLEAR(type);
+    Py_CLEAR(state->interned);
+
+    return 0;
+}
+
+static void pystdcxx_free(void *module)
+{
+    pystdcxx_clear(static_cast<PyObject *>(module));
+}
+
+static PyModuleDef_Slot pystdcxx_slots[] = {
+    { Py_mod_exec, reinterpret_cast<void *>(pystdcxx_exec) },
+#ifdef Py_mod_multiple_interpreters
+    { Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },
+#endif
+    { 0, nullptr },
+};
+
+PyModuleDef pystdcxx_def = {
+    .m_base = PyModuleDef_HEAD_INIT,
+    .m_name = "stdcxx",
+    .m_doc = "Python wrapper for libstdc++",
+    .m_size = sizeof(py_module_state),
+    .m_methods = nullptr,
+    .m_slots = pystdcxx_slots,
+    .m_traverse = pystdcxx_traverse,
+    .m_clear = pystdcxx_clear,
+    .m_free = pystdcxx_free,
+};
+
+PyMODINIT_FUNC PyInit_stdcxx(void)
+{
+    return PyModuleDef_Init(&pystdcxx_def);
 }
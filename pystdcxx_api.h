@@ -0,0 +1,79 @@
+#ifndef PYSTDCXX_API_H
+#define PYSTDCXX_API_H
+
+/*
+ * C API of stdcxx module for other extensions. The function table is
+ * exported as capsule stdcxx._C_API, import it once with pystdcxx_import()
+ * and call through it to operate on stdcxx.map and stdcxx.set without
+ * dispatching through Python.
+ *
+ * Container arguments aren't type checked for speed, check them with
+ * map_check()/set_check() first. Functions returning int return -1 with
+ * an exception set on error.
+ */
+
+#include <Python.h>
+
+#define PYSTDCXX_API_VERSION 1
+#define PYSTDCXX_API_CAPSULE "stdcxx._C_API"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Called by for_each with borrowed key and value (NULL for set), return 0
+ * to continue, 1 to stop or -1 with an exception set to abort.
+ */
+typedef int (*pystdcxx_visitproc)(PyObject *key, PyObject *value, void *arg);
+
+typedef struct {
+    /* PYSTDCXX_API_VERSION the module was built with */
+    int version;
+
+    /* Return 1 if ob is a stdcxx.map or subclass, 0 otherwise */
+    int (*map_check)(PyObject *ob);
+    Py_ssize_t (*map_size)(PyObject *map);
+    /* Insert or replace, return 1 if key is new, 0 if replaced */
+    int (*map_insert)(PyObject *map, PyObject *key, PyObject *value);
+    /* Return 1 and a new reference of value if found, 0 otherwise */
+    int (*map_find)(PyObject *map, PyObject *key, PyObject **value);
+    /* Return 1 if key was erased, 0 if it doesn't exist */
+    int (*map_erase)(PyObject *map, PyObject *key);
+    /* Return 1 and new references of the first item not less than key, 0 if there's none */
+    int (*map_lower_bound)(PyObject *map, PyObject *key, PyObject **found, PyObject **value);
+    /* Visit items with key in [lower, upper) in order, NULL bound means unbounded */
+    int (*map_for_each)(PyObject *map, PyObject *lower, PyObject *upper, pystdcxx_visitproc visit, void *arg);
+
+    /* Return 1 if ob is a stdcxx.set or subclass, 0 otherwise */
+    int (*set_check)(PyObject *ob);
+    Py_ssize_t (*set_size)(PyObject *set);
+    /* Return 1 if key was added, 0 if it exists or was rejected by maxlen */
+    int (*set_insert)(PyObject *set, PyObject *key);
+    /* Return 1 if key exists, 0 otherwise */
+    int (*set_find)(PyObject *set, PyObject *key);
+    /* Return 1 if key was erased, 0 if it doesn't exist */
+    int (*set_erase)(PyObject *set, PyObject *key);
+    /* Return 1 and a new reference of the first item not less than key, 0 if there's none */
+    int (*set_lower_bound)(PyObject *set, PyObject *key, PyObject **found);
+    /* Visit items in [lower, upper) in order, NULL bound means unbounded */
+    int (*set_for_each)(PyObject *set, PyObject *lower, PyObject *upper, pystdcxx_visitproc visit, void *arg);
+} pystdcxx_api;
+
+/* Import the function table, return NULL with an exception set on failure */
+static inline const pystdcxx_api *pystdcxx_import(void)
+{
+    const pystdcxx_api *api = (const pystdcxx_api *)PyCapsule_Import(PYSTDCXX_API_CAPSULE, 0);
+    if (api && api->version != PYSTDCXX_API_VERSION) {
+        PyErr_Format(PyExc_ImportError, "stdcxx C API version %d doesn't match %d", api->version, PYSTDCXX_API_VERSION);
+        return NULL;
+    }
+
+    return api;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYSTDCXX_API_H */
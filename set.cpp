@@ -4,11 +4,21 @@ PyMethodDef *pystdcxx_set::tp_methods()
 {
     static PyMethodDef methods[] = {
         { "add",          (PyCFunction)pystdcxx_set::add,      METH_O,       "Add item" },
+        { "append",       (PyCFunction)pystdcxx_set::append,   METH_O,       "Add an item greater than all items in the set" },
+        { "add_many",     (PyCFunction)pystdcxx_set::add_many, METH_O,       "Add items of an iterable, return number of items added" },
         { "remove",       (PyCFunction)pystdcxx_set::remove,   METH_O,       "Remove item" },
         { "clear",        (PyCFunction)pystdcxx_set::clear,    METH_NOARGS,  "Clear all items" },
         { "reverse",      (PyCFunction)pystdcxx_set::reverse,  METH_NOARGS,  "Find an item and return an iterator" },
+        { "iter_chunks",  (PyCFunction)pystdcxx_set::iter_chunks,      METH_VARARGS | METH_KEYWORDS,   "Return an iterator of lists of up to count items" },
         { "find",         (PyCFunction)pystdcxx_set::find,     METH_O,       "Find an item and return an iterator" },
         { "popitem",      (PyCFunction)pystdcxx_set::popitem,  METH_VARARGS | METH_KEYWORDS,       "Pop and remove the first/last item" },
+        { "pop_n",        (PyCFunction)pystdcxx_set::pop_n,    METH_VARARGS | METH_KEYWORDS,       "Pop and remove up to count first/last items as a list" },
+        { "pop_range",    (PyCFunction)pystdcxx_set::pop_range, METH_VARARGS, "Pop and remove items in [first, last) as a list" },
+        { "pop_until",    (PyCFunction)pystdcxx_set::pop_until, METH_O,       "Pop and remove items less than key as a list" },
+        { "pop_while",    (PyCFunction)pystdcxx_set::pop_while, METH_O,       "Pop and remove leading items while predicate(item) is true" },
+        { "cursor",       (PyCFunction)pystdcxx_set::cursor,   METH_VARARGS | METH_KEYWORDS,       "Create a cursor which survives modification, optionally seeking to key" },
+        { "freeze",       (PyCFunction)pystdcxx_set::freeze,   METH_NOARGS,  "Return an immutable and hashable copy stored as a sorted array" },
+        { "dump",         (PyCFunction)pystdcxx_set::dump,     METH_VARARGS | METH_KEYWORDS,       "Write items to file object in jsonl/csv/binary format" },
         { nullptr },
     };
 
@@ -17,25 +27,64 @@ PyMethodDef *pystdcxx_set::tp_methods()
 
 int pystdcxx_set::tp_init(pystdcxx_set *self, PyObject *args, PyObject *kwds)
 {
-    PyObject *tuple = nullptr, *less = nullptr;
-    static const char *kwlist[] = { "tuple", "less", nullptr };
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$O", const_cast<char **>(kwlist), &tuple, &less))
+    PyObject *tuple = nullptr, *less = nullptr, *cmp = nullptr, *maxlen = nullptr;
+    int intern = 0;
+    static const char *kwlist[] = { "tuple", "less", "cmp", "maxlen", "intern", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$OOOp", const_cast<char **>(kwlist), &tuple, &less, &cmp, &maxlen, &intern))
         return -1;
 
+    if (maxlen && !Py_IsNone(maxlen)) {
+        Py_ssize_t n = PyLong_AsSsize_t(maxlen);
+        if (n == -1 && PyErr_Occurred())
+            return -1;
+        if (n < 0) {
+            PyErr_SetString(PyExc_ValueError, "maxlen should not be negative");
+            return -1;
+        }
+        self->maxlen = n;
+    }
+
+    if (intern) {
+        intern_table *table = py_intern_table(reinterpret_cast<PyObject *>(self));
+        if (!table)
+            return -1;
+        self->interned = py_ptr<intern_table>(table, true);
+    }
+
     if (less) {
         if (PyCallable_Check(less)) {
             self->less = py_ptr<PyObject>(less, true);
+            self->maintain_tracking(less);
+            self->set = stdcxx_set(py_less(self->less));
+            ++self->version;
         } else if (!Py_IsNone(less)) {
             PyErr_SetString(PyExc_ValueError, "less argument should be callable type");
             return -1;
         }
     }
 
+    if (cmp) {
+        if (less && !Py_IsNone(less) && !Py_IsNone(cmp)) {
+            PyErr_SetString(PyExc_ValueError, "less and cmp can't be both given");
+            return -1;
+        }
+
+        if (PyCallable_Check(cmp)) {
+            self->cmp = py_ptr<PyObject>(cmp, true);
+            self->maintain_tracking(cmp);
+            self->set = stdcxx_set(py_less(self->less, self->cmp));
+            ++self->version;
+        } else if (!Py_IsNone(cmp)) {
+            PyErr_SetString(PyExc_ValueError, "cmp argument should be callable type");
+            return -1;
+        }
+    }
+
     if (tuple) {
         try {
             if (py_tuple_check(tuple)) {
                 py_tuple_for_each(tuple, [self] (PyObject *item) {
-                    self->set.insert(py_ptr<PyObject>(item, true));
+                    self->insert(item);
                 });
             } else {
                 PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
@@ -64,9 +113,23 @@ PyObject *pystdcxx_set::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwd
 
 int pystdcxx_set::tp_traverse(pystdcxx_set *self, visitproc visit, void *arg)
 {
+    Py_VISIT(Py_TYPE(self));
+
     if (self->less.get())
         Py_VISIT(self->less.get());
 
+    if (self->cmp.get())
+        Py_VISIT(self->cmp.get());
+
+    if (self->interned.get())
+        Py_VISIT(self->interned.get());
+
+    if (self->set.key_comp().less.get())
+        Py_VISIT(self->set.key_comp().less.get());
+
+    if (self->set.key_comp().cmp.get())
+        Py_VISIT(self->set.key_comp().cmp.get());
+
     for (stdcxx_set::iterator iter = self->set.begin(); iter != self->set.end(); ++iter)
         Py_VISIT(iter->get());
 
@@ -76,7 +139,10 @@ int pystdcxx_set::tp_traverse(pystdcxx_set *self, visitproc visit, void *arg)
 int pystdcxx_set::tp_clear(pystdcxx_set *self)
 {
     stdcxx_set set(std::move(self->set));
-    py_ptr<PyObject> less(self->less);
+    py_ptr<PyObject> less(self->less.release());
+    py_ptr<PyObject> cmp(self->cmp.release());
+    py_ptr<intern_table> interned(self->interned.release());
+    ++self->version;
     return 0;
 }
 
@@ -103,7 +169,7 @@ PyObject *pystdcxx_set::tp_repr(pystdcxx_set *self)
 
 PyObject *pystdcxx_set::tp_iter(pystdcxx_set *self)
 {
-    return reinterpret_cast<PyObject *>(new iterator(self, self->set.begin(), self->set.end()));
+    return reinterpret_cast<PyObject *>(new(self) iterator(self, self->set.begin(), self->set.end()));
 }
 
 Py_ssize_t pystdcxx_set::sq_length(pystdcxx_set *self)
@@ -118,39 +184,87 @@ int pystdcxx_set::sq_contains(pystdcxx_set *self, PyObject *value)
 
 PyObject *pystdcxx_set::sq_inplace_concat(pystdcxx_set *self, PyObject *tuple)
 {
-    size_t size = self->set.size();
-    
     try {
         if (py_tuple_check(tuple)) {
             py_tuple_for_each(tuple, [self] (PyObject *item) {
-                self->set.insert(py_ptr<PyObject>(item, true));
+                self->insert(item);
             });
         } else {
             PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
             return nullptr;
         }
     } catch (std::exception &e) {
-        if (size != self->set.size())
-            ++self->version;
         if (!PyErr_Occurred())
             PyErr_SetString(PyExc_RuntimeError, e.what());
         return nullptr;
     }
 
-    if (size != self->set.size())
-        ++self->version;
-
     Py_INCREF(self);
     return reinterpret_cast<PyObject *>(self);
 }
 
+PyObject *pystdcxx_set::mp_subscript(pystdcxx_set *self, PyObject *key)
+{
+    if (PySlice_Check(key))
+        return self->slice(py_key_range(), key);
+
+    PyErr_SetString(PyExc_TypeError, "set indices must be slices");
+    return nullptr;
+}
+
+// Insert item, return true if it's added. stored is set to the object kept
+// in the set, which differs from item if it's interned, and evicted to the
+// smallest item pushed out by maxlen, if any. An item not greater than the
+// smallest one of a full set is rejected with one comparison and never
+// touches the tree. The end hint makes items arriving in increasing order
+// skip the descent.
+bool pystdcxx_set::insert(PyObject *item, PyObject **stored, PyObject **evicted)
+{
+    py_ptr<PyObject> key(item, true);
+    if (maxlen >= 0 && set.size() >= static_cast<size_t>(maxlen)) {
+        if (set.empty() || !set.key_comp()(*set.begin(), key))
+            return false;
+    }
+
+    size_t size = set.size();
+    stdcxx_set::iterator pos = set.emplace_hint(set.end(), interned.get() ? interned->intern(item) : key);
+    if (size == set.size())
+        return false;
+
+    maintain_tracking(item);
+    if (stored)
+        *stored = pos->get();
+
+    if (maxlen >= 0 && set.size() > static_cast<size_t>(maxlen)) {
+        if (evicted)
+            *evicted = set.begin()->get();
+        set.erase(set.begin());
+    }
+
+    ++version;
+    return true;
+}
+
+PyObject *pystdcxx_set::append(pystdcxx_set *self, PyObject *value)
+{
+    try {
+        if (!self->set.empty() && !self->set.key_comp()(*self->set.rbegin(), py_ptr<PyObject>(value, true))) {
+            PyErr_SetString(PyExc_ValueError, "Item should be greater than the last item");
+            return nullptr;
+        }
+
+        return PyBool_FromLong(self->insert(value));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
 PyObject *pystdcxx_set::add(pystdcxx_set *self, PyObject *value)
 {
     try {
-        bool result = self->set.insert(py_ptr<PyObject>(value, true)).second;
-        if (result)
-            ++self->version;
-        return PyBool_FromLong(result);
+        return PyBool_FromLong(self->insert(value));
     } catch (std::exception &e) {
         if (!PyErr_Occurred())
             PyErr_SetString(PyExc_RuntimeError, e.what());
@@ -162,6 +276,49 @@ PyObject *pystdcxx_set::add(pystdcxx_set *self, PyObject *value)
     }
 }
 
+PyObject *pystdcxx_set::add_many(pystdcxx_set *self, PyObject *iterable)
+{
+    py_ptr<PyObject> iter(PyObject_GetIter(iterable));
+    if (!iter.get())
+        return nullptr;
+
+    // Items added here and then pushed out by maxlen aren't counted, the
+    // pointers of the added items still in the set are kept to tell them
+    // from older items when maxlen evicts one. Evicted pointers are only
+    // compared, never dereferenced.
+    Py_ssize_t count = 0;
+    std::unordered_set<PyObject *> added;
+    try {
+        for (;;) {
+            py_ptr<PyObject> item(PyIter_Next(iter.get()));
+            if (!item.get())
+                break;
+
+            PyObject *stored = nullptr, *evicted = nullptr;
+            if (!self->insert(item.get(), &stored, &evicted))
+                continue;
+
+            if (self->maxlen < 0) {
+                ++count;
+                continue;
+            }
+
+            added.insert(stored);
+            if (evicted)
+                added.erase(evicted);
+        }
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (PyErr_Occurred())
+        return nullptr;
+
+    return PyLong_FromSsize_t(self->maxlen < 0 ? count : static_cast<Py_ssize_t>(added.size()));
+}
+
 PyObject *pystdcxx_set::remove(pystdcxx_set *self, PyObject *value)
 {
     try {
@@ -182,19 +339,43 @@ PyObject *pystdcxx_set::remove(pystdcxx_set *self, PyObject *value)
 
 PyObject *pystdcxx_set::clear(pystdcxx_set *self, PyObject *Py_UNUSED(args))
 {
+    if (!self->set.empty())
+        ++self->version;
     self->set.clear();
     Py_RETURN_NONE;
 }
 
 PyObject *pystdcxx_set::reverse(pystdcxx_set *self, PyObject *Py_UNUSED(args))
 {
-    return reinterpret_cast<PyObject *>(new reverse_iterator(self, self->set.rbegin(), self->set.rend()));
+    return reinterpret_cast<PyObject *>(new(self) reverse_iterator(self, self->set.rbegin(), self->set.rend()));
+}
+
+PyObject *pystdcxx_set::iter_chunks(pystdcxx_set *self, PyObject *args, PyObject *kwds)
+{
+    Py_ssize_t count;
+    int reverse = 0;
+    static const char *kwlist[] = { "count", "reverse", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|$p", const_cast<char **>(kwlist), &count, &reverse))
+        return nullptr;
+
+    if (count <= 0) {
+        PyErr_SetString(PyExc_ValueError, "count should be positive");
+        return nullptr;
+    }
+
+    if (reverse) {
+        py_ptr<reverse_iterator> inner(new(self) reverse_iterator(self, self->set.rbegin(), self->set.rend()));
+        return reinterpret_cast<PyObject *>(new(self) chunk_iterator<reverse_iterator>(inner.get(), count));
+    }
+
+    py_ptr<iterator> inner(new(self) iterator(self, self->set.begin(), self->set.end()));
+    return reinterpret_cast<PyObject *>(new(self) chunk_iterator<iterator>(inner.get(), count));
 }
 
 PyObject *pystdcxx_set::find(pystdcxx_set *self, PyObject *value)
 {
     try {
-        return reinterpret_cast<PyObject*>(new iterator(self,
+        return reinterpret_cast<PyObject*>(new(self) iterator(self,
                                                         self->set.find(py_ptr<PyObject>(value, true)),
                                                         self->set.end()));
     } catch ( ... ) {
@@ -226,10 +407,380 @@ PyObject *pystdcxx_set::popitem(pystdcxx_set *self, PyObject *args, PyObject *kw
 
     py_ptr<PyObject> item(std::move(*iter));
     self->set.erase(iter);
+    ++self->version;
 
     return item.release();
 }
 
+// Create a view of base range narrowed by slice
+PyObject *pystdcxx_set::slice(const py_key_range &base, PyObject *slice)
+{
+    try {
+        py_key_range range(base);
+        if (!range.narrow(set.key_comp(), slice))
+            return nullptr;
+
+        return reinterpret_cast<PyObject *>(new(this) range_view(this, range));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::erase_to_list(stdcxx_set::iterator first, stdcxx_set::iterator last, bool reverse)
+{
+    py_ptr<PyObject> list(PyList_New(std::distance(first, last)));
+    if (!list.get())
+        return nullptr;
+
+    Py_ssize_t index = reverse ? PyList_GET_SIZE(list.get()) - 1 : 0;
+    for (stdcxx_set::iterator iter = first; iter != last; ++iter) {
+        PyObject *item = iter->get();
+        Py_INCREF(item);
+        PyList_SET_ITEM(list.get(), index, item);
+        index += reverse ? -1 : 1;
+    }
+
+    if (first != last) {
+        set.erase(first, last);
+        ++version;
+    }
+
+    return list.release();
+}
+
+PyObject *pystdcxx_set::pop_n(pystdcxx_set *self, PyObject *args, PyObject *kwds)
+{
+    Py_ssize_t count = 0;
+    PyObject *is_last = nullptr;
+    static const char *kwlist[] = { "count", "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|O", const_cast<char **>(kwlist), &count, &is_last))
+        return nullptr;
+
+    if (count < 0) {
+        PyErr_SetString(PyExc_ValueError, "count should not be negative");
+        return nullptr;
+    }
+
+    try {
+        count = std::min<size_t>(count, self->set.size());
+        if (is_last && PyObject_IsTrue(is_last))
+            return self->erase_to_list(std::prev(self->set.end(), count), self->set.end(), true);
+        else
+            return self->erase_to_list(self->set.begin(), std::next(self->set.begin(), count), false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::pop_range(pystdcxx_set *self, PyObject *args)
+{
+    PyObject *first, *last;
+    if (!PyArg_ParseTuple(args, "OO", &first, &last))
+        return nullptr;
+
+    try {
+        py_ptr<PyObject> lower(first, true), upper(last, true);
+        if (self->set.key_comp()(upper, lower))
+            return PyList_New(0);
+
+        return self->erase_to_list(self->set.lower_bound(lower), self->set.lower_bound(upper), false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::pop_until(pystdcxx_set *self, PyObject *key)
+{
+    try {
+        return self->erase_to_list(self->set.begin(), self->set.lower_bound(py_ptr<PyObject>(key, true)), false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::pop_while(pystdcxx_set *self, PyObject *predicate)
+{
+    if (!PyCallable_Check(predicate)) {
+        PyErr_SetString(PyExc_ValueError, "predicate should be callable type");
+        return nullptr;
+    }
+
+    try {
+        unsigned int version = self->version;
+        stdcxx_set::iterator last = self->set.begin();
+        for (; last != self->set.end(); ++last) {
+            py_ptr<PyObject> result(PyObject_CallOneArg(predicate, last->get()));
+            if (!result.get())
+                return nullptr;
+
+            if (version != self->version) {
+                PyErr_SetString(PyExc_RuntimeError, "Can't change set while popping");
+                return nullptr;
+            }
+
+            int is_true = PyObject_IsTrue(result.get());
+            if (is_true < 0)
+                return nullptr;
+            if (!is_true)
+                break;
+        }
+
+        return self->erase_to_list(self->set.begin(), last, false);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::dump(pystdcxx_set *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *file = nullptr, *first = nullptr, *last = nullptr;
+    const char *format = "jsonl";
+    Py_ssize_t chunk_size = 65536;
+    static const char *kwlist[] = { "file", "format", "chunk_size", "first", "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|sn$OO", const_cast<char **>(kwlist),
+                                     &file, &format, &chunk_size, &first, &last))
+        return nullptr;
+
+    try {
+        py_dump_writer writer(file, format, chunk_size);
+        unsigned int version = self->version;
+
+        stdcxx_set::iterator iter = self->set.begin(), end = self->set.end();
+        if (first && !Py_IsNone(first))
+            iter = self->set.lower_bound(py_ptr<PyObject>(first, true));
+        if (last && !Py_IsNone(last))
+            end = self->set.lower_bound(py_ptr<PyObject>(last, true));
+        if (first && !Py_IsNone(first) && last && !Py_IsNone(last) &&
+            self->set.key_comp()(py_ptr<PyObject>(last, true), py_ptr<PyObject>(first, true)))
+            end = iter;
+
+        // Formatting an item runs Python code which may change the set,
+        // check the version after every item
+        for (; iter != end; ++iter) {
+            py_ptr<PyObject> item(*iter);
+            writer.put(item.get());
+            if (version != self->version) {
+                PyErr_SetString(PyExc_RuntimeError, "Can't change set while dumping");
+                return nullptr;
+            }
+        }
+
+        writer.flush();
+        Py_RETURN_NONE;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::cursor(pystdcxx_set *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *key = nullptr;
+    static const char *kwlist[] = { "key", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &key))
+        return nullptr;
+
+    try {
+        py_ptr<pystdcxx_set::cursor_iterator> result(new(self) pystdcxx_set::cursor_iterator(self));
+        if (key && !Py_IsNone(key)) {
+            py_ptr<PyObject> found(pystdcxx_set::cursor_iterator::seek(result.get(), key));
+            if (!found.get())
+                return nullptr;
+        }
+
+        return reinterpret_cast<PyObject *>(result.release());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::freeze(pystdcxx_set *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        py_ptr<pystdcxx_frozen_set> result(new(self) pystdcxx_frozen_set(self->set.key_comp()));
+        result->reserve(self->set.size());
+        for (stdcxx_set::iterator iter = self->set.begin(); iter != self->set.end(); ++iter)
+            result->append(*iter);
+
+        return reinterpret_cast<PyObject *>(result.release());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+int pystdcxx_set::api_check(PyObject *ob)
+{
+    return py_type<pystdcxx_set>::check(ob);
+}
+
+Py_ssize_t pystdcxx_set::api_size(PyObject *self)
+{
+    return reinterpret_cast<pystdcxx_set *>(self)->set.size();
+}
+
+int pystdcxx_set::api_insert(PyObject *self, PyObject *key)
+{
+    try {
+        return reinterpret_cast<pystdcxx_set *>(self)->insert(key);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_set::api_find(PyObject *self, PyObject *key)
+{
+    pystdcxx_set *set = reinterpret_cast<pystdcxx_set *>(self);
+    try {
+        return set->set.find(py_ptr<PyObject>(key, true)) != set->set.end();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_set::api_erase(PyObject *self, PyObject *key)
+{
+    pystdcxx_set *set = reinterpret_cast<pystdcxx_set *>(self);
+    try {
+        if (!set->set.erase(py_ptr<PyObject>(key, true)))
+            return 0;
+
+        ++set->version;
+        return 1;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_set::api_lower_bound(PyObject *self, PyObject *key, PyObject **found)
+{
+    pystdcxx_set *set = reinterpret_cast<pystdcxx_set *>(self);
+    try {
+        stdcxx_set::iterator iter = set->set.lower_bound(py_ptr<PyObject>(key, true));
+        if (iter == set->set.end())
+            return 0;
+
+        *found = py_ptr<PyObject>(*iter).release();
+        return 1;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_set::api_for_each(PyObject *self, PyObject *lower, PyObject *upper, pystdcxx_visitproc visit, void *arg)
+{
+    // The visitor may drop the last reference of the set
+    py_ptr<pystdcxx_set> set(reinterpret_cast<pystdcxx_set *>(self), true);
+    uint32_t version = set->version;
+
+    try {
+        stdcxx_set::iterator first = lower ? set->set.lower_bound(py_ptr<PyObject>(lower, true)) : set->set.begin();
+        stdcxx_set::iterator last = upper ? set->set.lower_bound(py_ptr<PyObject>(upper, true)) : set->set.end();
+        if (lower && upper && set->set.key_comp()(py_ptr<PyObject>(upper, true), py_ptr<PyObject>(lower, true)))
+            last = first;
+
+        for (; first != last; ++first) {
+            int result = visit(first->get(), nullptr, arg);
+            if (result)
+                return result < 0 ? -1 : 0;
+
+            if (version != set->version) {
+                PyErr_SetString(PyExc_RuntimeError, "Can't change set while iterating");
+                return -1;
+            }
+        }
+
+        return 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+// Build a list of up to count items and advance first past them. Nothing
+// here calls back into Python code, so the caller checks the version once
+// for the whole chunk.
+template<typename I>
+static PyObject *take_items(I &first, const I &last, Py_ssize_t count)
+{
+    py_ptr<PyObject> list(PyList_New(0));
+    if (!list.get())
+        return nullptr;
+
+    for (; count > 0 && first != last; --count, ++first) {
+        if (PyList_Append(list.get(), first->get()) < 0)
+            return nullptr;
+    }
+
+    return list.release();
+}
+
+static bool parse_count(PyObject *value, Py_ssize_t &count)
+{
+    count = PyLong_AsSsize_t(value);
+    if (count == -1 && PyErr_Occurred())
+        return false;
+
+    if (count < 0) {
+        PyErr_SetString(PyExc_ValueError, "count should not be negative");
+        return false;
+    }
+
+    return true;
+}
+
+PyMethodDef *pystdcxx_set::iterator::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "next_n",       (PyCFunction)pystdcxx_set::iterator::next_n,   METH_O,       "Return a list of up to count next items, empty at the end" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_set::iterator::take(Py_ssize_t count)
+{
+    if (version != owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change set while iterating");
+        return nullptr;
+    }
+
+    return take_items(first, last, count);
+}
+
+PyObject *pystdcxx_set::iterator::next_n(pystdcxx_set::iterator *self, PyObject *count)
+{
+    Py_ssize_t n;
+    if (!parse_count(count, n))
+        return nullptr;
+
+    return self->take(n);
+}
+
 PyObject *pystdcxx_set::iterator::tp_iter(pystdcxx_set::iterator *self)
 {
     Py_INCREF(self);
@@ -253,6 +804,35 @@ PyObject *pystdcxx_set::iterator::tp_iternext(pystdcxx_set::iterator *self)
     return item;
 }
 
+PyMethodDef *pystdcxx_set::reverse_iterator::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "next_n",       (PyCFunction)pystdcxx_set::reverse_iterator::next_n,   METH_O,       "Return a list of up to count next items, empty at the end" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_set::reverse_iterator::take(Py_ssize_t count)
+{
+    if (version != owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change set while iterating");
+        return nullptr;
+    }
+
+    return take_items(first, last, count);
+}
+
+PyObject *pystdcxx_set::reverse_iterator::next_n(pystdcxx_set::reverse_iterator *self, PyObject *count)
+{
+    Py_ssize_t n;
+    if (!parse_count(count, n))
+        return nullptr;
+
+    return self->take(n);
+}
+
 PyObject *pystdcxx_set::reverse_iterator::tp_iter(pystdcxx_set::reverse_iterator *self)
 {
     Py_INCREF(self);
@@ -275,3 +855,264 @@ PyObject *pystdcxx_set::reverse_iterator::tp_iternext(pystdcxx_set::reverse_iter
     Py_INCREF(item);
     return item;
 }
+
+template<typename I>
+PyObject *pystdcxx_set::chunk_iterator<I>::tp_iter(chunk_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+template<typename I>
+PyObject *pystdcxx_set::chunk_iterator<I>::tp_iternext(chunk_iterator *self)
+{
+    PyObject *list = self->inner->take(self->count);
+    if (list && PyList_GET_SIZE(list) == 0) {
+        Py_DECREF(list);
+        return nullptr;
+    }
+
+    return list;
+}
+
+PyObject *pystdcxx_set::range_view::tp_repr(pystdcxx_set::range_view *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+        auto append = [&] (stdcxx_set::iterator iter) {
+            repr += comma;
+            repr += py_repr(iter->get());
+            comma = ", ";
+        };
+
+        auto bounds = self->range.resolve(self->owner->set);
+        if (self->range.reverse) {
+            for (stdcxx_set::iterator iter = bounds.second; iter != bounds.first;)
+                append(--iter);
+        } else {
+            for (stdcxx_set::iterator iter = bounds.first; iter != bounds.second; ++iter)
+                append(iter);
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::range_view::tp_iter(pystdcxx_set::range_view *self)
+{
+    try {
+        auto bounds = self->range.resolve(self->owner->set);
+        if (self->range.reverse) {
+            return reinterpret_cast<PyObject *>(new(self) reverse_iterator(self->owner.get(),
+                                                                           stdcxx_set::reverse_iterator(bounds.second),
+                                                                           stdcxx_set::reverse_iterator(bounds.first)));
+        }
+
+        return reinterpret_cast<PyObject *>(new(self) iterator(self->owner.get(), bounds.first, bounds.second));
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_set::range_view::sq_length(pystdcxx_set::range_view *self)
+{
+    try {
+        auto bounds = self->range.resolve(self->owner->set);
+        return std::distance(bounds.first, bounds.second);
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+int pystdcxx_set::range_view::sq_contains(pystdcxx_set::range_view *self, PyObject *key)
+{
+    try {
+        py_ptr<PyObject> k(key, true);
+        return self->range.contains(self->owner->set.key_comp(), k) && self->owner->set.find(k) != self->owner->set.end();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+Py_ssize_t pystdcxx_set::range_view::mp_length(pystdcxx_set::range_view *self)
+{
+    return sq_length(self);
+}
+
+PyObject *pystdcxx_set::range_view::mp_subscript(pystdcxx_set::range_view *self, PyObject *key)
+{
+    if (PySlice_Check(key))
+        return self->owner->slice(self->range, key);
+
+    PyErr_SetString(PyExc_TypeError, "set range indices must be slices");
+    return nullptr;
+}
+
+PyMethodDef *pystdcxx_set::cursor_iterator::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "seek",          (PyCFunction)pystdcxx_set::cursor_iterator::seek,           METH_O,       "Move to the first item not less than key" },
+        { "next",          (PyCFunction)pystdcxx_set::cursor_iterator::next,           METH_NOARGS,  "Return the next item and move forward" },
+        { "prev",          (PyCFunction)pystdcxx_set::cursor_iterator::prev,           METH_NOARGS,  "Move backward and return the previous item" },
+        { "peek",          (PyCFunction)pystdcxx_set::cursor_iterator::peek,           METH_NOARGS,  "Return the next item without moving, None at the end" },
+        { "erase_current", (PyCFunction)pystdcxx_set::cursor_iterator::erase_current,  METH_NOARGS,  "Erase the item last returned by next/prev" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+void pystdcxx_set::cursor_iterator::sync()
+{
+    if (version == owner->version)
+        return;
+
+    stdcxx_set &set = owner->set;
+    if (!anchor.get())
+        pos = set.begin();
+    else if (inclusive)
+        pos = set.lower_bound(anchor);
+    else
+        pos = set.upper_bound(anchor);
+
+    if (has_current) {
+        current = set.find(anchor);
+        has_current = current != set.end();
+    }
+
+    version = owner->version;
+}
+
+PyObject *pystdcxx_set::cursor_iterator::tp_iter(pystdcxx_set::cursor_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_set::cursor_iterator::tp_iternext(pystdcxx_set::cursor_iterator *self)
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (self->pos == self->owner->set.end())
+        return nullptr;
+
+    self->current = self->pos;
+    self->has_current = true;
+    self->anchor = *self->pos;
+    self->inclusive = false;
+    ++self->pos;
+
+    Py_INCREF(self->current->get());
+    return self->current->get();
+}
+
+PyObject *pystdcxx_set::cursor_iterator::seek(pystdcxx_set::cursor_iterator *self, PyObject *key)
+{
+    try {
+        py_ptr<PyObject> anchor(key, true);
+        self->pos = self->owner->set.lower_bound(anchor);
+        self->version = self->owner->version;
+        self->anchor = anchor;
+        self->inclusive = true;
+        self->has_current = false;
+        return PyBool_FromLong(self->pos != self->owner->set.end());
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_set::cursor_iterator::next(pystdcxx_set::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    PyObject *item = tp_iternext(self);
+    if (!item && !PyErr_Occurred())
+        PyErr_SetNone(PyExc_StopIteration);
+    return item;
+}
+
+PyObject *pystdcxx_set::cursor_iterator::prev(pystdcxx_set::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (self->pos == self->owner->set.begin()) {
+        PyErr_SetNone(PyExc_StopIteration);
+        return nullptr;
+    }
+
+    --self->pos;
+    self->current = self->pos;
+    self->has_current = true;
+    self->anchor = *self->pos;
+    self->inclusive = true;
+
+    Py_INCREF(self->current->get());
+    return self->current->get();
+}
+
+PyObject *pystdcxx_set::cursor_iterator::peek(pystdcxx_set::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (self->pos == self->owner->set.end())
+        Py_RETURN_NONE;
+
+    Py_INCREF(self->pos->get());
+    return self->pos->get();
+}
+
+PyObject *pystdcxx_set::cursor_iterator::erase_current(pystdcxx_set::cursor_iterator *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        self->sync();
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    if (!self->has_current) {
+        PyErr_SetString(PyExc_KeyError, "No current item");
+        return nullptr;
+    }
+
+    // Current is either at or right before pos, erasing it leaves the
+    // next item at pos in both cases, which also holds after the array of
+    // a small set shifted.
+    self->pos = self->owner->set.erase(self->current);
+
+    self->has_current = false;
+    ++self->owner->version;
+    self->version = self->owner->version;
+    Py_RETURN_NONE;
+}
@@ -5,16 +5,23 @@
 #include <Python.h>
 #include <pyerrors.h>
 #include <set>
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
 #include "utils.hpp"
+#include "small_tree.hpp"
+#include "dump.hpp"
+#include "frozen_set.hpp"
+#include "pystdcxx_api.h"
 
 class pystdcxx_set: public py_object<pystdcxx_set>
 {
 private:
 
 public:
-    pystdcxx_set(): version(0), set(py_less(less))
+    pystdcxx_set(): version(0), set(py_less(py_ptr<PyObject>())), maxlen(-1)
     {
-        PyObject_GC_Track(this);
+        maintain_tracking();
     }
 
     ~pystdcxx_set()
@@ -34,15 +41,39 @@ public:
     static Py_ssize_t sq_length(pystdcxx_set *self);
     static int sq_contains(pystdcxx_set *self, PyObject *value);
     static PyObject *sq_inplace_concat(pystdcxx_set *self, PyObject *tuple);
+    static PyObject *mp_subscript(pystdcxx_set *self, PyObject *key);
     static PyObject *add(pystdcxx_set *self, PyObject *value);
+    static PyObject *append(pystdcxx_set *self, PyObject *value);
+    static PyObject *add_many(pystdcxx_set *self, PyObject *iterable);
     static PyObject *remove(pystdcxx_set *self, PyObject *value);
     static PyObject *clear(pystdcxx_set *self, PyObject *args);
     static PyObject *reverse(pystdcxx_set *self, PyObject *args);
+    static PyObject *iter_chunks(pystdcxx_set *self, PyObject *args, PyObject *kwds);
     static PyObject *find(pystdcxx_set *self, PyObject *value);
     static PyObject *popitem(pystdcxx_set *self, PyObject *args, PyObject *kwds);
+    static PyObject *pop_n(pystdcxx_set *self, PyObject *args, PyObject *kwds);
+    static PyObject *pop_range(pystdcxx_set *self, PyObject *args);
+    static PyObject *pop_until(pystdcxx_set *self, PyObject *key);
+    static PyObject *pop_while(pystdcxx_set *self, PyObject *predicate);
+    static PyObject *dump(pystdcxx_set *self, PyObject *args, PyObject *kwds);
+    static PyObject *cursor(pystdcxx_set *self, PyObject *args, PyObject *kwds);
+    static PyObject *freeze(pystdcxx_set *self, PyObject *args);
+
+    // C API exported through capsule, see pystdcxx_api.h
+    static int api_check(PyObject *ob);
+    static Py_ssize_t api_size(PyObject *self);
+    static int api_insert(PyObject *self, PyObject *key);
+    static int api_find(PyObject *self, PyObject *key);
+    static int api_erase(PyObject *self, PyObject *key);
+    static int api_lower_bound(PyObject *self, PyObject *key, PyObject **found);
+    static int api_for_each(PyObject *self, PyObject *lower, PyObject *upper, pystdcxx_visitproc visit, void *arg);
 
 private:
-    typedef std::set<py_ptr<PyObject>, py_less> stdcxx_set;
+    typedef small_tree<std::set<py_ptr<PyObject>, py_less>> stdcxx_set;
+
+    bool insert(PyObject *item, PyObject **stored=nullptr, PyObject **evicted=nullptr);
+    PyObject *slice(const py_key_range &base, PyObject *slice);
+    PyObject *erase_to_list(stdcxx_set::iterator first, stdcxx_set::iterator last, bool reverse);
 
     class iterator: public py_object<iterator>
     {
@@ -57,8 +88,12 @@ private:
 
         static const char *tp_name() { return "pystdcxx.set_iterator"; }
         static const char *tp_doc() { return "Python wrapper for std::set::iterator"; }
+        static PyMethodDef *tp_methods();
         static PyObject *tp_iter(iterator *self);
         static PyObject *tp_iternext(iterator *self);
+        static PyObject *next_n(iterator *self, PyObject *count);
+
+        PyObject *take(Py_ssize_t count);
 
     private:
         py_ptr<pystdcxx_set> owner;
@@ -79,8 +114,12 @@ private:
 
         static const char *tp_name() { return "pystdcxx.set_reverse_iterator"; }
         static const char *tp_doc() { return "Python wrapper for std::set::reverse_iterator"; }
+        static PyMethodDef *tp_methods();
         static PyObject *tp_iter(reverse_iterator *self);
         static PyObject *tp_iternext(reverse_iterator *self);
+        static PyObject *next_n(reverse_iterator *self, PyObject *count);
+
+        PyObject *take(Py_ssize_t count);
 
     private:
         py_ptr<pystdcxx_set> owner;
@@ -88,9 +127,97 @@ private:
         stdcxx_set::reverse_iterator first, last;
     };
 
+    // Iterator of lists of up to count items taken from inner iterator
+    template<typename I>
+    class chunk_iterator: public py_object<chunk_iterator<I>>
+    {
+    public:
+        chunk_iterator(I *inner, Py_ssize_t count):
+            inner(inner, true),
+            count(count)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.set_chunk_iterator"; }
+        static const char *tp_doc() { return "Iterator of chunks of std::set items"; }
+        static PyObject *tp_iter(chunk_iterator *self);
+        static PyObject *tp_iternext(chunk_iterator *self);
+
+    private:
+        py_ptr<I> inner;
+        Py_ssize_t count;
+    };
+
+    // Lazy view of the items in a key range, taken by slicing. Bounds are
+    // resolved with lower_bound every time the view is used, so nothing
+    // is copied and the view follows later changes of the set.
+    class range_view: public py_object<range_view>
+    {
+    public:
+        range_view(pystdcxx_set *owner, const py_key_range &range):
+            owner(owner, true),
+            range(range)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.set_range"; }
+        static const char *tp_doc() { return "Lazy view of a key range of std::set"; }
+        static PyObject *tp_repr(range_view *self);
+        static PyObject *tp_iter(range_view *self);
+        static Py_ssize_t sq_length(range_view *self);
+        static int sq_contains(range_view *self, PyObject *key);
+        static Py_ssize_t mp_length(range_view *self);
+        static PyObject *mp_subscript(range_view *self, PyObject *key);
+
+    private:
+        py_ptr<pystdcxx_set> owner;
+        py_key_range range;
+    };
+
+    // A cursor sits between two items like a bidirectional iterator. It
+    // remembers the key it was anchored to, so when the set is changed
+    // by others it re-seeks with one lower_bound/upper_bound instead of
+    // becoming invalid.
+    class cursor_iterator: public py_object<cursor_iterator>
+    {
+    public:
+        cursor_iterator(pystdcxx_set *owner):
+            owner(owner, true),
+            version(owner->version),
+            pos(owner->set.begin()),
+            inclusive(false),
+            has_current(false)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.set_cursor"; }
+        static const char *tp_doc() { return "Cursor of std::set which survives modification of the set"; }
+        static PyMethodDef *tp_methods();
+        static PyObject *tp_iter(cursor_iterator *self);
+        static PyObject *tp_iternext(cursor_iterator *self);
+        static PyObject *seek(cursor_iterator *self, PyObject *key);
+        static PyObject *next(cursor_iterator *self, PyObject *args);
+        static PyObject *prev(cursor_iterator *self, PyObject *args);
+        static PyObject *peek(cursor_iterator *self, PyObject *args);
+        static PyObject *erase_current(cursor_iterator *self, PyObject *args);
+
+    private:
+        void sync();
+
+        py_ptr<pystdcxx_set> owner;
+        unsigned int version;
+        stdcxx_set::iterator pos, current;
+        py_ptr<PyObject> anchor;
+        bool inclusive;
+        bool has_current;
+    };
+
     unsigned int version;
     stdcxx_set set;
-    py_ptr<PyObject> less;    
+    py_ptr<PyObject> less;
+    py_ptr<PyObject> cmp;               // Three-way comparator, used instead of less
+    py_ptr<intern_table> interned;      // Intern table if created with intern=True
+    Py_ssize_t maxlen;                  // Keep the largest maxlen items, -1 if unbounded
 };
 
 #endif // PYSTDCXX_SET_HPP
@@ -8,9 +8,10 @@ setup(name="pystdcxx",
       author="Andrew Chow",
       author_email="andrew_show@hotmail.com",
       url="https://github.com/andrew-show/pystdcxx",
+      headers=[ "pystdcxx_api.h" ],
       ext_modules=[
           Extension("stdcxx",
-                    [ "pystdcxx.cpp", "set.cpp", "map.cpp" ],
+                    [ "pystdcxx.cpp", "set.cpp", "map.cpp", "interval_map.cpp", "aggregate_map.cpp", "frozen_map.cpp", "frozen_set.cpp", "disk_map.cpp", "typed_map.cpp", "typed_set.cpp", "priority_map.cpp", "trie_map.cpp", "trie_set.cpp" ],
                     language='c++')]
       )
 
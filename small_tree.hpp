@@ -0,0 +1,405 @@
+#ifndef PYSTDCXX_SMALL_TREE_HPP
+#define PYSTDCXX_SMALL_TREE_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "utils.hpp"
+
+// Ordered container with the part of std::set/std::map interface used by
+// the wrappers, Tree is ordered by py_less. Up to N items are kept sorted
+// in an array inside the object, so a small container allocates no tree
+// node. It's promoted to the tree when it grows beyond N items and demoted
+// when erasing shrinks it to N / 2, the gap keeps it from flipping on
+// every insert and erase.
+//
+// Keys are compared by Python, which costs far more than walking a few
+// slots, so the array is searched with a plain binary search. With a
+// three-way comparator exact lookups stop on the first equal key, and the
+// tree is searched with a py_probe so a hit costs no extra comparison.
+//
+// Iterators into the array are invalidated by every insert and erase
+// besides the erased ones, callers already treat any change of size as
+// invalidating through their version counters.
+template<typename Tree, size_t N = 8>
+class small_tree
+{
+public:
+    typedef typename Tree::key_type key_type;
+    typedef typename Tree::value_type value_type;
+    typedef typename Tree::key_compare key_compare;
+    typedef typename Tree::size_type size_type;
+
+    template<bool Const>
+    class basic_iterator
+    {
+    public:
+        typedef typename std::conditional<Const, typename Tree::const_iterator, typename Tree::iterator>::type node_type;
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef typename small_tree::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::iterator_traits<node_type>::pointer pointer;
+        typedef typename std::iterator_traits<node_type>::reference reference;
+        typedef typename std::conditional<Const, const value_type, value_type>::type *slot_type;
+
+        basic_iterator(): node_(), slot_(nullptr) {}
+
+        template<bool C = Const, typename std::enable_if<C, int>::type = 0>
+        basic_iterator(const basic_iterator<false> &rhs): node_(rhs.node_), slot_(rhs.slot_) {}
+
+        reference operator*() const { return slot_ ? *slot_ : *node_; }
+        pointer operator->() const { return &**this; }
+
+        basic_iterator &operator++()
+        {
+            if (slot_)
+                ++slot_;
+            else
+                ++node_;
+            return *this;
+        }
+
+        basic_iterator &operator--()
+        {
+            if (slot_)
+                --slot_;
+            else
+                --node_;
+            return *this;
+        }
+
+        basic_iterator operator++(int) { basic_iterator tmp(*this); ++*this; return tmp; }
+        basic_iterator operator--(int) { basic_iterator tmp(*this); --*this; return tmp; }
+
+        bool operator==(const basic_iterator &rhs) const
+        {
+            return slot_ || rhs.slot_ ? slot_ == rhs.slot_ : node_ == rhs.node_;
+        }
+
+        bool operator!=(const basic_iterator &rhs) const { return !(*this == rhs); }
+
+    private:
+        friend class small_tree;
+        template<bool> friend class basic_iterator;
+
+        explicit basic_iterator(node_type node): node_(node), slot_(nullptr) {}
+        explicit basic_iterator(slot_type slot): node_(), slot_(slot) {}
+
+        node_type node_;
+        slot_type slot_;            // Position in the array, nullptr in tree mode
+    };
+
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    // Arguments after the comparator are passed on to the tree
+    template<typename... Args>
+    explicit small_tree(const key_compare &comp, Args&&... args):
+        tree_(comp, std::forward<Args>(args)...), count_(0), small_(true)
+    {
+    }
+
+    small_tree(const small_tree &rhs): tree_(rhs.tree_), count_(0), small_(rhs.small_)
+    {
+        for (; count_ < rhs.count_; ++count_)
+            new(slot(count_)) value_type(*rhs.slot(count_));
+    }
+
+    small_tree(small_tree &&rhs): tree_(std::move(rhs.tree_)), count_(0), small_(rhs.small_)
+    {
+        take_slots(rhs);
+    }
+
+    small_tree &operator=(small_tree &&rhs)
+    {
+        if (this != &rhs) {
+            destroy_slots();
+            tree_ = std::move(rhs.tree_);
+            small_ = rhs.small_;
+            take_slots(rhs);
+        }
+        return *this;
+    }
+
+    small_tree &operator=(const small_tree &) = delete;
+
+    ~small_tree()
+    {
+        destroy_slots();
+    }
+
+    key_compare key_comp() const { return tree_.key_comp(); }
+    size_type size() const { return small_ ? count_ : tree_.size(); }
+    bool empty() const { return size() == 0; }
+    bool small() const { return small_; }
+    const Tree &tree() const { return tree_; }
+
+    iterator begin() { return small_ ? iterator(slot(0)) : iterator(tree_.begin()); }
+    iterator end() { return small_ ? iterator(slot(count_)) : iterator(tree_.end()); }
+    const_iterator begin() const { return small_ ? const_iterator(slot(0)) : const_iterator(tree_.begin()); }
+    const_iterator end() const { return small_ ? const_iterator(slot(count_)) : const_iterator(tree_.end()); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    iterator lower_bound(const key_type &key)
+    {
+        return small_ ? iterator(slot(lower_index(key))) : iterator(tree_.lower_bound(key));
+    }
+
+    iterator upper_bound(const key_type &key)
+    {
+        if (!small_)
+            return iterator(tree_.upper_bound(key));
+
+        key_compare comp(tree_.key_comp());
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (comp(key, key_of(*slot(mid))))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return iterator(slot(lo));
+    }
+
+    iterator find(const key_type &key)
+    {
+        bool found;
+        iterator iter = locate(key, found);
+        return found ? iter : end();
+    }
+
+    // Lower bound of key, found tells whether it's equal to key
+    iterator locate(const key_type &key, bool &found)
+    {
+        if (small_)
+            return iterator(slot(find_index(key, found)));
+
+        key_compare comp(tree_.key_comp());
+        if (!comp.cmp.get()) {
+            typename Tree::iterator iter = tree_.lower_bound(key);
+            found = iter != tree_.end() && !comp(key, key_of(*iter));
+            return iterator(iter);
+        }
+
+        py_probe probe(key);
+        typename Tree::iterator iter = tree_.lower_bound(probe);
+        found = iter != tree_.end() && key_of(*iter).get() == probe.equal;
+        return iterator(iter);
+    }
+
+    // Insert an item unless its key exists, hint is checked as std::map
+    // does, the end hint costs one comparison while the array isn't full.
+    template<typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args)
+    {
+        if (!small_)
+            return iterator(tree_.emplace_hint(hint.node_, std::forward<Args>(args)...));
+
+        value_type item(std::forward<Args>(args)...);
+        const key_type &key = key_of(item);
+        key_compare comp(tree_.key_comp());
+
+        size_t i = hint.slot_ - slot(0);
+        if ((i > 0 && !comp(key_of(*slot(i - 1)), key)) || (i < count_ && !comp(key, key_of(*slot(i))))) {
+            bool found;
+            i = find_index(key, found);
+            if (found)
+                return iterator(slot(i));
+        }
+
+        if (count_ == N) {
+            promote();
+            return iterator(tree_.emplace_hint(tree_.end(), std::move(item)));
+        }
+
+        for (size_t j = count_; j > i; --j)
+            move_slot(j, j - 1);
+        new(slot(i)) value_type(std::move(item));
+        ++count_;
+        return iterator(slot(i));
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        if (!small_)
+            return demote(tree_.erase(pos.node_));
+
+        size_t i = pos.slot_ - slot(0);
+        slot(i)->~value_type();
+        for (size_t j = i + 1; j < count_; ++j)
+            move_slot(j - 1, j);
+        --count_;
+        return iterator(slot(i));
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        if (!small_)
+            return demote(tree_.erase(first.node_, last.node_));
+
+        size_t i = first.slot_ - slot(0), n = last.slot_ - first.slot_;
+        for (size_t j = i; j < i + n; ++j)
+            slot(j)->~value_type();
+        for (size_t j = i + n; j < count_; ++j)
+            move_slot(j - n, j);
+        count_ -= n;
+        return iterator(slot(i));
+    }
+
+    size_type erase(const key_type &key)
+    {
+        iterator iter = find(key);
+        if (iter == end())
+            return 0;
+
+        erase(iter);
+        return 1;
+    }
+
+    // Replace the value at pos, a tree sharing nodes with other trees may
+    // copy the node and move pos to the copy. Returns true if it did, other
+    // iterators are invalidated then.
+    template<typename V>
+    bool assign(iterator &pos, const V &value)
+    {
+        if (!small_)
+            return tree_.assign(pos.node_, value);
+
+        pos.slot_->second = value;
+        return false;
+    }
+
+    void clear()
+    {
+        destroy_slots();
+        tree_.clear();
+        small_ = true;
+    }
+
+private:
+    static const key_type &key_of(const key_type &key) { return key; }
+
+    template<typename K, typename V>
+    static const K &key_of(const std::pair<const K, V> &item) { return item.first; }
+
+    value_type *slot(size_t i) { return reinterpret_cast<value_type *>(slots_) + i; }
+    const value_type *slot(size_t i) const { return reinterpret_cast<const value_type *>(slots_) + i; }
+
+    // Construct slot to from slot from and destroy the latter
+    void move_slot(size_t to, size_t from)
+    {
+        new(slot(to)) value_type(std::move(*slot(from)));
+        slot(from)->~value_type();
+    }
+
+    void take_slots(small_tree &rhs)
+    {
+        for (; count_ < rhs.count_; ++count_)
+            new(slot(count_)) value_type(std::move(*rhs.slot(count_)));
+        rhs.destroy_slots();
+        rhs.small_ = true;
+    }
+
+    void destroy_slots()
+    {
+        for (size_t i = 0; i < count_; ++i)
+            slot(i)->~value_type();
+        count_ = 0;
+    }
+
+    size_t lower_index(const key_type &key) const
+    {
+        key_compare comp(tree_.key_comp());
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (comp(key_of(*slot(mid)), key))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    // Index of the lower bound of key, a three-way comparator ends the
+    // search at the first equal key
+    size_t find_index(const key_type &key, bool &found) const
+    {
+        key_compare comp(tree_.key_comp());
+        size_t lo = 0, hi = count_;
+
+        if (!comp.cmp.get()) {
+            lo = lower_index(key);
+            found = lo < count_ && !comp(key, key_of(*slot(lo)));
+            return lo;
+        }
+
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int result = comp.compare(key_of(*slot(mid)), key);
+            if (result == 0) {
+                found = true;
+                return mid;
+            }
+
+            if (result < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        found = false;
+        return lo;
+    }
+
+    // Move items to the tree, they are copied first so the array is left
+    // intact if the comparator throws.
+    void promote()
+    {
+        try {
+            for (size_t i = 0; i < count_; ++i)
+                tree_.emplace_hint(tree_.end(), *slot(i));
+        } catch ( ... ) {
+            tree_.clear();
+            throw;
+        }
+
+        destroy_slots();
+        small_ = false;
+    }
+
+    // Move items back to the array once the tree is small enough, pos is
+    // translated to the same position in the array.
+    iterator demote(typename Tree::iterator pos)
+    {
+        if (tree_.size() > N / 2)
+            return iterator(pos);
+
+        size_t index = tree_.size();
+        for (typename Tree::iterator iter = tree_.begin(); iter != tree_.end(); ++iter) {
+            if (iter == pos)
+                index = count_;
+            new(slot(count_)) value_type(*iter);
+            ++count_;
+        }
+
+        tree_.clear();
+        small_ = true;
+        return iterator(slot(index));
+    }
+
+    Tree tree_;                 // Holds the comparator in both modes
+    size_t count_;              // Number of items in the array
+    bool small_;                // Items are in the array rather than the tree
+    alignas(value_type) unsigned char slots_[N * sizeof(value_type)];
+};
+
+#endif // PYSTDCXX_SMALL_TREE_HPP
@@ -0,0 +1,74 @@
+import unittest
+
+import stdcxx
+
+
+class AccessTest(unittest.TestCase):
+    def test_get_and_setdefault(self):
+        m = stdcxx.map()
+        self.assertIsNone(m.get(1))
+        self.assertEqual(m.get(1, 'x'), 'x')
+        self.assertEqual(m.setdefault(1, 'a'), 'a')
+        self.assertEqual(m.setdefault(1, 'b'), 'a')
+        self.assertIsNone(m.setdefault(2))
+        self.assertEqual(list(m), [(1, 'a'), (2, None)])
+
+    def test_pop(self):
+        m = stdcxx.map(((1, 'a'),))
+        self.assertEqual(m.pop(1), 'a')
+        self.assertEqual(m.pop(1, 'd'), 'd')
+        with self.assertRaises(KeyError):
+            m.pop(1)
+
+    def test_incr(self):
+        m = stdcxx.map()
+        self.assertEqual(m.incr(2), 1)
+        self.assertEqual(m.incr(2, 5), 6)
+        self.assertEqual(m.incr(3, 1.5), 1.5)
+        self.assertEqual(m[2], 6)
+        m[4] = []
+        with self.assertRaises(TypeError):
+            m.incr(4)
+        self.assertEqual(m[4], [])
+
+    def test_upsert(self):
+        m = stdcxx.map()
+        self.assertEqual(m.upsert(4, lambda v: (v or []) + [1]), [1])
+        self.assertEqual(m.upsert(4, lambda v: v + [2]), [1, 2])
+        with self.assertRaises(ZeroDivisionError):
+            m.upsert(4, lambda v: 1 / 0)
+        self.assertEqual(m[4], [1, 2])
+
+    def test_upsert_mutating(self):
+        m = stdcxx.map()
+
+        def fn(v):
+            for i in range(100):
+                m[i] = i
+            m.snapshot()
+            return 7
+
+        self.assertEqual(m.upsert(1000, fn), 7)
+        self.assertEqual(m[1000], 7)
+        self.assertEqual(len(m), 101)
+
+    def test_snapshot_isolation(self):
+        m = stdcxx.map(((1, 1),))
+        s = m.snapshot()
+        m.incr(1)
+        m.setdefault(2, 2)
+        m.pop(1)
+        self.assertEqual(list(s), [(1, 1)])
+        self.assertEqual(list(m), [(2, 2)])
+
+    def test_changelog(self):
+        m = stdcxx.map(changelog=8)
+        m.setdefault(1, 'a')
+        m.incr(2)
+        m.pop(1)
+        self.assertEqual(m.changes_since(0)[1],
+                         [(1, 'set', 1, 'a'), (2, 'set', 2, 1), (3, 'del', 1, None)])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,78 @@
+import random
+import unittest
+
+import stdcxx
+
+
+class AggregateMapTest(unittest.TestCase):
+    def test_queries(self):
+        m = stdcxx.aggregate_map([(i, float(i * i)) for i in range(10)])
+        self.assertEqual(len(m), 10)
+        self.assertEqual(m.range_sum(), sum(i * i for i in range(10)))
+        self.assertEqual(m.range_sum(2, 5), 4 + 9 + 16)
+        self.assertEqual(m.range_count(2, 5), 3)
+        self.assertEqual(m.range_min(3), 9.0)
+        self.assertEqual(m.range_max(None, 4), 9.0)
+        self.assertEqual(m.prefix_sum(3), 0 + 1 + 4)
+        self.assertIsNone(m.range_min(20, 30))
+        self.assertEqual(m.range_count(5, 2), 0)
+
+    def test_against_dict(self):
+        rng = random.Random(7)
+        m, d = stdcxx.aggregate_map(), {}
+        for _ in range(3000):
+            key = rng.randrange(500)
+            if rng.random() < 0.3 and key in d:
+                del m[key]
+                del d[key]
+            else:
+                d[key] = rng.randrange(-100, 100)
+                m[key] = d[key]
+
+        self.assertEqual(len(m), len(d))
+        self.assertEqual([k for k, v in m], sorted(d))
+        for _ in range(200):
+            lo, hi = sorted(rng.sample(range(-10, 510), 2))
+            values = [v for k, v in d.items() if lo <= k < hi]
+            self.assertEqual(m.range_count(lo, hi), len(values))
+            self.assertEqual(m.range_sum(lo, hi), sum(values))
+            self.assertEqual(m.range_min(lo, hi), min(values) if values else None)
+            self.assertEqual(m.range_max(lo, hi), max(values) if values else None)
+
+    def test_int_sums_are_exact(self):
+        m = stdcxx.aggregate_map([(0, 2), (1, 3)])
+        self.assertIsInstance(m.range_sum(), int)
+        self.assertEqual(m.range_sum(), 5)
+        m[0] = 2 ** 53
+        m[1] = 1
+        self.assertEqual(m.range_sum(), 2 ** 53 + 1)
+        self.assertEqual(m.range_max(), 2 ** 53)
+        big = 2 ** 63 - 1
+        m = stdcxx.aggregate_map([(i, big) for i in range(4)])
+        self.assertEqual(m.range_sum(), 4 * big)
+        self.assertEqual(m.prefix_sum(3), 3 * big)
+        m = stdcxx.aggregate_map([(i, -big - 1) for i in range(4)])
+        self.assertEqual(m.range_sum(), 4 * (-big - 1))
+        self.assertEqual(m.range_sum(5, 9), 0)
+
+    def test_float_or_big_int_makes_sum_float(self):
+        m = stdcxx.aggregate_map([(0, 1), (1, 0.5)])
+        self.assertEqual(m.range_sum(), 1.5)
+        self.assertIsInstance(m.range_sum(0, 1), int)
+        m[2] = 2 ** 64
+        self.assertIsInstance(m.range_sum(2, 3), float)
+        self.assertEqual(m.range_sum(2, 3), float(2 ** 64))
+
+    def test_values_must_be_numbers(self):
+        m = stdcxx.aggregate_map()
+        with self.assertRaises(TypeError):
+            m[1] = 'x'
+        with self.assertRaises(KeyError):
+            del m[1]
+        m[1] = 1
+        m.clear()
+        self.assertEqual(len(m), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,55 @@
+import unittest
+
+import stdcxx
+
+
+class AppendTest(unittest.TestCase):
+    def test_map_append(self):
+        m = stdcxx.map(((1, 'a'),))
+        m.append(2, 'b')
+        with self.assertRaises(ValueError):
+            m.append(2, 'c')
+        with self.assertRaises(ValueError):
+            m.append(0, 'c')
+        self.assertEqual(list(m), [(1, 'a'), (2, 'b')])
+
+    def test_map_append_less(self):
+        m = stdcxx.map(less=lambda a, b: a > b)
+        m.append(3, 'a')
+        m.append(1, 'b')
+        with self.assertRaises(ValueError):
+            m.append(2, 'c')
+        self.assertEqual(list(m), [(3, 'a'), (1, 'b')])
+
+    def test_ascending_insert(self):
+        calls = 0
+
+        def less(a, b):
+            nonlocal calls
+            calls += 1
+            return a < b
+
+        m = stdcxx.map(less=less)
+        for i in range(1000):
+            m[i] = i
+        self.assertLess(calls, 3000)
+        self.assertEqual(list(m)[-1], (999, 999))
+
+    def test_set_append(self):
+        s = stdcxx.set((1, 2))
+        s.append(3)
+        with self.assertRaises(ValueError):
+            s.append(3)
+        with self.assertRaises(ValueError):
+            s.append(0)
+        self.assertEqual(list(s), [1, 2, 3])
+
+    def test_set_append_maxlen(self):
+        s = stdcxx.set(maxlen=3)
+        for i in range(10):
+            s.append(i)
+        self.assertEqual(list(s), [7, 8, 9])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,46 @@
+import unittest
+
+import stdcxx
+
+
+class BoundedSetTest(unittest.TestCase):
+    def test_keeps_largest(self):
+        s = stdcxx.set(maxlen=3)
+        for i in [5, 1, 9, 3, 7]:
+            s.add(i)
+        self.assertEqual(list(s), [5, 7, 9])
+
+    def test_early_rejection(self):
+        s = stdcxx.set([5, 6, 7], maxlen=3)
+        self.assertFalse(s.add(1))
+        self.assertFalse(s.add(5))
+        self.assertTrue(s.add(8))
+        self.assertEqual(list(s), [6, 7, 8])
+
+    def test_add_many_counts_items_kept(self):
+        s = stdcxx.set(maxlen=3)
+        self.assertEqual(s.add_many(range(10)), 3)
+        self.assertEqual(list(s), [7, 8, 9])
+
+        s = stdcxx.set([0, 1, 2], maxlen=3)
+        self.assertEqual(s.add_many([5, 6]), 2)
+        self.assertEqual(list(s), [2, 5, 6])
+
+        s = stdcxx.set([100, 101, 102], maxlen=3)
+        self.assertEqual(s.add_many(range(10)), 0)
+
+    def test_add_many_unbounded(self):
+        s = stdcxx.set([1])
+        self.assertEqual(s.add_many([1, 2, 2, 3]), 2)
+        self.assertEqual(list(s), [1, 2, 3])
+
+    def test_zero_and_negative(self):
+        s = stdcxx.set(maxlen=0)
+        self.assertEqual(s.add_many(range(5)), 0)
+        self.assertEqual(len(s), 0)
+        with self.assertRaises(ValueError):
+            stdcxx.set(maxlen=-1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,93 @@
+import ctypes
+import unittest
+
+import stdcxx
+
+O = ctypes.py_object
+P = ctypes.POINTER(ctypes.py_object)
+VISIT = ctypes.PYFUNCTYPE(ctypes.c_int, O, O, ctypes.c_void_p)
+SET_VISIT = ctypes.PYFUNCTYPE(ctypes.c_int, O, ctypes.c_void_p, ctypes.c_void_p)
+
+
+class Api(ctypes.Structure):
+    _fields_ = [
+        ('version', ctypes.c_int),
+        ('map_check', ctypes.PYFUNCTYPE(ctypes.c_int, O)),
+        ('map_size', ctypes.PYFUNCTYPE(ctypes.c_ssize_t, O)),
+        ('map_insert', ctypes.PYFUNCTYPE(ctypes.c_int, O, O, O)),
+        ('map_find', ctypes.PYFUNCTYPE(ctypes.c_int, O, O, P)),
+        ('map_erase', ctypes.PYFUNCTYPE(ctypes.c_int, O, O)),
+        ('map_lower_bound', ctypes.PYFUNCTYPE(ctypes.c_int, O, O, P, P)),
+        ('map_for_each', ctypes.PYFUNCTYPE(ctypes.c_int, O, ctypes.c_void_p, ctypes.c_void_p, VISIT, ctypes.c_void_p)),
+        ('set_check', ctypes.PYFUNCTYPE(ctypes.c_int, O)),
+        ('set_size', ctypes.PYFUNCTYPE(ctypes.c_ssize_t, O)),
+        ('set_insert', ctypes.PYFUNCTYPE(ctypes.c_int, O, O)),
+        ('set_find', ctypes.PYFUNCTYPE(ctypes.c_int, O, O)),
+        ('set_erase', ctypes.PYFUNCTYPE(ctypes.c_int, O, O)),
+        ('set_lower_bound', ctypes.PYFUNCTYPE(ctypes.c_int, O, O, P)),
+        ('set_for_each', ctypes.PYFUNCTYPE(ctypes.c_int, O, ctypes.c_void_p, ctypes.c_void_p, SET_VISIT, ctypes.c_void_p)),
+    ]
+
+
+def import_api():
+    get_pointer = ctypes.pythonapi.PyCapsule_GetPointer
+    get_pointer.restype = ctypes.c_void_p
+    get_pointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+    return Api.from_address(get_pointer(stdcxx._C_API, b'stdcxx._C_API'))
+
+
+class CApiTest(unittest.TestCase):
+    def setUp(self):
+        self.api = import_api()
+
+    def test_map(self):
+        api, m = self.api, stdcxx.map()
+        self.assertEqual(api.version, 1)
+        self.assertEqual(api.map_check(m), 1)
+        self.assertEqual(api.map_check(stdcxx.set()), 0)
+        self.assertEqual(api.map_insert(m, 2, 'b'), 1)
+        self.assertEqual(api.map_insert(m, 2, 'B'), 0)
+        api.map_insert(m, 4, 'd')
+        self.assertEqual(api.map_size(m), 2)
+
+        value = O()
+        self.assertEqual(api.map_find(m, 2, ctypes.pointer(value)), 1)
+        self.assertEqual(value.value, 'B')
+        self.assertEqual(api.map_find(m, 3, ctypes.pointer(O())), 0)
+
+        found, value = O(), O()
+        self.assertEqual(api.map_lower_bound(m, 3, ctypes.pointer(found), ctypes.pointer(value)), 1)
+        self.assertEqual((found.value, value.value), (4, 'd'))
+
+        seen = []
+        visit = VISIT(lambda key, value, arg: seen.append((key, value)) or 0)
+        self.assertEqual(api.map_for_each(m, None, None, visit, None), 0)
+        self.assertEqual(seen, [(2, 'B'), (4, 'd')])
+
+        self.assertEqual(api.map_erase(m, 2), 1)
+        self.assertEqual(api.map_erase(m, 2), 0)
+        self.assertEqual(list(m), [(4, 'd')])
+
+    def test_set(self):
+        api, s = self.api, stdcxx.set()
+        self.assertEqual(api.set_check(s), 1)
+        self.assertEqual(api.set_insert(s, 3), 1)
+        self.assertEqual(api.set_insert(s, 3), 0)
+        api.set_insert(s, 1)
+        self.assertEqual(api.set_size(s), 2)
+        self.assertEqual(api.set_find(s, 1), 1)
+        self.assertEqual(api.set_find(s, 2), 0)
+
+        found = O()
+        self.assertEqual(api.set_lower_bound(s, 2, ctypes.pointer(found)), 1)
+        self.assertEqual(found.value, 3)
+
+        seen = []
+        visit = SET_VISIT(lambda key, value, arg: seen.append(key) or 0)
+        self.assertEqual(api.set_for_each(s, None, None, visit, None), 0)
+        self.assertEqual(seen, [1, 3])
+        self.assertEqual(api.set_erase(s, 1), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,68 @@
+import unittest
+
+import stdcxx
+
+
+class ChangelogTest(unittest.TestCase):
+    def test_changes_since(self):
+        m = stdcxx.map(((1, 'a'), (2, 'b')), changelog=4)
+        self.assertEqual(m.changes_since(0), (2, [(1, 'set', 1, 'a'), (2, 'set', 2, 'b')]))
+        m[3] = 'c'
+        del m[1]
+        self.assertEqual(m.changes_since(2), (4, [(3, 'set', 3, 'c'), (4, 'del', 1, None)]))
+        self.assertEqual(m.changes_since(4), (4, []))
+
+    def test_dropped(self):
+        m = stdcxx.map(changelog=2)
+        for i in range(5):
+            m[i] = i
+        self.assertEqual(m.changes_since(1), (5, None))
+        self.assertEqual(m.changes_since(3), (5, [(4, 'set', 3, 3), (5, 'set', 4, 4)]))
+
+    def test_clear(self):
+        m = stdcxx.map(((1, 1),), changelog=4)
+        m.clear()
+        m[2] = 2
+        self.assertEqual(m.changes_since(0), (3, [(2, 'clear', None, None), (3, 'set', 2, 2)]))
+
+    def test_clear_empty(self):
+        m = stdcxx.map(changelog=4)
+        m.clear()
+        self.assertEqual(m.changes_since(0), (0, []))
+        m[1] = 1
+        s = m.snapshot()
+        del m[1]
+        m.clear()
+        self.assertEqual(m.changes_since(0), (2, [(1, 'set', 1, 1), (2, 'del', 1, None)]))
+        self.assertEqual(list(s), [(1, 1)])
+
+    def test_reinit_comparator(self):
+        m = stdcxx.map(((1, 1), (2, 2)), changelog=4)
+        m.__init__(cmp=lambda a, b: b - a, changelog=4)
+        self.assertEqual(len(m), 0)
+        self.assertEqual(m.changes_since(0), (3, [(3, 'clear', None, None)]))
+        m.__init__(less=lambda a, b: a < b, changelog=4)
+        self.assertEqual(m.changes_since(0), (3, [(3, 'clear', None, None)]))
+        m[5] = 5
+        m.__init__(((3, 3),), less=lambda a, b: a < b, changelog=4)
+        self.assertEqual(m.changes_since(4), (6, [(5, 'clear', None, None), (6, 'set', 3, 3)]))
+
+    def test_popitem_and_cursor(self):
+        m = stdcxx.map(((1, 1), (2, 2)), changelog=8)
+        self.assertEqual(m.popitem(), (1, 1))
+        c = m.cursor()
+        c.next()
+        c.erase_current()
+        self.assertEqual(m.changes_since(2), (4, [(3, 'del', 1, None), (4, 'del', 2, None)]))
+
+    def test_disabled(self):
+        with self.assertRaises(ValueError):
+            stdcxx.map().changes_since(0)
+        with self.assertRaises(ValueError):
+            stdcxx.map(changelog=-1)
+        with self.assertRaises(ValueError):
+            stdcxx.map(changelog=1).changes_since(5)
+
+
+if __name__ == '__main__':
+    unittest.main()
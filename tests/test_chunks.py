@@ -0,0 +1,58 @@
+import unittest
+
+import stdcxx
+
+
+class NextNTest(unittest.TestCase):
+    def setUp(self):
+        self.m = stdcxx.map()
+        for i in range(20):
+            self.m[i] = str(i)
+
+    def test_next_n(self):
+        it = iter(self.m)
+        self.assertEqual(it.next_n(3), [(0, '0'), (1, '1'), (2, '2')])
+        self.assertEqual(next(it), (3, '3'))
+        self.assertEqual(len(it.next_n(100)), 16)
+        self.assertEqual(it.next_n(5), [])
+        with self.assertRaises(ValueError):
+            iter(self.m).next_n(-1)
+
+    def test_reverse_and_slice(self):
+        self.assertEqual(self.m.reverse().next_n(2), [(19, '19'), (18, '18')])
+        self.assertEqual(iter(self.m[5:9]).next_n(10), [(i, str(i)) for i in range(5, 9)])
+
+    def test_set(self):
+        s = stdcxx.set(tuple(range(10)))
+        self.assertEqual(iter(s).next_n(4), [0, 1, 2, 3])
+        self.assertEqual(s.reverse().next_n(2), [9, 8])
+        self.assertEqual(iter(s[2:5]).next_n(9), [2, 3, 4])
+
+
+class IterChunksTest(unittest.TestCase):
+    def test_map(self):
+        m = stdcxx.map([(i, str(i)) for i in range(20)])
+        chunks = list(m.iter_chunks(7))
+        self.assertEqual([len(c) for c in chunks], [7, 7, 6])
+        self.assertEqual(sum(chunks, []), list(m))
+        self.assertEqual(list(m.iter_chunks(7, reverse=True))[0][0], (19, '19'))
+        with self.assertRaises(ValueError):
+            m.iter_chunks(0)
+
+    def test_invalidated(self):
+        m = stdcxx.map([(i, i) for i in range(20)])
+        chunks = m.iter_chunks(5)
+        next(chunks)
+        m[100] = 1
+        with self.assertRaises(RuntimeError):
+            next(chunks)
+
+    def test_set(self):
+        s = stdcxx.set(tuple(range(10)))
+        self.assertEqual(list(s.iter_chunks(4)), [[0, 1, 2, 3], [4, 5, 6, 7], [8, 9]])
+        self.assertEqual(list(s.iter_chunks(4, reverse=True))[-1], [1, 0])
+        self.assertEqual(list(stdcxx.set().iter_chunks(4)), [])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,94 @@
+import gc
+import unittest
+
+import stdcxx
+
+
+def counting(fn):
+    def wrapper(a, b):
+        wrapper.calls += 1
+        return fn(a, b)
+    wrapper.calls = 0
+    return wrapper
+
+
+class CmpTest(unittest.TestCase):
+    def test_fewer_calls_than_less(self):
+        cmp = counting(lambda a, b: (a > b) - (a < b))
+        less = counting(lambda a, b: a < b)
+        keys = list(range(0, 2000, 2))
+        mc = stdcxx.map(tuple((k, k) for k in keys), cmp=cmp)
+        ml = stdcxx.map(tuple((k, k) for k in keys), less=less)
+        self.assertEqual(list(mc), list(ml))
+        for k in keys:
+            self.assertEqual(mc[k], k)
+            self.assertEqual(ml[k], k)
+
+        # A miss needs no extra equality test with a three-way comparator
+        cmp.calls = less.calls = 0
+        for k in range(1, 2000, 2):
+            self.assertNotIn(k, mc)
+            self.assertNotIn(k, ml)
+        self.assertLess(cmp.calls, less.calls)
+
+        # Inline arrays stop on the first equal key
+        small_cmp = stdcxx.map(((1, 1), (2, 2), (3, 3)), cmp=cmp)
+        small_less = stdcxx.map(((1, 1), (2, 2), (3, 3)), less=less)
+        cmp.calls = less.calls = 0
+        for k in (1, 2, 3):
+            self.assertEqual(small_cmp[k], k)
+            self.assertEqual(small_less[k], k)
+        self.assertLess(cmp.calls, less.calls)
+
+    def test_map(self):
+        m = stdcxx.map(((3, 1), (1, 2)), cmp=lambda a, b: b - a)
+        self.assertEqual([k for k, v in m], [3, 1])
+        m[2] = 0
+        self.assertEqual([k for k, v in m], [3, 2, 1])
+        del m[3]
+        self.assertNotIn(3, m)
+        self.assertEqual(m.get(5, 'd'), 'd')
+        self.assertEqual(m.snapshot()[1], 2)
+
+    def test_float_result(self):
+        m = stdcxx.map([(1.5, 1), (0.5, 2), (1.0, 3)], cmp=lambda a, b: a - b)
+        self.assertEqual([k for k, v in m], [0.5, 1.0, 1.5])
+        self.assertEqual(m[1.0], 3)
+        self.assertNotIn(0.75, m)
+        s = stdcxx.set((0.25, 0.125), cmp=lambda a, b: a - b)
+        self.assertEqual(list(s), [0.125, 0.25])
+
+    def test_set(self):
+        s = stdcxx.set((1, 5, 3), cmp=lambda a, b: b - a)
+        self.assertEqual(list(s), [5, 3, 1])
+        self.assertIn(3, s)
+        self.assertNotIn(4, s)
+        s.remove(3)
+        self.assertEqual(list(s), [5, 1])
+
+    def test_frozen(self):
+        f = stdcxx.map(((3, 1), (1, 2)), cmp=lambda a, b: b - a).freeze()
+        self.assertEqual(f[3], 1)
+        self.assertNotIn(2, f)
+        self.assertEqual([k for k, v in f], [3, 1])
+        fs = stdcxx.frozen_set((1, 5, 3), cmp=lambda a, b: b - a)
+        self.assertEqual(list(fs), [5, 3, 1])
+        self.assertIn(3, fs)
+
+    def test_invalid(self):
+        with self.assertRaises(ValueError):
+            stdcxx.map(less=lambda a, b: a < b, cmp=lambda a, b: 0)
+        with self.assertRaises(ValueError):
+            stdcxx.map(cmp=3)
+        with self.assertRaises((TypeError, RuntimeError)):
+            stdcxx.map(((1, 1), (2, 2), (3, 3)), cmp=lambda a, b: 'x')
+
+    def test_cycle(self):
+        m = stdcxx.map(cmp=lambda a, b: 0)
+        m[1] = m
+        del m
+        gc.collect()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,79 @@
+import unittest
+
+import stdcxx
+
+
+class MapCursorTest(unittest.TestCase):
+    def test_walk(self):
+        m = stdcxx.map([(i, str(i)) for i in range(5)])
+        c = m.cursor()
+        self.assertEqual(list(c), [(i, str(i)) for i in range(5)])
+        self.assertEqual(c.prev(), (4, '4'))
+        self.assertEqual(c.prev(), (3, '3'))
+        self.assertEqual(c.peek(), (3, '3'))
+        self.assertEqual(c.next(), (3, '3'))
+
+    def test_seek(self):
+        m = stdcxx.map([(i * 2, i) for i in range(5)])
+        c = m.cursor(3)
+        self.assertEqual(c.next(), (4, 2))
+        self.assertFalse(c.seek(100))
+        self.assertIsNone(c.peek())
+        with self.assertRaises(StopIteration):
+            c.next()
+        self.assertTrue(c.seek(0))
+        self.assertEqual(c.next(), (0, 0))
+
+    def test_survives_changes(self):
+        m = stdcxx.map([(i, i) for i in range(10)])
+        c = m.cursor()
+        seen = []
+        for key, value in c:
+            seen.append(key)
+            if key == 2:
+                del m[3]
+                m[7.5] = 0
+                m[-1] = 0
+        self.assertEqual(seen, [0, 1, 2, 4, 5, 6, 7, 7.5, 8, 9])
+
+    def test_erase_current(self):
+        m = stdcxx.map([(i, i) for i in range(10)])
+        c = m.cursor()
+        for key, value in c:
+            if key % 2:
+                c.erase_current()
+        self.assertEqual(list(m), [(i, i) for i in range(0, 10, 2)])
+        with self.assertRaises(KeyError):
+            c.erase_current()
+
+    def test_survives_snapshot(self):
+        m = stdcxx.map([(i, i) for i in range(10)])
+        c = m.cursor()
+        c.next()
+        s = m.snapshot()
+        del m[1]
+        self.assertEqual(c.next(), (2, 2))
+        self.assertEqual(len(s), 10)
+
+
+class SetCursorTest(unittest.TestCase):
+    def test_walk(self):
+        s = stdcxx.set(list(range(5)))
+        c = s.cursor(2)
+        self.assertEqual(c.next(), 2)
+        s.remove(3)
+        s.add(2.5)
+        self.assertEqual(list(c), [2.5, 4])
+        self.assertEqual(c.prev(), 4)
+
+    def test_erase_current(self):
+        s = stdcxx.set(list(range(10)))
+        c = s.cursor()
+        for item in c:
+            if item >= 5:
+                c.erase_current()
+        self.assertEqual(list(s), list(range(5)))
+
+
+if __name__ == '__main__':
+    unittest.main()
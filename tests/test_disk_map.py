@@ -0,0 +1,162 @@
+import os
+import random
+import tempfile
+import unittest
+
+import stdcxx
+
+
+class DiskMapTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.addCleanup(self.dir.cleanup)
+
+    def open(self, **kwargs):
+        m = stdcxx.disk_map(self.dir.name, **kwargs)
+        self.addCleanup(m.close)
+        return m
+
+    def test_basic(self):
+        m = self.open()
+        m[2] = 'b'
+        m[1] = b'a'
+        self.assertEqual(list(m), [(1, b'a'), (2, 'b')])
+        self.assertEqual(len(m), 2)
+        self.assertIn(1, m)
+        self.assertEqual(m.get(3, 'x'), 'x')
+        del m[1]
+        self.assertNotIn(1, m)
+        with self.assertRaises(KeyError):
+            del m[1]
+        with self.assertRaises(KeyError):
+            m[1]
+
+    def test_reopen(self):
+        m = self.open(memtable_size=64, max_runs=2)
+        for i in range(100):
+            m[i] = str(i)
+        del m[5]
+        m.compact()
+        m.close()
+
+        m = self.open()
+        self.assertEqual(len(m), 99)
+        self.assertEqual(m[7], '7')
+        self.assertNotIn(5, m)
+
+    def runs(self):
+        return sorted(name for name in os.listdir(self.dir.name) if name.endswith('.run'))
+
+    def test_compaction_keeps_big_runs(self):
+        m = self.open(memtable_size=256, max_runs=4)
+        for i in range(2000):
+            m[i] = 'x' * 16
+        m.compact()
+        [big] = self.runs()
+        stat = os.stat(os.path.join(self.dir.name, big))
+        for i in range(200):
+            m[10000 + i] = 'y' * 16
+        self.assertIn(big, self.runs())
+        again = os.stat(os.path.join(self.dir.name, big))
+        self.assertEqual((stat.st_ino, stat.st_mtime_ns), (again.st_ino, again.st_mtime_ns))
+        self.assertEqual(len(m), 2200)
+
+    def test_against_dict(self):
+        rng = random.Random(3)
+        m, d = self.open(memtable_size=128, max_runs=3), {}
+        for _ in range(3000):
+            key = rng.randrange(300)
+            if rng.random() < 0.3 and key in d:
+                del m[key]
+                del d[key]
+            else:
+                d[key] = str(rng.randrange(1000))
+                m[key] = d[key]
+        self.assertEqual(list(m), sorted(d.items()))
+        m.close()
+        m = self.open()
+        self.assertEqual(list(m), sorted(d.items()))
+        m.compact()
+        self.assertEqual(list(m), sorted(d.items()))
+        self.assertEqual(len(self.runs()), 1)
+
+    def test_pop_and_setdefault(self):
+        m = self.open(memtable_size=64)
+        for i in range(20):
+            m[i] = str(i)
+        self.assertEqual(m.pop(3), '3')
+        self.assertNotIn(3, m)
+        self.assertEqual(m.pop(3, 'x'), 'x')
+        with self.assertRaises(KeyError):
+            m.pop(3)
+        self.assertEqual(m.setdefault(4, 'y'), '4')
+        self.assertEqual(m.setdefault(30, 'y'), 'y')
+        self.assertEqual(m[30], 'y')
+
+    def test_popitem(self):
+        m = self.open(memtable_size=64)
+        for i in range(20):
+            m[i] = str(i)
+        m.flush()
+        del m[0]
+        self.assertEqual(m.popitem(), (1, '1'))
+        self.assertEqual(m.popitem(last=True), (19, '19'))
+        self.assertEqual(len(m), 17)
+        m.clear()
+        with self.assertRaises(ValueError):
+            m.popitem()
+
+    def test_find(self):
+        m = self.open()
+        for i in range(0, 10, 2):
+            m[i] = str(i)
+        self.assertEqual(list(m.find(6)), [(6, '6'), (8, '8')])
+        self.assertEqual(list(m.find(5)), [])
+        self.assertEqual(list(m[3:7]), [(4, '4'), (6, '6')])
+
+    def test_clear(self):
+        m = self.open(memtable_size=64, max_runs=2)
+        for i in range(100):
+            m[i] = str(i)
+        it = iter(m)
+        m.clear()
+        self.assertEqual(len(m), 0)
+        self.assertEqual(list(m), [])
+        with self.assertRaises(RuntimeError):
+            next(it)
+        m[1] = 'a'
+        m.close()
+
+        m = self.open()
+        self.assertEqual(list(m), [(1, 'a')])
+
+    def test_key_limits(self):
+        m = self.open()
+        with self.assertRaises(TypeError):
+            m[1.5] = 'a'
+        with self.assertRaises(OverflowError):
+            m[1 << 64] = 'a'
+        m[b'b'] = 'b'
+        m['s'] = 's'
+        m[-1] = 'i'
+        self.assertEqual([k for k, v in m], [b'b', -1, 's'])
+
+    def test_dumps(self):
+        import pickle
+        m = self.open(dumps=pickle.dumps, loads=pickle.loads)
+        m[1] = [1, 2]
+        self.assertEqual(m[1], [1, 2])
+        with self.assertRaises(TypeError):
+            self.open()[2] = 1
+
+    def test_closed(self):
+        m = self.open()
+        m.close()
+        with self.assertRaises(ValueError):
+            m[1] = 'a'
+        with self.assertRaises(ValueError):
+            m.pop(1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,82 @@
+import io
+import marshal
+import unittest
+
+import stdcxx
+
+
+class ClearOnStr:
+    def __init__(self, owner):
+        self.owner = owner
+
+    def __str__(self):
+        self.owner.clear()
+        return 'x'
+
+    def __lt__(self, other):
+        return id(self) < id(other)
+
+
+class DumpTest(unittest.TestCase):
+    def test_map_jsonl(self):
+        m = stdcxx.map([(1, 'a'), (2, None), (3, 1.5)])
+        f = io.StringIO()
+        m.dump(f)
+        self.assertEqual(f.getvalue(), '[1, "a"]\n[2, null]\n[3, 1.5]\n')
+
+    def test_map_csv(self):
+        m = stdcxx.map([(1, 'a,b'), (2, 'c')])
+        f = io.StringIO()
+        m.dump(f, format='csv')
+        self.assertEqual(f.getvalue(), '1,"a,b"\n2,c\n')
+
+    def test_set_binary(self):
+        s = stdcxx.set([3, 1, 2])
+        f = io.BytesIO()
+        s.dump(f, format='binary')
+        data, items = f.getvalue(), []
+        while data:
+            size = int.from_bytes(data[:4], 'little')
+            items.append(marshal.loads(data[4:4 + size]))
+            data = data[4 + size:]
+        self.assertEqual(items, [1, 2, 3])
+
+    def test_small_chunks(self):
+        m = stdcxx.map([(i, i) for i in range(100)])
+        writes = []
+        m.dump(type('F', (), {'write': lambda self, s: writes.append(s)})(), chunk_size=16)
+        self.assertGreater(len(writes), 1)
+        self.assertEqual(''.join(writes), ''.join('[%d, %d]\n' % (i, i) for i in range(100)))
+
+    def test_range(self):
+        m = stdcxx.map([(i, i) for i in range(20)])
+        s = stdcxx.set(list(range(20)))
+        for c in (m, s):
+            f = io.StringIO()
+            c.dump(f, format='csv', first=5, last=8)
+            self.assertEqual(len(f.getvalue().splitlines()), 3)
+
+            f = io.StringIO()
+            c.dump(f, first=15, last=10)
+            self.assertEqual(f.getvalue(), '')
+
+    def test_invalid_format(self):
+        with self.assertRaises(ValueError):
+            stdcxx.map().dump(io.StringIO(), format='xml')
+
+    def test_change_while_dumping(self):
+        m = stdcxx.map()
+        for i in range(20):
+            m[i] = ClearOnStr(m)
+        with self.assertRaises(RuntimeError):
+            m.dump(io.StringIO(), format='csv')
+
+        s = stdcxx.set()
+        for i in range(20):
+            s.add(ClearOnStr(s))
+        with self.assertRaises(RuntimeError):
+            s.dump(io.StringIO(), format='csv')
+
+
+if __name__ == '__main__':
+    unittest.main()
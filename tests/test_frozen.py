@@ -0,0 +1,49 @@
+import unittest
+
+import stdcxx
+
+
+class FrozenMapTest(unittest.TestCase):
+    def test_freeze(self):
+        m = stdcxx.map([(2, 'b'), (1, 'a')])
+        f = m.freeze()
+        m[3] = 'c'
+        self.assertEqual(list(f), [(1, 'a'), (2, 'b')])
+        self.assertEqual(len(f), 2)
+        self.assertEqual(f[1], 'a')
+        self.assertEqual(f.get(5, 'x'), 'x')
+        self.assertIn(2, f)
+        with self.assertRaises(KeyError):
+            f[5]
+        with self.assertRaises(TypeError):
+            f[5] = 1
+
+    def test_hash_and_equality(self):
+        a = stdcxx.frozen_map([(1, 'a'), (2, 'b')])
+        b = stdcxx.map([(2, 'b'), (1, 'a')]).freeze()
+        self.assertEqual(a, b)
+        self.assertEqual(hash(a), hash(b))
+        self.assertEqual(len({a, b}), 1)
+        self.assertNotEqual(a, stdcxx.frozen_map([(1, 'a')]))
+
+    def test_cmp(self):
+        f = stdcxx.frozen_map([(1, 1), (2, 2)], cmp=lambda a, b: b - a)
+        self.assertEqual([k for k, v in f], [2, 1])
+        self.assertEqual(f[1], 1)
+
+
+class FrozenSetTest(unittest.TestCase):
+    def test_freeze(self):
+        s = stdcxx.set([3, 1, 2])
+        f = s.freeze()
+        s.add(4)
+        self.assertEqual(list(f), [1, 2, 3])
+        self.assertIn(2, f)
+        self.assertNotIn(4, f)
+        self.assertEqual(f, stdcxx.frozen_set([2, 3, 1]))
+        self.assertEqual(hash(f), hash(stdcxx.frozen_set([1, 2, 3])))
+        self.assertEqual({f: 1}[stdcxx.frozen_set([3, 2, 1])], 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,43 @@
+import gc
+import unittest
+
+import stdcxx
+
+
+class Node:
+    pass
+
+
+class GCTrackingTest(unittest.TestCase):
+    def test_atomic_items_stay_untracked(self):
+        for c in (stdcxx.map([(i, str(i)) for i in range(20)]), stdcxx.set(list(range(20)))):
+            self.assertFalse(gc.is_tracked(c))
+
+    def test_tracked_once_holding_containers(self):
+        m = stdcxx.map([(1, 1)])
+        self.assertFalse(gc.is_tracked(m))
+        m[2] = []
+        self.assertTrue(gc.is_tracked(m))
+
+        s = stdcxx.set()
+        s.add((1, 2))
+        self.assertFalse(gc.is_tracked(s))
+        s.add((2, []))
+        self.assertTrue(gc.is_tracked(s))
+
+    def test_subclass_is_tracked(self):
+        class Sub(stdcxx.map):
+            pass
+        self.assertTrue(gc.is_tracked(Sub()))
+
+    def test_cycle_collected(self):
+        m = stdcxx.map()
+        n = Node()
+        n.map = m
+        m[1] = n
+        del m, n
+        self.assertGreater(gc.collect(), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,108 @@
+import gc
+import sys
+import tracemalloc
+import unittest
+
+import stdcxx
+
+
+def fresh(b):
+    return bytes(bytearray(b))
+
+
+class InternTest(unittest.TestCase):
+    def test_shared_bytes(self):
+        m = stdcxx.map(intern=True)
+        n = stdcxx.map(intern=True)
+        s = stdcxx.set(intern=True)
+        m[fresh(b'tenant-1')] = 1
+        n[fresh(b'tenant-1')] = 2
+        s.add(fresh(b'tenant-1'))
+        self.assertIs(list(m)[0][0], list(n)[0][0])
+        self.assertIs(list(m)[0][0], list(s)[0])
+
+    def test_shared_str(self):
+        s = stdcxx.set(intern=True)
+        m = stdcxx.map(intern=True)
+        s.add(''.join(['metric', '-1']))
+        m.setdefault(''.join(['metric', '-1']))
+        self.assertIs(list(s)[0], list(m)[0][0])
+
+    def test_not_interned(self):
+        m = stdcxx.map()
+        k = fresh(b'key')
+        m[k] = 1
+        self.assertIs(list(m)[0][0], k)
+
+        class sub(bytes):
+            pass
+
+        n = stdcxx.map(intern=True)
+        k = sub(b'key')
+        n[k] = 1
+        self.assertIs(list(n)[0][0], k)
+
+    def test_changelog_logs_interned_key(self):
+        a = stdcxx.map(intern=True)
+        a[fresh(b'k')] = 0
+        m = stdcxx.map(intern=True, changelog=4)
+        m[fresh(b'k')] = 1
+        m.setdefault(fresh(b'j'))
+        changes = m.changes_since(0)[1]
+        self.assertIs(changes[0][2], list(a)[0][0])
+        self.assertIs(changes[1][2], list(m)[0][0])
+
+    def test_unused_keys_are_dropped(self):
+        gc.collect()
+        tracemalloc.start()
+        try:
+            sizes = []
+            for round in range(6):
+                m = stdcxx.map(intern=True)
+                for i in range(5000):
+                    m[b'%d-%d' % (round, i)] = None
+                del m
+                gc.collect()
+                sizes.append(tracemalloc.get_traced_memory()[0])
+        finally:
+            tracemalloc.stop()
+
+        # Kept keys would add about 200KB every round
+        self.assertLess(sizes[-1] - sizes[1], 200 * 1024)
+
+    def test_unused_str_keys_are_dropped(self):
+        gc.collect()
+        tracemalloc.start()
+        try:
+            sizes = []
+            for round in range(6):
+                s = stdcxx.set(intern=True)
+                for i in range(5000):
+                    s.add('%d-%d' % (round, i))
+                del s
+                gc.collect()
+                sizes.append(tracemalloc.get_traced_memory()[0])
+        finally:
+            tracemalloc.stop()
+
+        self.assertLess(sizes[-1] - sizes[1], 200 * 1024)
+
+    def test_used_keys_are_kept(self):
+        m = stdcxx.map(intern=True)
+        m[fresh(b'kept')] = 1
+        k = list(m)[0][0]
+        refs = sys.getrefcount(k)
+        n = stdcxx.map(intern=True)
+        for i in range(5000):
+            n[b'%d' % i] = None
+        del n
+        n = stdcxx.map(intern=True)
+        for i in range(5000):
+            n[b'x%d' % i] = None
+        self.assertEqual(sys.getrefcount(k), refs)
+        n[fresh(b'kept')] = 2
+        self.assertIs(list(n.find(b'kept'))[0][0], k)
+
+
+if __name__ == '__main__':
+    unittest.main()
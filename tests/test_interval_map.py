@@ -0,0 +1,66 @@
+import unittest
+
+import stdcxx
+
+
+class IntervalMapTest(unittest.TestCase):
+    def test_assign_splits_and_coalesces(self):
+        m = stdcxx.interval_map()
+        m.assign(0, 10, 'a')
+        m.assign(5, 15, 'b')
+        self.assertEqual(list(m), [(0, 5, 'a'), (5, 15, 'b')])
+        m.assign(15, 20, 'b')
+        self.assertEqual(list(m), [(0, 5, 'a'), (5, 20, 'b')])
+        m.assign(2, 3, 'c')
+        self.assertEqual(list(m), [(0, 2, 'a'), (2, 3, 'c'), (3, 5, 'a'), (5, 20, 'b')])
+        self.assertEqual(len(m), 4)
+
+    def test_overlapping_assign_overwrites(self):
+        m = stdcxx.interval_map()
+        m.assign(0, 10, 'a')
+        m.assign(0, 10, 'b')
+        self.assertEqual(list(m), [(0, 10, 'b')])
+
+    def test_queries(self):
+        m = stdcxx.interval_map()
+        m.assign(0, 10, 'a')
+        m.assign(20, 30, 'b')
+        m.assign(30, 40, 'c')
+        self.assertEqual(m.containing(0), (0, 10, 'a'))
+        self.assertIsNone(m.containing(10))
+        self.assertIsNone(m.containing(-1))
+        self.assertEqual(m[25], 'b')
+        with self.assertRaises(KeyError):
+            m[15]
+        self.assertEqual(m.overlapping(5, 21), [(0, 10, 'a'), (20, 30, 'b')])
+        self.assertEqual(m.overlapping(10, 20), [])
+        self.assertEqual(m.overlapping(35, 100), [(30, 40, 'c')])
+
+    def test_overlapping_empty_range(self):
+        m = stdcxx.interval_map()
+        m.assign(0, 10, 'x')
+        self.assertEqual(m.overlapping(5, 3), [])
+        self.assertEqual(m.overlapping(5, 5), [])
+        self.assertEqual(m.overlapping(5, 6), [(0, 10, 'x')])
+
+    def test_erase(self):
+        m = stdcxx.interval_map()
+        m.assign(0, 10, 'a')
+        m.erase(2, 4)
+        self.assertEqual(list(m), [(0, 2, 'a'), (4, 10, 'a')])
+        m.clear()
+        self.assertEqual(len(m), 0)
+
+    def test_empty_interval(self):
+        m = stdcxx.interval_map()
+        with self.assertRaises(ValueError):
+            m.assign(5, 5, 'a')
+
+    def test_less(self):
+        m = stdcxx.interval_map(less=lambda a, b: a > b)
+        m.assign(10, 0, 'a')
+        self.assertEqual(m.containing(5), (10, 0, 'a'))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,37 @@
+import unittest
+
+import stdcxx
+
+
+class MergeTest(unittest.TestCase):
+    def setUp(self):
+        self.lhs = stdcxx.map([(1, 'a'), (2, 'b'), (3, 'c'), (5, 'e')])
+        self.rhs = stdcxx.map([(2, 'b'), (3, 'C'), (4, 'd'), (6, 'f')])
+
+    def test_diff(self):
+        added, removed, changed = self.lhs.diff(self.rhs)
+        self.assertEqual(added, [(4, 'd'), (6, 'f')])
+        self.assertEqual(removed, [(1, 'a'), (5, 'e')])
+        self.assertEqual(changed, [(3, 'c', 'C')])
+        self.assertEqual(self.lhs.diff(self.lhs), ([], [], []))
+
+    def test_join(self):
+        self.assertEqual(self.lhs.join(self.rhs), [(2, 'b', 'b'), (3, 'c', 'C')])
+        self.assertEqual(self.lhs.join(self.rhs, how='left'),
+                         [(1, 'a', None), (2, 'b', 'b'), (3, 'c', 'C'), (5, 'e', None)])
+        self.assertEqual(self.lhs.join(self.rhs, how='outer'),
+                         [(1, 'a', None), (2, 'b', 'b'), (3, 'c', 'C'), (4, None, 'd'),
+                          (5, 'e', None), (6, None, 'f')])
+        with self.assertRaises(ValueError):
+            self.lhs.join(self.rhs, how='cross')
+
+    def test_order_must_match(self):
+        other = stdcxx.map([(1, 1)], less=lambda a, b: a > b)
+        with self.assertRaises(ValueError):
+            self.lhs.diff(other)
+        with self.assertRaises(TypeError):
+            self.lhs.join({1: 1})
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,41 @@
+import importlib.util
+import os
+import unittest
+
+import stdcxx
+
+
+def load_again():
+    spec = importlib.util.spec_from_file_location('stdcxx', stdcxx.__file__)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+class ModuleTest(unittest.TestCase):
+    def test_types_per_module(self):
+        other = load_again()
+        self.assertIsNot(other.map, stdcxx.map)
+        m = other.map([(1, 2)])
+        self.assertEqual(list(m), [(1, 2)])
+        self.assertNotIsInstance(m, stdcxx.map)
+
+    def test_subinterpreter(self):
+        try:
+            import _xxsubinterpreters as interpreters
+        except ImportError:
+            self.skipTest('no subinterpreter support')
+
+        interp = interpreters.create()
+        try:
+            interpreters.run_string(interp, 'import sys; sys.path.insert(0, %r)\n'
+                                            'import stdcxx\n'
+                                            'm = stdcxx.map([(1, 1)])\n'
+                                            'assert list(m) == [(1, 1)]\n'
+                                            % os.path.dirname(stdcxx.__file__))
+        finally:
+            interpreters.destroy(interp)
+
+
+if __name__ == '__main__':
+    unittest.main()
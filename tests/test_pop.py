@@ -0,0 +1,70 @@
+import unittest
+
+import stdcxx
+
+
+class MapPopTest(unittest.TestCase):
+    def setUp(self):
+        self.m = stdcxx.map([(i, str(i)) for i in range(10)])
+
+    def test_pop_n(self):
+        self.assertEqual(self.m.pop_n(2), [(0, '0'), (1, '1')])
+        self.assertEqual(self.m.pop_n(2, last=True), [(9, '9'), (8, '8')])
+        self.assertEqual(self.m.pop_n(0), [])
+        self.assertEqual(len(self.m.pop_n(100)), 6)
+        self.assertEqual(len(self.m), 0)
+        with self.assertRaises(ValueError):
+            self.m.pop_n(-1)
+
+    def test_pop_range(self):
+        self.assertEqual(self.m.pop_range(3, 5), [(3, '3'), (4, '4')])
+        self.assertEqual(self.m.pop_range(8, 2), [])
+        self.assertEqual([k for k, v in self.m], [0, 1, 2, 5, 6, 7, 8, 9])
+
+    def test_pop_until(self):
+        self.assertEqual(self.m.pop_until(3), [(0, '0'), (1, '1'), (2, '2')])
+        self.assertEqual(self.m.pop_until(-1), [])
+        self.assertEqual(len(self.m), 7)
+
+    def test_pop_while(self):
+        self.assertEqual(self.m.pop_while(lambda item: item[0] < 2), [(0, '0'), (1, '1')])
+        self.assertEqual(self.m.pop_while(lambda item: False), [])
+        self.assertEqual(len(self.m.pop_while(lambda item: True)), 8)
+
+    def test_pop_while_change(self):
+        def predicate(item):
+            self.m[100] = 0
+            return True
+        with self.assertRaises(RuntimeError):
+            self.m.pop_while(predicate)
+
+    def test_pop_while_snapshot(self):
+        snapshots = []
+
+        def predicate(item):
+            if not snapshots:
+                snapshots.append(self.m.snapshot())
+            return item[0] < 5
+
+        self.assertEqual(len(self.m.pop_while(predicate)), 5)
+        self.assertEqual(len(snapshots[0]), 10)
+        self.assertEqual(len(self.m), 5)
+
+    def test_snapshot_is_read_only(self):
+        with self.assertRaises(TypeError):
+            self.m.snapshot().pop_n(1)
+
+
+class SetPopTest(unittest.TestCase):
+    def test_pop(self):
+        s = stdcxx.set(list(range(10)))
+        self.assertEqual(s.pop_n(2), [0, 1])
+        self.assertEqual(s.pop_n(1, last=True), [9])
+        self.assertEqual(s.pop_range(4, 6), [4, 5])
+        self.assertEqual(s.pop_until(3), [2])
+        self.assertEqual(s.pop_while(lambda item: item < 7), [3, 6])
+        self.assertEqual(list(s), [7, 8])
+
+
+if __name__ == '__main__':
+    unittest.main()
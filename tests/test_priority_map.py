@@ -0,0 +1,104 @@
+import gc
+import random
+import unittest
+
+import stdcxx
+
+
+class PriorityMapTest(unittest.TestCase):
+    def test_basic(self):
+        pm = stdcxx.priority_map()
+        for i, p in enumerate([5, 3, 9, 1, 7]):
+            pm.push('t%d' % i, p)
+        self.assertEqual(len(pm), 5)
+        self.assertIn('t3', pm)
+        self.assertEqual(pm['t2'], 9)
+        self.assertEqual(pm.peek(), ('t3', 1))
+        self.assertEqual(pm.peek(last=True), ('t2', 9))
+        pm.update('t2', 0)
+        self.assertEqual(pm.peek(), ('t2', 0))
+        self.assertEqual(pm.pop_min(), ('t2', 0))
+        self.assertEqual(pm.pop_max(), ('t4', 7))
+        self.assertEqual(list(pm), [('t3', 1), ('t1', 3), ('t0', 5)])
+        pm['t1'] = 10
+        pm['new'] = 2
+        del pm['t0']
+        self.assertEqual(list(pm), [('t3', 1), ('new', 2), ('t1', 10)])
+
+    def test_errors(self):
+        pm = stdcxx.priority_map((('a', 1),))
+        with self.assertRaises(ValueError):
+            pm.push('a', 4)
+        with self.assertRaises(KeyError):
+            pm.update('zz', 4)
+        with self.assertRaises(TypeError):
+            pm.push([1], 1)
+        self.assertEqual(len(pm), 1)
+        e = stdcxx.priority_map()
+        for pop in (e.pop_min, e.pop_max, e.peek):
+            with self.assertRaises(ValueError):
+                pop()
+
+    def test_ties_fifo(self):
+        q = stdcxx.priority_map((('a', 1), ('b', 1), ('c', 1)))
+        q.update('a', 1)
+        self.assertEqual([t for t, _ in q], ['b', 'c', 'a'])
+        self.assertEqual(q.peek(), ('b', 1))
+        self.assertEqual(q.peek(last=True), ('b', 1))
+        self.assertEqual(q.pop_max(), ('b', 1))
+        self.assertEqual(q.pop_max(), ('c', 1))
+        self.assertEqual(q.pop_min(), ('a', 1))
+
+        q = stdcxx.priority_map((('x', 2), ('y', 2), ('z', 1)))
+        self.assertEqual([q.pop_max()[0] for _ in range(3)], ['x', 'y', 'z'])
+
+    def test_iterator_invalidated(self):
+        q = stdcxx.priority_map((('a', 1), ('b', 2)))
+        it = iter(q)
+        next(it)
+        q.update('b', 5)
+        with self.assertRaises(RuntimeError):
+            next(it)
+
+    def test_comparators(self):
+        r = stdcxx.priority_map(cmp=lambda a, b: b - a)
+        r.push(1, 1)
+        r.push(2, 2)
+        self.assertEqual(r.pop_min(), (2, 2))
+        r = stdcxx.priority_map(less=lambda a, b: a > b)
+        r.push(1, 1)
+        r.push(2, 2)
+        self.assertEqual(r.pop_min(), (2, 2))
+
+    def test_cycle(self):
+        class T:
+            pass
+
+        t = T()
+        t.pm = stdcxx.priority_map()
+        t.pm.push(t, 1)
+        del t
+        gc.collect()
+
+    def test_random(self):
+        rnd = random.Random(1)
+        ref = {}
+        pm = stdcxx.priority_map()
+        for _ in range(5000):
+            k = rnd.randrange(200)
+            p = rnd.randrange(50)
+            pm[k] = p
+            ref[k] = p
+            if rnd.random() < 0.2:
+                task, prio = pm.pop_min()
+                self.assertEqual(ref.pop(task), prio)
+                self.assertLessEqual(prio, min(ref.values(), default=prio))
+            elif rnd.random() < 0.2:
+                task, prio = pm.pop_max()
+                self.assertEqual(ref.pop(task), prio)
+                self.assertGreaterEqual(prio, max(ref.values(), default=prio))
+        self.assertEqual(sorted(ref.items()), sorted(pm))
+
+
+if __name__ == '__main__':
+    unittest.main()
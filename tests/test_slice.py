@@ -0,0 +1,48 @@
+import unittest
+
+import stdcxx
+
+
+class MapSliceTest(unittest.TestCase):
+    def setUp(self):
+        self.m = stdcxx.map([(i, str(i)) for i in range(10)])
+
+    def test_range(self):
+        view = self.m[3:6]
+        self.assertEqual(list(view), [(3, '3'), (4, '4'), (5, '5')])
+        self.assertEqual(len(view), 3)
+        self.assertIn(4, view)
+        self.assertNotIn(6, view)
+        self.assertEqual(view[4], '4')
+        with self.assertRaises(KeyError):
+            view[7]
+
+    def test_open_bounds_and_reverse(self):
+        self.assertEqual([k for k, v in self.m[:2]], [0, 1])
+        self.assertEqual([k for k, v in self.m[8:]], [8, 9])
+        self.assertEqual([k for k, v in self.m[2:5:-1]], [4, 3, 2])
+        self.assertEqual(list(self.m[5:2]), [])
+
+    def test_narrow(self):
+        self.assertEqual([k for k, v in self.m[2:8][4:20]], [4, 5, 6, 7])
+
+    def test_view_is_lazy(self):
+        view = self.m[3:6]
+        del self.m[4]
+        self.m[3.5] = 'x'
+        self.assertEqual([k for k, v in view], [3, 3.5, 5])
+
+
+class SetSliceTest(unittest.TestCase):
+    def test_range(self):
+        s = stdcxx.set(list(range(10)))
+        self.assertEqual(list(s[3:6]), [3, 4, 5])
+        self.assertEqual(list(s[3:6:-1]), [5, 4, 3])
+        self.assertEqual(len(s[:4]), 4)
+        self.assertIn(8, s[7:])
+        s.remove(8)
+        self.assertEqual(list(s[7:]), [7, 9])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,105 @@
+import gc
+import random
+import tracemalloc
+import unittest
+
+import stdcxx
+
+
+class SmallTreeTest(unittest.TestCase):
+    def check(self, m, d):
+        self.assertEqual(list(m), sorted(d.items()))
+        self.assertEqual(list(m.reverse()), sorted(d.items(), reverse=True))
+        self.assertEqual(len(m), len(d))
+        for k in range(-1, 21):
+            self.assertEqual(k in m, k in d)
+
+    def test_promote_and_demote(self):
+        m = stdcxx.map()
+        d = {}
+        # Grow past the inline capacity of 8, then shrink below 4 and back
+        for k in range(12):
+            m[k] = k
+            d[k] = k
+            self.check(m, d)
+        for k in range(11, 1, -1):
+            del m[k]
+            del d[k]
+            self.check(m, d)
+        for k in range(2, 10):
+            m[k] = -k
+            d[k] = -k
+            self.check(m, d)
+
+    def test_iterator_across_promotion(self):
+        m = stdcxx.map([(k, k) for k in range(8)])
+        it = iter(m)
+        next(it)
+        m[8] = 8
+        with self.assertRaises(RuntimeError):
+            next(it)
+
+    def test_snapshot_across_promotion(self):
+        m = stdcxx.map([(k, k) for k in range(8)])
+        s = m.snapshot()
+        m[8] = 8
+        for k in range(6):
+            del m[k]
+        self.assertEqual(list(s), [(k, k) for k in range(8)])
+        self.assertEqual(list(m), [(k, k) for k in range(6, 9)])
+
+    def test_small_map_is_one_object(self):
+        items = ((1, 1), (2, 2), (3, 3))
+        maps = [None] * 1000
+        gc.collect()
+        tracemalloc.start()
+        try:
+            before = tracemalloc.get_traced_memory()[0]
+            for i in range(len(maps)):
+                maps[i] = stdcxx.map(items)
+            size = (tracemalloc.get_traced_memory()[0] - before) / len(maps)
+        finally:
+            tracemalloc.stop()
+
+        # Items are kept in the map object, a second object holding them
+        # would cost more than the GC header on top of the map
+        self.assertLessEqual(size, type(maps[0]).__basicsize__ + 32)
+
+    def test_random(self):
+        rnd = random.Random(1)
+        for trial in range(200):
+            m = stdcxx.map()
+            d = {}
+            s = stdcxx.set()
+            t = set()
+            for step in range(60):
+                op = rnd.random()
+                k = rnd.randrange(20)
+                if op < 0.5:
+                    m[k] = step
+                    d[k] = step
+                    s.add(k)
+                    t.add(k)
+                elif op < 0.75:
+                    if k in d:
+                        del m[k]
+                        del d[k]
+                    if k in t:
+                        s.remove(k)
+                        t.discard(k)
+                elif op < 0.85 and d:
+                    key, value = m.popitem(last=rnd.random() < 0.5)
+                    self.assertEqual(d.pop(key), value)
+                else:
+                    lo, hi = sorted([rnd.randrange(20), rnd.randrange(20)])
+                    expected = sorted((a, b) for a, b in d.items() if lo <= a < hi)
+                    self.assertEqual(m.pop_range(lo, hi), expected)
+                    for a, _ in expected:
+                        del d[a]
+                self.assertEqual(list(m), sorted(d.items()))
+                self.assertEqual(list(s), sorted(t))
+                self.assertEqual(list(m[3:12]), [(a, b) for a, b in sorted(d.items()) if 3 <= a < 12])
+
+
+if __name__ == '__main__':
+    unittest.main()
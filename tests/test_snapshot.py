@@ -0,0 +1,96 @@
+import gc
+import unittest
+import weakref
+
+import stdcxx
+
+
+class Node:
+    pass
+
+
+class SnapshotTest(unittest.TestCase):
+    def test_isolated_from_writes(self):
+        m = stdcxx.map([(i, i) for i in range(10)])
+        s = m.snapshot()
+        m[3] = 'x'
+        del m[4]
+        m[20] = 20
+        self.assertEqual(list(s), [(i, i) for i in range(10)])
+        self.assertEqual(m[3], 'x')
+        self.assertNotIn(4, m)
+        m.clear()
+        self.assertEqual(len(s), 10)
+
+    def test_many_snapshots_of_big_tree(self):
+        m = stdcxx.map([(i, i) for i in range(100)])
+        d = dict(m)
+        snapshots = []
+        for i in range(300):
+            if i % 7 == 0:
+                snapshots.append((m.snapshot(), sorted(d.items())))
+            key = (i * 37) % 150
+            if i % 3 == 0 and key in d:
+                del m[key]
+                del d[key]
+            else:
+                m[key] = i
+                d[key] = i
+        self.assertEqual(list(m), sorted(d.items()))
+        for s, items in snapshots:
+            self.assertEqual(list(s), items)
+
+    def test_read_only(self):
+        s = stdcxx.map([(1, 1)]).snapshot()
+        with self.assertRaises(TypeError):
+            s[2] = 2
+        with self.assertRaises(TypeError):
+            s.clear()
+
+    def test_iterator_survives_write(self):
+        m = stdcxx.map([(i, i) for i in range(10)])
+        s = m.snapshot()
+        it = iter(s)
+        next(it)
+        m[100] = 100
+        self.assertEqual(len(list(it)), 9)
+
+    def test_overwrite_on_shared_path_invalidates_iterators(self):
+        m = stdcxx.map([(i, i) for i in range(2000)])
+        s = m.snapshot()
+        m[0] = 'a'
+        it = iter(m)
+        for _ in range(1000):
+            next(it)
+        m[1000] = 'changed'
+        del s
+        gc.collect()
+        m += [(5, None)]
+        with self.assertRaises(RuntimeError):
+            next(it)
+        self.assertEqual(m[1000], 'changed')
+        self.assertEqual(m[5], 5)
+
+    def test_cycle_through_shared_tree(self):
+        def make():
+            m = stdcxx.map()
+            n = Node()
+            m[1] = n
+            n.map = m
+            n.snapshot = m.snapshot()
+            return weakref.ref(n)
+
+        ref = make()
+        gc.collect()
+        self.assertIsNone(ref())
+
+    def test_reachable_items_kept(self):
+        m = stdcxx.map([(i, Node()) for i in range(20)])
+        s = m.snapshot()
+        del m
+        gc.collect()
+        self.assertTrue(all(isinstance(v, Node) for k, v in s))
+
+
+if __name__ == '__main__':
+    unittest.main()
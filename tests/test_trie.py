@@ -0,0 +1,101 @@
+import gc
+import random
+import unittest
+
+import stdcxx
+
+
+class TrieMapTest(unittest.TestCase):
+    words = ['app', 'apple', 'application', 'apt', 'banana', 'band', 'ban', 'b', '', 'ünï', 'üb', 'zzz']
+
+    def test_order_and_prefix(self):
+        t = stdcxx.trie_map(tuple((w, i) for i, w in enumerate(self.words)))
+        self.assertEqual(len(t), len(self.words))
+        self.assertEqual([k for k, v in t], sorted(self.words))
+        self.assertEqual([k for k, v in t.prefix_items('ap')], ['app', 'apple', 'application', 'apt'])
+        self.assertEqual([k for k, v in t.prefix_items('appl')], ['apple', 'application'])
+        self.assertEqual(t.prefix_items('apx'), [])
+        self.assertEqual(t.prefix_items(b'ap'), [])
+        self.assertEqual(len(t.prefix_items('')), len(self.words))
+
+    def test_longest_prefix(self):
+        t = stdcxx.trie_map(tuple((w, i) for i, w in enumerate(self.words)))
+        self.assertEqual(t.longest_prefix('applesauce'), ('apple', 1))
+        self.assertEqual(t.longest_prefix('x'), ('', 8))
+        del t['']
+        self.assertIsNone(t.longest_prefix('x'))
+        self.assertEqual(t.longest_prefix('bandana'), ('band', 5))
+
+    def test_access(self):
+        t = stdcxx.trie_map((('app', 1), ('apt', 3)))
+        self.assertEqual(t['apt'], 3)
+        self.assertIsNone(t.get('ap'))
+        self.assertNotIn('ap', t)
+        self.assertIn('app', t)
+        with self.assertRaises(KeyError):
+            t['nope']
+        with self.assertRaises(TypeError):
+            t[b'x'] = 1
+        with self.assertRaises(TypeError):
+            t[1] = 1
+        t.clear()
+        t[b'x'] = 1
+        self.assertEqual(list(t), [(b'x', 1)])
+
+    def test_random(self):
+        rnd = random.Random(1)
+        ref = {}
+        tm = stdcxx.trie_map()
+        for i in range(5000):
+            k = ''.join(rnd.choice('ab\xe9c') for _ in range(rnd.randrange(0, 6)))
+            if rnd.random() < 0.4 and k in ref:
+                del tm[k]
+                del ref[k]
+            else:
+                tm[k] = i
+                ref[k] = i
+            if i % 500 == 0:
+                self.assertEqual(list(tm), sorted(ref.items()))
+                p = k[:2]
+                self.assertEqual([x for x, _ in tm.prefix_items(p)], sorted(x for x in ref if x.startswith(p)))
+                lp = max((x for x in ref if k.startswith(x)), key=len, default=None)
+                r = tm.longest_prefix(k)
+                self.assertEqual(r[0] if r else None, lp)
+        self.assertEqual(len(tm), len(ref))
+
+    def test_iterator_invalidated(self):
+        tm = stdcxx.trie_map((('a', 1), ('b', 2)))
+        it = iter(tm)
+        next(it)
+        tm['new-key'] = 1
+        with self.assertRaises(RuntimeError):
+            next(it)
+
+    def test_cycle(self):
+        m = stdcxx.trie_map()
+        m['self'] = m
+        del m
+        gc.collect()
+
+
+class TrieSetTest(unittest.TestCase):
+    def test_set(self):
+        s = stdcxx.trie_set(('/usr/bin', '/usr', '/usr/lib', '/etc'))
+        self.assertEqual(list(s), ['/etc', '/usr', '/usr/bin', '/usr/lib'])
+        self.assertEqual(s.prefix_items('/usr/'), ['/usr/bin', '/usr/lib'])
+        self.assertEqual(s.longest_prefix('/usr/bin/python'), '/usr/bin')
+        s.remove('/usr')
+        s.discard('/none')
+        self.assertNotIn('/usr', s)
+        self.assertEqual(len(s), 3)
+        with self.assertRaises(KeyError):
+            s.remove('/usr')
+
+    def test_deep(self):
+        deep = stdcxx.trie_set(tuple('a' * i for i in range(1, 3000)))
+        self.assertEqual(len(deep), 2999)
+        self.assertEqual(deep.longest_prefix('a' * 5000), 'a' * 2999)
+
+
+if __name__ == '__main__':
+    unittest.main()
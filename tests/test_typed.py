@@ -0,0 +1,97 @@
+import gc
+import unittest
+
+import stdcxx
+
+
+class TypedMapTest(unittest.TestCase):
+    def test_map_i64_f64(self):
+        m = stdcxx.map_i64_f64(((3, 1.5), (1, 2)))
+        m[2] = 7
+        self.assertEqual(list(m), [(1, 2.0), (2, 7.0), (3, 1.5)])
+        self.assertEqual(len(m), 3)
+        self.assertIn(2, m)
+        self.assertNotIn(9, m)
+        self.assertEqual(m.get(9, 'd'), 'd')
+        self.assertEqual(list(m.reverse()), [(3, 1.5), (2, 7.0), (1, 2.0)])
+        self.assertEqual(m.pop(1), 2.0)
+        self.assertEqual(m.popitem(last=True), (3, 1.5))
+        self.assertEqual(list(m), [(2, 7.0)])
+        del m[2]
+        with self.assertRaises(KeyError):
+            m[2]
+
+    def test_conversion_errors(self):
+        m = stdcxx.map_i64_f64()
+        with self.assertRaises(TypeError):
+            m['x'] = 1
+        with self.assertRaises(TypeError):
+            m[1] = 'x'
+        with self.assertRaises(OverflowError):
+            m[2 ** 70] = 1
+        with self.assertRaises(ValueError):
+            stdcxx.map_f64_f64()[float('nan')] = 1
+        self.assertEqual(len(m), 0)
+
+    def test_map_i64_i64(self):
+        m = stdcxx.map_i64_i64([(i, -i) for i in range(10)])
+        self.assertEqual(m[4], -4)
+        self.assertFalse(gc.is_tracked(m))
+
+    def test_map_i64_obj(self):
+        m = stdcxx.map_i64_obj()
+        m[1] = m
+        m[2] = [1]
+        self.assertEqual(len(m), 2)
+        self.assertTrue(gc.is_tracked(m))
+        del m
+        gc.collect()
+
+    def test_subclass(self):
+        class Sub(stdcxx.map_i64_i64):
+            pass
+
+        x = Sub()
+        x.attr = x
+        x[1] = 2
+        self.assertEqual(x[1], 2)
+        self.assertTrue(gc.is_tracked(x))
+
+    def test_iterator_invalidated(self):
+        m = stdcxx.map_i64_i64(((1, 1), (2, 2)))
+        it = iter(m)
+        m[3] = 3
+        with self.assertRaises(RuntimeError):
+            next(it)
+
+
+class TypedSetTest(unittest.TestCase):
+    def test_set_i64(self):
+        s = stdcxx.set_i64((5, 3, 9, 3))
+        self.assertEqual(list(s), [3, 5, 9])
+        self.assertTrue(s.add(1))
+        self.assertFalse(s.add(1))
+        self.assertTrue(s.remove(9))
+        self.assertEqual(list(s), [1, 3, 5])
+        self.assertIn(3, s)
+        self.assertEqual(s.popitem(), 1)
+        self.assertEqual(list(s.reverse()), [5, 3])
+        with self.assertRaises(TypeError):
+            s.add('x')
+
+    def test_set_f64(self):
+        s = stdcxx.set_f64((2.5, 1, -0.5))
+        self.assertEqual(list(s), [-0.5, 1.0, 2.5])
+        with self.assertRaises(ValueError):
+            s.add(float('nan'))
+
+    def test_iterator_invalidated(self):
+        s = stdcxx.set_i64((1, 2))
+        it = iter(s)
+        s.add(100)
+        with self.assertRaises(RuntimeError):
+            next(it)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,118 @@
+import random
+import threading
+import unittest
+
+import stdcxx
+
+
+class ReductionTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        rnd = random.Random(5)
+        items = [(rnd.randrange(-10 ** 12, 10 ** 12), rnd.randrange(-1000, 1000)) for _ in range(50000)]
+        cls.m = stdcxx.map_i64_i64(items)
+        cls.d = dict(items)
+        cls.keys = sorted(cls.d)
+
+    def test_sum_values(self):
+        m, d, ks = self.m, self.d, self.keys
+        self.assertEqual(m.sum_values(), sum(d.values()))
+        rnd = random.Random(1)
+        for _ in range(10):
+            lo, hi = sorted(rnd.sample(ks, 2))
+            self.assertEqual(m.sum_values(lo, hi), sum(d[k] for k in ks if lo <= k < hi))
+            self.assertEqual(m.sum_values(lo=lo), sum(d[k] for k in ks if k >= lo))
+            self.assertEqual(m.sum_values(hi=hi), sum(d[k] for k in ks if k < hi))
+        self.assertEqual(m.sum_values(5, 5), 0)
+        self.assertEqual(m.sum_values(10, 5), 0)
+
+    def test_histogram(self):
+        edges = [-1000, -500, 0, 3, 999]
+        expected = [0] * 4
+        for v in self.d.values():
+            for i in range(4):
+                if edges[i] <= v < edges[i + 1] or (i == 3 and v == edges[4]):
+                    expected[i] += 1
+                    break
+        self.assertEqual(self.m.histogram(edges), expected)
+        for bad in ([1], [2, 1], [1, 1]):
+            with self.assertRaises(ValueError):
+                self.m.histogram(bad)
+
+    def test_count_if(self):
+        ops = {'<': lambda v: v < 7, '<=': lambda v: v <= 7, '>': lambda v: v > 7,
+               '>=': lambda v: v >= 7, '==': lambda v: v == 7, '!=': lambda v: v != 7}
+        for op, f in ops.items():
+            self.assertEqual(self.m.count_if(op, 7), sum(1 for v in self.d.values() if f(v)), op)
+        with self.assertRaises(ValueError):
+            self.m.count_if('~', 1)
+
+    def test_errors(self):
+        with self.assertRaises(TypeError):
+            stdcxx.map_i64_obj([(1, 'a')]).sum_values()
+        with self.assertRaises(OverflowError):
+            stdcxx.map_i64_i64([(i, 2 ** 62) for i in range(4)]).sum_values()
+        e = stdcxx.map_i64_i64([(-2 ** 63, 1), (2 ** 63 - 1, 2)] + [(i, 1) for i in range(100)])
+        self.assertEqual(e.sum_values(), 103)
+
+    def test_float(self):
+        f = stdcxx.map_f64_f64([(i * 0.5, 1.0) for i in range(1000)])
+        self.assertEqual(f.sum_values(), 1000.0)
+        self.assertEqual(f.count_if('>=', 1.0), 1000)
+        self.assertEqual(sum(f.histogram([0.0, 1.0, 2.0])), 1000)
+        fi = stdcxx.map_i64_f64([(i, 0.5) for i in range(1000)])
+        self.assertEqual(fi.sum_values(0, 100), 50.0)
+
+    def test_write_during_scan(self):
+        m = stdcxx.map_i64_i64([(i, 1) for i in range(200000)])
+        blocked = []
+
+        def writer():
+            for i in range(200):
+                try:
+                    m[-1 - i] = 0
+                except RuntimeError:
+                    blocked.append(i)
+
+        t = threading.Thread(target=writer)
+        t.start()
+        for _ in range(20):
+            self.assertEqual(m.sum_values(), 200000)
+        t.join()
+        self.assertEqual(len(m), 200200 - len(blocked))
+
+    def test_unbox_starts_scan(self):
+        m = stdcxx.map_i64_i64([(i, 1) for i in range(200000)])
+        results = []
+
+        class Key:
+            # Let a scan start while the key is being unboxed
+            def __index__(self):
+                started = threading.Event()
+
+                def scan():
+                    started.set()
+                    results.append(m.sum_values())
+
+                self.thread = threading.Thread(target=scan)
+                self.thread.start()
+                started.wait()
+                return -1
+
+        writes = [lambda key: m.__setitem__(key, 5), m.pop, m.__delitem__]
+        for i in range(5):
+            for write in writes:
+                key = Key()
+                try:
+                    write(key)
+                except (RuntimeError, KeyError):
+                    pass
+                key.thread.join()
+            m.pop(-1, None)
+        self.assertEqual(len(results), 15)
+        for total in results:
+            self.assertIn(total, (200000, 200005))
+
+
+if __name__ == '__main__':
+    unittest.main()
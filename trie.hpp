@@ -0,0 +1,293 @@
+#ifndef PYSTDCXX_TRIE_HPP
+#define PYSTDCXX_TRIE_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils.hpp"
+
+// Kind of keys held by a trie, str and bytes keys can't be mixed as they
+// have no order between them.
+enum trie_key_kind
+{
+    trie_key_none,
+    trie_key_str,
+    trie_key_bytes,
+};
+
+// Bytes of a str or bytes key. str is taken as UTF-8, whose byte order is
+// the order of code points, so the trie iterates keys in Python order.
+static inline bool trie_key_data(PyObject *key, const char *&data, size_t &size, trie_key_kind &kind)
+{
+    if (PyUnicode_Check(key)) {
+        Py_ssize_t n;
+        data = PyUnicode_AsUTF8AndSize(key, &n);
+        if (!data)
+            return false;
+
+        size = n;
+        kind = trie_key_str;
+        return true;
+    }
+
+    if (PyBytes_Check(key)) {
+        data = PyBytes_AS_STRING(key);
+        size = PyBytes_GET_SIZE(key);
+        kind = trie_key_bytes;
+        return true;
+    }
+
+    PyErr_SetString(PyExc_TypeError, "Require str or bytes key");
+    return false;
+}
+
+// Radix tree of byte strings. Every node holds the bytes of the edge from
+// its parent, so a prefix shared by many keys is stored once, and a node
+// other than the root either ends a key or branches. Children are sorted
+// by their first byte, a preorder walk visits keys in ascending order.
+//
+// Nothing here calls into Python. Erased keys and values are handed back
+// to the caller, to be released after the tree is consistent again.
+class trie_tree
+{
+public:
+    struct node
+    {
+        std::string label;                              // Bytes of the edge from parent
+        std::vector<std::unique_ptr<node>> children;    // Sorted by first byte of label
+        py_ptr<PyObject> key;                           // Key ending here, null if none
+        py_ptr<PyObject> value;
+    };
+
+    trie_tree(): root_(new node), size_(0) {}
+    trie_tree(const trie_tree &) = delete;
+    trie_tree &operator=(const trie_tree &) = delete;
+
+    ~trie_tree()
+    {
+        destroy(root_.get());
+    }
+
+    size_t size() const { return size_; }
+    node *root() const { return root_.get(); }
+
+    // Node of key s, or nullptr if s isn't a key
+    node *find(const char *s, size_t n) const
+    {
+        node *cur = root_.get();
+        size_t i = 0;
+        while (i < n) {
+            node *child = find_child(cur, s[i]);
+            if (!child || !starts_with(s + i, n - i, child->label))
+                return nullptr;
+
+            i += child->label.size();
+            cur = child;
+        }
+
+        return cur->key.get() ? cur : nullptr;
+    }
+
+    // Node of key s, created if it doesn't exist. Its key is null if s
+    // wasn't a key, the caller fills it and calls added().
+    node *insert(const char *s, size_t n)
+    {
+        node *cur = root_.get();
+        size_t i = 0;
+        while (i < n) {
+            std::vector<std::unique_ptr<node>>::iterator pos = lower_child(cur, s[i]);
+            if (pos == cur->children.end() || (*pos)->label[0] != s[i]) {
+                std::unique_ptr<node> leaf(new node);
+                leaf->label.assign(s + i, n - i);
+                return cur->children.insert(pos, std::move(leaf))->get();
+            }
+
+            node *child = pos->get();
+            size_t common = common_length(s + i, n - i, child->label);
+            if (common < child->label.size()) {
+                // Split the edge where s leaves it
+                std::unique_ptr<node> mid(new node);
+                mid->label.assign(child->label, 0, common);
+                mid->children.reserve(2);
+                child->label.erase(0, common);
+                mid->children.push_back(std::move(*pos));
+                *pos = std::move(mid);
+                child = pos->get();
+            }
+
+            i += common;
+            cur = child;
+        }
+
+        return cur;
+    }
+
+    void added() { ++size_; }
+
+    // Remove key s, moving its key and value out. Returns false if s
+    // isn't a key.
+    bool erase(const char *s, size_t n, py_ptr<PyObject> &key, py_ptr<PyObject> &value)
+    {
+        std::vector<node *> path(1, root_.get());
+        size_t i = 0;
+        while (i < n) {
+            node *child = find_child(path.back(), s[i]);
+            if (!child || !starts_with(s + i, n - i, child->label))
+                return false;
+
+            i += child->label.size();
+            path.push_back(child);
+        }
+
+        node *target = path.back();
+        if (!target->key.get())
+            return false;
+
+        key = py_ptr<PyObject>(target->key.release());
+        value = py_ptr<PyObject>(target->value.release());
+        --size_;
+
+        // Drop a leaf, then merge whichever node is left with a single
+        // child and no key into that child
+        if (path.size() > 1 && target->children.empty()) {
+            node *parent = path[path.size() - 2];
+            parent->children.erase(lower_child(parent, target->label[0]));
+            path.pop_back();
+            target = parent;
+        }
+
+        if (path.size() > 1 && !target->key.get() && target->children.size() == 1)
+            merge(target);
+
+        return true;
+    }
+
+    // Topmost node whose path starts with prefix s, every key below it
+    // starts with s. Returns nullptr if no key does.
+    node *find_prefix(const char *s, size_t n) const
+    {
+        node *cur = root_.get();
+        size_t i = 0;
+        while (i < n) {
+            node *child = find_child(cur, s[i]);
+            if (!child)
+                return nullptr;
+
+            size_t common = common_length(s + i, n - i, child->label);
+            if (common < child->label.size() && i + common < n)
+                return nullptr;
+
+            i += common;
+            cur = child;
+        }
+
+        return cur;
+    }
+
+    // Node of the longest key which is a prefix of s, or nullptr
+    node *longest_prefix(const char *s, size_t n) const
+    {
+        node *cur = root_.get();
+        node *found = cur->key.get() ? cur : nullptr;
+        size_t i = 0;
+        while (i < n) {
+            node *child = find_child(cur, s[i]);
+            if (!child || !starts_with(s + i, n - i, child->label))
+                break;
+
+            i += child->label.size();
+            cur = child;
+            if (cur->key.get())
+                found = cur;
+        }
+
+        return found;
+    }
+
+    // Call f(node) for every key below and including n in ascending order
+    template<typename F>
+    static void for_each(node *n, F f)
+    {
+        std::vector<node *> stack(1, n);
+        while (!stack.empty()) {
+            node *cur = stack.back();
+            stack.pop_back();
+            for (size_t i = cur->children.size(); i > 0; --i)
+                stack.push_back(cur->children[i - 1].get());
+
+            if (cur->key.get())
+                f(cur);
+        }
+    }
+
+    // Swap content with rhs, so items are released after the swap
+    void swap(trie_tree &rhs)
+    {
+        root_.swap(rhs.root_);
+        std::swap(size_, rhs.size_);
+    }
+
+private:
+    static std::vector<std::unique_ptr<node>>::iterator lower_child(node *parent, char c)
+    {
+        return std::lower_bound(parent->children.begin(), parent->children.end(), c,
+                                [] (const std::unique_ptr<node> &child, char c) {
+                                    return static_cast<unsigned char>(child->label[0]) < static_cast<unsigned char>(c);
+                                });
+    }
+
+    static node *find_child(node *parent, char c)
+    {
+        std::vector<std::unique_ptr<node>>::iterator pos = lower_child(parent, c);
+        return pos != parent->children.end() && (*pos)->label[0] == c ? pos->get() : nullptr;
+    }
+
+    static size_t common_length(const char *s, size_t n, const std::string &label)
+    {
+        size_t i = 0, limit = std::min(n, label.size());
+        while (i < limit && s[i] == label[i])
+            ++i;
+        return i;
+    }
+
+    static bool starts_with(const char *s, size_t n, const std::string &label)
+    {
+        return n >= label.size() && std::equal(label.begin(), label.end(), s);
+    }
+
+    // Absorb the only child of n
+    static void merge(node *n)
+    {
+        std::unique_ptr<node> child(std::move(n->children.front()));
+        n->label += child->label;
+        n->key = py_ptr<PyObject>(child->key.release());
+        n->value = py_ptr<PyObject>(child->value.release());
+        n->children.swap(child->children);
+    }
+
+    // Free nodes without recursion, keys may be long enough to make the
+    // tree too deep for the stack
+    static void destroy(node *n)
+    {
+        std::vector<std::unique_ptr<node>> pending;
+        for (std::unique_ptr<node> &child: n->children)
+            pending.push_back(std::move(child));
+        n->children.clear();
+
+        while (!pending.empty()) {
+            std::unique_ptr<node> cur(std::move(pending.back()));
+            pending.pop_back();
+            for (std::unique_ptr<node> &child: cur->children)
+                pending.push_back(std::move(child));
+            cur->children.clear();
+        }
+    }
+
+    std::unique_ptr<node> root_;
+    size_t size_;
+};
+
+#endif // PYSTDCXX_TRIE_HPP
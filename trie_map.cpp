@@ -0,0 +1,323 @@
+#include "trie_map.hpp"
+
+PyMethodDef *pystdcxx_trie_map::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "get",          (PyCFunction)pystdcxx_trie_map::get,      METH_VARARGS, "Return value of key, or default if key doesn't exist" },
+        { "clear",        (PyCFunction)pystdcxx_trie_map::clear,    METH_NOARGS,  "Clear all items" },
+        { "prefix_items", (PyCFunction)pystdcxx_trie_map::prefix_items, METH_O,   "Return list of items whose key starts with prefix in order of key" },
+        { "longest_prefix", (PyCFunction)pystdcxx_trie_map::longest_prefix, METH_O, "Return the item of the longest key which is a prefix of key, or None" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_trie_map::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) pystdcxx_trie_map());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create trie map object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_trie_map::tp_init(pystdcxx_trie_map *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr;
+    static const char *kwlist[] = { "tuple", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &tuple))
+        return -1;
+
+    if (!tuple)
+        return 0;
+
+    if (!py_tuple_check(tuple)) {
+        PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+        return -1;
+    }
+
+    try {
+        py_tuple_for_each(tuple, [self] (PyObject *item) {
+            PyObject *key = py_tuple_get_item(item, 0);
+            PyObject *value = py_tuple_get_item(item, 1);
+            if (!key || !value)
+                throw std::runtime_error("Invalid key/value pair");
+            if (!self->insert(key, value))
+                throw std::runtime_error("Insert key/value error");
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+int pystdcxx_trie_map::tp_traverse(pystdcxx_trie_map *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    int result = 0;
+    trie_tree::for_each(self->trie.root(), [&] (trie_tree::node *n) {
+        if (!result && n->value.get())
+            result = visit(n->value.get(), arg);
+    });
+
+    return result;
+}
+
+int pystdcxx_trie_map::tp_clear(pystdcxx_trie_map *self)
+{
+    trie_tree trie;
+    trie.swap(self->trie);
+    self->kind = trie_key_none;
+    ++self->version;
+    return 0;
+}
+
+PyObject *pystdcxx_trie_map::tp_repr(pystdcxx_trie_map *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        trie_tree::for_each(self->trie.root(), [&] (trie_tree::node *n) {
+            repr += comma;
+            repr += "(";
+            repr += py_repr(n->key.get());
+            repr += ", ";
+            repr += py_repr(n->value.get());
+            repr += ")";
+            comma = ", ";
+        });
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_trie_map::tp_iter(pystdcxx_trie_map *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_trie_map::sq_length(pystdcxx_trie_map *self)
+{
+    return self->trie.size();
+}
+
+int pystdcxx_trie_map::sq_contains(pystdcxx_trie_map *self, PyObject *key)
+{
+    if (self->find(key))
+        return 1;
+
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+Py_ssize_t pystdcxx_trie_map::mp_length(pystdcxx_trie_map *self)
+{
+    return self->trie.size();
+}
+
+PyObject *pystdcxx_trie_map::mp_subscript(pystdcxx_trie_map *self, PyObject *key)
+{
+    trie_tree::node *n = self->find(key);
+    if (!n) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_KeyError, "Key error");
+        return nullptr;
+    }
+
+    PyObject *value = n->value.get();
+    Py_INCREF(value);
+    return value;
+}
+
+int pystdcxx_trie_map::mp_ass_subscript(pystdcxx_trie_map *self, PyObject *key, PyObject *value)
+{
+    if (value)
+        return self->insert(key, value) ? 0 : -1;
+
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k))
+        return -1;
+
+    // Erased key and value are released when leaving the scope
+    py_ptr<PyObject> erased_key, erased_value;
+    if (k != self->kind || !self->trie.erase(data, size, erased_key, erased_value)) {
+        PyErr_SetString(PyExc_KeyError, "Key error");
+        return -1;
+    }
+
+    if (!self->trie.size())
+        self->kind = trie_key_none;
+    ++self->version;
+    return 0;
+}
+
+// Node of key, or nullptr if it doesn't exist or isn't a str/bytes key,
+// only the latter sets an error.
+trie_tree::node *pystdcxx_trie_map::find(PyObject *key)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k) || k != kind)
+        return nullptr;
+
+    return trie.find(data, size);
+}
+
+bool pystdcxx_trie_map::insert(PyObject *key, PyObject *value)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k))
+        return false;
+
+    if (kind != trie_key_none && k != kind) {
+        PyErr_SetString(PyExc_TypeError, "Keys should be all str or all bytes");
+        return false;
+    }
+
+    try {
+        trie_tree::node *n = trie.insert(data, size);
+        if (!n->key.get()) {
+            n->key = py_ptr<PyObject>(key, true);
+            trie.added();
+            kind = k;
+            ++version;
+        }
+
+        n->value = py_ptr<PyObject>(value, true);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_MemoryError, e.what());
+        return false;
+    }
+
+    maintain_tracking(value);
+    return true;
+}
+
+PyObject *pystdcxx_trie_map::get(pystdcxx_trie_map *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    trie_tree::node *n = self->find(key);
+    if (!n) {
+        if (PyErr_Occurred())
+            return nullptr;
+        Py_INCREF(def);
+        return def;
+    }
+
+    PyObject *value = n->value.get();
+    Py_INCREF(value);
+    return value;
+}
+
+PyObject *pystdcxx_trie_map::clear(pystdcxx_trie_map *self, PyObject *Py_UNUSED(args))
+{
+    if (self->trie.size())
+        ++self->version;
+
+    trie_tree trie;
+    trie.swap(self->trie);
+    self->kind = trie_key_none;
+    Py_RETURN_NONE;
+}
+
+PyObject *pystdcxx_trie_map::prefix_items(pystdcxx_trie_map *self, PyObject *prefix)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(prefix, data, size, k))
+        return nullptr;
+
+    py_ptr<PyObject> list(PyList_New(0));
+    if (!list.get())
+        return nullptr;
+
+    trie_tree::node *top = k == self->kind ? self->trie.find_prefix(data, size) : nullptr;
+    if (!top)
+        return list.release();
+
+    try {
+        trie_tree::for_each(top, [&list] (trie_tree::node *n) {
+            py_ptr<PyObject> item(PyTuple_Pack(2, n->key.get(), n->value.get()));
+            if (!item.get() || PyList_Append(list.get(), item.get()) < 0)
+                throw std::runtime_error("Append item error");
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    return list.release();
+}
+
+PyObject *pystdcxx_trie_map::longest_prefix(pystdcxx_trie_map *self, PyObject *key)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k))
+        return nullptr;
+
+    trie_tree::node *n = k == self->kind ? self->trie.longest_prefix(data, size) : nullptr;
+    if (!n)
+        Py_RETURN_NONE;
+
+    return PyTuple_Pack(2, n->key.get(), n->value.get());
+}
+
+PyObject *pystdcxx_trie_map::iterator::tp_iter(pystdcxx_trie_map::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_trie_map::iterator::tp_iternext(pystdcxx_trie_map::iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change trie map while iterating");
+        return nullptr;
+    }
+
+    try {
+        while (!self->stack.empty()) {
+            trie_tree::node *n = self->stack.back();
+            self->stack.pop_back();
+            for (size_t i = n->children.size(); i > 0; --i)
+                self->stack.push_back(n->children[i - 1].get());
+
+            if (n->key.get())
+                return PyTuple_Pack(2, n->key.get(), n->value.get());
+        }
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_MemoryError, e.what());
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,76 @@
+#ifndef PYSTDCXX_TRIE_MAP_HPP
+#define PYSTDCXX_TRIE_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <vector>
+#include "utils.hpp"
+#include "trie.hpp"
+
+// Ordered map of str or bytes keys stored in a radix tree. Prefix queries
+// walk the bytes of the prefix once and then only visit the results,
+// without comparing whole keys.
+class pystdcxx_trie_map: public py_object<pystdcxx_trie_map>
+{
+public:
+    pystdcxx_trie_map(): version(0), kind(trie_key_none)
+    {
+        maintain_tracking();
+    }
+
+    ~pystdcxx_trie_map()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static const char *tp_name() { return "pystdcxx.trie_map"; }
+    static const char *tp_doc() { return "Ordered map of str or bytes keys stored in a radix tree"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(pystdcxx_trie_map *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_trie_map *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_trie_map *self);
+    static PyObject *tp_repr(pystdcxx_trie_map *self);
+    static PyObject *tp_iter(pystdcxx_trie_map *self);
+    static Py_ssize_t sq_length(pystdcxx_trie_map *self);
+    static int sq_contains(pystdcxx_trie_map *self, PyObject *key);
+    static Py_ssize_t mp_length(pystdcxx_trie_map *self);
+    static PyObject *mp_subscript(pystdcxx_trie_map *self, PyObject *key);
+    static int mp_ass_subscript(pystdcxx_trie_map *self, PyObject *key, PyObject *value);
+    static PyObject *get(pystdcxx_trie_map *self, PyObject *args);
+    static PyObject *clear(pystdcxx_trie_map *self, PyObject *args);
+    static PyObject *prefix_items(pystdcxx_trie_map *self, PyObject *prefix);
+    static PyObject *longest_prefix(pystdcxx_trie_map *self, PyObject *key);
+
+private:
+    trie_tree::node *find(PyObject *key);
+    bool insert(PyObject *key, PyObject *value);
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_trie_map *owner):
+            owner(owner, true),
+            version(owner->version),
+            stack(1, owner->trie.root())
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.trie_map_iterator"; }
+        static const char *tp_doc() { return "Iterator of trie map in order of key"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_trie_map> owner;
+        unsigned int version;
+        std::vector<trie_tree::node *> stack;   // Nodes to visit in preorder
+    };
+
+    unsigned int version;
+    trie_tree trie;
+    trie_key_kind kind;         // Kind of keys, none while the map is empty
+};
+
+#endif // PYSTDCXX_TRIE_MAP_HPP
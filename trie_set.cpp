@@ -0,0 +1,301 @@
+#include "trie_set.hpp"
+
+PyMethodDef *pystdcxx_trie_set::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "add",          (PyCFunction)pystdcxx_trie_set::add,      METH_O,       "Add key" },
+        { "remove",       (PyCFunction)pystdcxx_trie_set::remove,   METH_O,       "Remove key, raise KeyError if it doesn't exist" },
+        { "discard",      (PyCFunction)pystdcxx_trie_set::discard,  METH_O,       "Remove key if it exists" },
+        { "clear",        (PyCFunction)pystdcxx_trie_set::clear,    METH_NOARGS,  "Clear all keys" },
+        { "prefix_items", (PyCFunction)pystdcxx_trie_set::prefix_items, METH_O,   "Return list of keys starting with prefix in order" },
+        { "longest_prefix", (PyCFunction)pystdcxx_trie_set::longest_prefix, METH_O, "Return the longest key which is a prefix of key, or None" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+PyObject *pystdcxx_trie_set::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) pystdcxx_trie_set());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create trie set object failure");
+        return nullptr;
+    }
+}
+
+int pystdcxx_trie_set::tp_init(pystdcxx_trie_set *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr;
+    static const char *kwlist[] = { "tuple", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &tuple))
+        return -1;
+
+    if (!tuple)
+        return 0;
+
+    if (!py_tuple_check(tuple)) {
+        PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+        return -1;
+    }
+
+    try {
+        py_tuple_for_each(tuple, [self] (PyObject *item) {
+            if (!self->insert(item))
+                throw std::runtime_error("Insert key error");
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+// Keys are str or bytes, which can't take part in a cycle
+int pystdcxx_trie_set::tp_traverse(pystdcxx_trie_set *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+    return 0;
+}
+
+int pystdcxx_trie_set::tp_clear(pystdcxx_trie_set *self)
+{
+    trie_tree trie;
+    trie.swap(self->trie);
+    self->kind = trie_key_none;
+    ++self->version;
+    return 0;
+}
+
+PyObject *pystdcxx_trie_set::tp_repr(pystdcxx_trie_set *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        trie_tree::for_each(self->trie.root(), [&] (trie_tree::node *n) {
+            repr += comma;
+            repr += py_repr(n->key.get());
+            comma = ", ";
+        });
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject *pystdcxx_trie_set::tp_iter(pystdcxx_trie_set *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+Py_ssize_t pystdcxx_trie_set::sq_length(pystdcxx_trie_set *self)
+{
+    return self->trie.size();
+}
+
+int pystdcxx_trie_set::sq_contains(pystdcxx_trie_set *self, PyObject *key)
+{
+    if (self->find(key))
+        return 1;
+
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+// Node of key, or nullptr if it doesn't exist or isn't a str/bytes key,
+// only the latter sets an error.
+trie_tree::node *pystdcxx_trie_set::find(PyObject *key)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k) || k != kind)
+        return nullptr;
+
+    return trie.find(data, size);
+}
+
+bool pystdcxx_trie_set::insert(PyObject *key)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k))
+        return false;
+
+    if (kind != trie_key_none && k != kind) {
+        PyErr_SetString(PyExc_TypeError, "Keys should be all str or all bytes");
+        return false;
+    }
+
+    try {
+        trie_tree::node *n = trie.insert(data, size);
+        if (!n->key.get()) {
+            n->key = py_ptr<PyObject>(key, true);
+            trie.added();
+            kind = k;
+            ++version;
+        }
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_MemoryError, e.what());
+        return false;
+    }
+
+    return true;
+}
+
+// Remove key, returns 1 if it's removed, 0 if it doesn't exist and -1 on
+// error.
+int pystdcxx_trie_set::erase(PyObject *key)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k))
+        return -1;
+
+    // Erased key is released when leaving the scope
+    py_ptr<PyObject> erased_key, erased_value;
+    if (k != kind || !trie.erase(data, size, erased_key, erased_value))
+        return 0;
+
+    if (!trie.size())
+        kind = trie_key_none;
+    ++version;
+    return 1;
+}
+
+PyObject *pystdcxx_trie_set::add(pystdcxx_trie_set *self, PyObject *key)
+{
+    if (!self->insert(key))
+        return nullptr;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *pystdcxx_trie_set::remove(pystdcxx_trie_set *self, PyObject *key)
+{
+    int result = self->erase(key);
+    if (result < 0)
+        return nullptr;
+
+    if (!result) {
+        PyErr_SetString(PyExc_KeyError, "Key error");
+        return nullptr;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyObject *pystdcxx_trie_set::discard(pystdcxx_trie_set *self, PyObject *key)
+{
+    if (self->erase(key) < 0)
+        return nullptr;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *pystdcxx_trie_set::clear(pystdcxx_trie_set *self, PyObject *Py_UNUSED(args))
+{
+    if (self->trie.size())
+        ++self->version;
+
+    trie_tree trie;
+    trie.swap(self->trie);
+    self->kind = trie_key_none;
+    Py_RETURN_NONE;
+}
+
+PyObject *pystdcxx_trie_set::prefix_items(pystdcxx_trie_set *self, PyObject *prefix)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(prefix, data, size, k))
+        return nullptr;
+
+    py_ptr<PyObject> list(PyList_New(0));
+    if (!list.get())
+        return nullptr;
+
+    trie_tree::node *top = k == self->kind ? self->trie.find_prefix(data, size) : nullptr;
+    if (!top)
+        return list.release();
+
+    try {
+        trie_tree::for_each(top, [&list] (trie_tree::node *n) {
+            if (PyList_Append(list.get(), n->key.get()) < 0)
+                throw std::runtime_error("Append item error");
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    return list.release();
+}
+
+PyObject *pystdcxx_trie_set::longest_prefix(pystdcxx_trie_set *self, PyObject *key)
+{
+    const char *data;
+    size_t size;
+    trie_key_kind k;
+    if (!trie_key_data(key, data, size, k))
+        return nullptr;
+
+    trie_tree::node *n = k == self->kind ? self->trie.longest_prefix(data, size) : nullptr;
+    if (!n)
+        Py_RETURN_NONE;
+
+    PyObject *found = n->key.get();
+    Py_INCREF(found);
+    return found;
+}
+
+PyObject *pystdcxx_trie_set::iterator::tp_iter(pystdcxx_trie_set::iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *pystdcxx_trie_set::iterator::tp_iternext(pystdcxx_trie_set::iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change trie set while iterating");
+        return nullptr;
+    }
+
+    try {
+        while (!self->stack.empty()) {
+            trie_tree::node *n = self->stack.back();
+            self->stack.pop_back();
+            for (size_t i = n->children.size(); i > 0; --i)
+                self->stack.push_back(n->children[i - 1].get());
+
+            if (n->key.get()) {
+                PyObject *key = n->key.get();
+                Py_INCREF(key);
+                return key;
+            }
+        }
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_MemoryError, e.what());
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,75 @@
+#ifndef PYSTDCXX_TRIE_SET_HPP
+#define PYSTDCXX_TRIE_SET_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <vector>
+#include "utils.hpp"
+#include "trie.hpp"
+
+// Ordered set of str or bytes keys stored in a radix tree, see
+// pystdcxx_trie_map.
+class pystdcxx_trie_set: public py_object<pystdcxx_trie_set>
+{
+public:
+    pystdcxx_trie_set(): version(0), kind(trie_key_none)
+    {
+        maintain_tracking();
+    }
+
+    ~pystdcxx_trie_set()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static const char *tp_name() { return "pystdcxx.trie_set"; }
+    static const char *tp_doc() { return "Ordered set of str or bytes keys stored in a radix tree"; }
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(pystdcxx_trie_set *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(pystdcxx_trie_set *self, visitproc visit, void *arg);
+    static int tp_clear(pystdcxx_trie_set *self);
+    static PyObject *tp_repr(pystdcxx_trie_set *self);
+    static PyObject *tp_iter(pystdcxx_trie_set *self);
+    static Py_ssize_t sq_length(pystdcxx_trie_set *self);
+    static int sq_contains(pystdcxx_trie_set *self, PyObject *key);
+    static PyObject *add(pystdcxx_trie_set *self, PyObject *key);
+    static PyObject *remove(pystdcxx_trie_set *self, PyObject *key);
+    static PyObject *discard(pystdcxx_trie_set *self, PyObject *key);
+    static PyObject *clear(pystdcxx_trie_set *self, PyObject *args);
+    static PyObject *prefix_items(pystdcxx_trie_set *self, PyObject *prefix);
+    static PyObject *longest_prefix(pystdcxx_trie_set *self, PyObject *key);
+
+private:
+    trie_tree::node *find(PyObject *key);
+    bool insert(PyObject *key);
+    int erase(PyObject *key);
+
+    class iterator: public py_object<iterator>
+    {
+    public:
+        iterator(pystdcxx_trie_set *owner):
+            owner(owner, true),
+            version(owner->version),
+            stack(1, owner->trie.root())
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.trie_set_iterator"; }
+        static const char *tp_doc() { return "Iterator of trie set in order of key"; }
+        static PyObject *tp_iter(iterator *self);
+        static PyObject *tp_iternext(iterator *self);
+
+    private:
+        py_ptr<pystdcxx_trie_set> owner;
+        unsigned int version;
+        std::vector<trie_tree::node *> stack;   // Nodes to visit in preorder
+    };
+
+    unsigned int version;
+    trie_tree trie;
+    trie_key_kind kind;         // Kind of keys, none while the set is empty
+};
+
+#endif // PYSTDCXX_TRIE_SET_HPP
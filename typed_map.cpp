@@ -0,0 +1,686 @@
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include "typed_map.hpp"
+
+// Items walked with the GIL held before a scan is split across threads, a
+// range shorter than this isn't worth starting threads for
+static const size_t scan_grain = 1 << 14;
+
+// Key i / n of the way from lower to upper, used to split a key range
+static inline int64_t split_key(int64_t lower, int64_t upper, size_t i, size_t n)
+{
+    return lower + static_cast<int64_t>((static_cast<__int128>(upper) - lower) * i / n);
+}
+
+static inline double split_key(double lower, double upper, size_t i, size_t n)
+{
+    double t = static_cast<double>(i) / n;
+    return lower * (1.0 - t) + upper * t;
+}
+
+// Partial sum, an integer sum which overflows is flagged instead of wrapped
+template<typename N>
+struct native_sum
+{
+    native_sum(): value(0), overflow(false) {}
+
+    void add(N n)
+    {
+        if constexpr (std::is_integral<N>::value)
+            overflow |= __builtin_add_overflow(value, n, &value);
+        else
+            value += n;
+    }
+
+    N value;
+    bool overflow;
+};
+
+template<typename T, typename K, typename V>
+PyMethodDef *pystdcxx_typed_map<T, K, V>::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "get",          (PyCFunction)pystdcxx_typed_map::get,      METH_VARARGS, "Return value of key, or default if key doesn't exist" },
+        { "pop",          (PyCFunction)pystdcxx_typed_map::pop,      METH_VARARGS, "Remove key and return its value, or default if key doesn't exist" },
+        { "popitem",      (PyCFunction)pystdcxx_typed_map::popitem,  METH_VARARGS | METH_KEYWORDS,       "Pop and remove the first/last item" },
+        { "clear",        (PyCFunction)pystdcxx_typed_map::clear,    METH_NOARGS,  "Clear all items" },
+        { "reverse",      (PyCFunction)pystdcxx_typed_map::reverse,  METH_NOARGS,  "Return an iterator in reverse order" },
+        { "sum_values",   (PyCFunction)pystdcxx_typed_map::sum_values, METH_VARARGS | METH_KEYWORDS,     "Sum of values with key in [lo, hi)" },
+        { "histogram",    (PyCFunction)pystdcxx_typed_map::histogram,  METH_VARARGS | METH_KEYWORDS,     "Count values with key in [lo, hi) into bins between increasing edges" },
+        { "count_if",     (PyCFunction)pystdcxx_typed_map::count_if,   METH_VARARGS | METH_KEYWORDS,     "Count values with key in [lo, hi) for which value op threshold holds" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) T());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create typed map object failure");
+        return nullptr;
+    }
+}
+
+template<typename T, typename K, typename V>
+int pystdcxx_typed_map<T, K, V>::tp_init(T *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr;
+    static const char *kwlist[] = { "tuple", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &tuple))
+        return -1;
+
+    if (!tuple)
+        return 0;
+
+    if (!py_tuple_check(tuple)) {
+        PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+        return -1;
+    }
+
+    try {
+        py_tuple_for_each(tuple, [self] (PyObject *item) {
+            PyObject *key = py_tuple_get_item(item, 0);
+            PyObject *value = py_tuple_get_item(item, 1);
+            if (!key || !value)
+                throw std::runtime_error("Invalie key/value pair");
+            if (!self->insert(key, value))
+                throw std::runtime_error("Convert key/value error");
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+// Only maps of object values hold references which may form a cycle
+template<typename T, typename K, typename V>
+int pystdcxx_typed_map<T, K, V>::tp_traverse(T *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+
+    if (V::is_object) {
+        for (auto iter = self->map.begin(); iter != self->map.end(); ++iter)
+            Py_VISIT(V::object(iter->second));
+    }
+
+    return 0;
+}
+
+template<typename T, typename K, typename V>
+int pystdcxx_typed_map<T, K, V>::tp_clear(T *self)
+{
+    native_map map;
+    map.swap(self->map);
+    ++self->version;
+    return 0;
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::make_item(const typename native_map::value_type &item)
+{
+    py_ptr<PyObject> key(K::box(item.first)), value(V::box(item.second));
+    if (!key.get() || !value.get())
+        return nullptr;
+
+    return PyTuple_Pack(2, key.get(), value.get());
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::tp_repr(T *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        for (auto iter = self->map.begin(); iter != self->map.end(); ++iter) {
+            py_ptr<PyObject> item(make_item(*iter));
+            if (!item.get())
+                return nullptr;
+
+            repr += comma;
+            repr += py_repr(item.get());
+            comma = ", ";
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::tp_iter(T *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self, self->map.begin(), self->map.end()));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::reverse(T *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) reverse_iterator(self, self->map.rbegin(), self->map.rend()));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+template<typename T, typename K, typename V>
+Py_ssize_t pystdcxx_typed_map<T, K, V>::sq_length(T *self)
+{
+    return self->map.size();
+}
+
+template<typename T, typename K, typename V>
+int pystdcxx_typed_map<T, K, V>::sq_contains(T *self, PyObject *key)
+{
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k))
+        return -1;
+
+    return self->map.find(k) != self->map.end();
+}
+
+template<typename T, typename K, typename V>
+Py_ssize_t pystdcxx_typed_map<T, K, V>::mp_length(T *self)
+{
+    return self->map.size();
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::mp_subscript(T *self, PyObject *key)
+{
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k))
+        return nullptr;
+
+    auto iter = self->map.find(k);
+    if (iter == self->map.end()) {
+        PyErr_SetString(PyExc_KeyError, "Key error");
+        return nullptr;
+    }
+
+    return V::box(iter->second);
+}
+
+// Insert or replace an item, sorted input is placed with the end hint.
+// Unboxing may run Python code which lets a scan start, so the scan check
+// comes right before the tree is touched.
+template<typename T, typename K, typename V>
+bool pystdcxx_typed_map<T, K, V>::insert(PyObject *key, PyObject *value)
+{
+    typename K::type k;
+    typename V::type v;
+    if (!native_unbox_key<K>(key, k) || !V::unbox(value, v) || !prepare_modify())
+        return false;
+
+    size_t size = map.size();
+    map.insert_or_assign(map.end(), k, v);
+    if (size != map.size())
+        ++version;
+
+    this->maintain_tracking(V::object(v));
+    return true;
+}
+
+template<typename T, typename K, typename V>
+int pystdcxx_typed_map<T, K, V>::mp_ass_subscript(T *self, PyObject *key, PyObject *value)
+{
+    try {
+        if (value)
+            return self->insert(key, value) ? 0 : -1;
+
+        typename K::type k;
+        if (!native_unbox_key<K>(key, k) || !self->prepare_modify())
+            return -1;
+
+        if (!self->map.erase(k)) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return -1;
+        }
+
+        ++self->version;
+        return 0;
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::get(T *self, PyObject *args)
+{
+    PyObject *key, *def = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k))
+        return nullptr;
+
+    auto iter = self->map.find(k);
+    if (iter == self->map.end()) {
+        Py_INCREF(def);
+        return def;
+    }
+
+    return V::box(iter->second);
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::pop(T *self, PyObject *args)
+{
+    PyObject *key, *def = nullptr;
+    if (!PyArg_ParseTuple(args, "O|O", &key, &def))
+        return nullptr;
+
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k) || !self->prepare_modify())
+        return nullptr;
+
+    auto iter = self->map.find(k);
+    if (iter == self->map.end()) {
+        if (!def) {
+            PyErr_SetString(PyExc_KeyError, "Key error");
+            return nullptr;
+        }
+        Py_INCREF(def);
+        return def;
+    }
+
+    PyObject *value = V::box(iter->second);
+    if (value) {
+        self->map.erase(iter);
+        ++self->version;
+    }
+
+    return value;
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::popitem(T *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *is_last = nullptr;
+    static const char *kwlist[] = { "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &is_last))
+        return nullptr;
+
+    int last = is_last ? PyObject_IsTrue(is_last) : 0;
+    if (last < 0)
+        return nullptr;
+
+    // Creating the tuple may run a collection whose finalizers change the
+    // map, take the item again if they did
+    for (;;) {
+        if (!self->prepare_modify())
+            return nullptr;
+
+        if (self->map.empty()) {
+            PyErr_SetString(PyExc_ValueError, "Empty map");
+            return nullptr;
+        }
+
+        unsigned int version = self->version;
+        auto iter = last ? std::prev(self->map.end()) : self->map.begin();
+        PyObject *item = make_item(*iter);
+        if (!item)
+            return nullptr;
+
+        if (version != self->version || self->scans) {
+            Py_DECREF(item);
+            continue;
+        }
+
+        self->map.erase(iter);
+        ++self->version;
+        return item;
+    }
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::clear(T *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->prepare_modify())
+        return nullptr;
+
+    if (!self->map.empty())
+        ++self->version;
+    self->map.clear();
+    Py_RETURN_NONE;
+}
+
+// Another thread may run Python code while a scan has released the GIL,
+// the tree must stay as it is until the scan ends
+template<typename T, typename K, typename V>
+bool pystdcxx_typed_map<T, K, V>::prepare_modify()
+{
+    if (scans) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while it's being scanned");
+        return false;
+    }
+
+    return true;
+}
+
+// Items with key in [lower, upper), None is unbounded
+template<typename T, typename K, typename V>
+bool pystdcxx_typed_map<T, K, V>::key_range(PyObject *lower, PyObject *upper,
+                                            typename native_map::iterator &first, typename native_map::iterator &last)
+{
+    typename K::type lo = typename K::type(), hi = typename K::type();
+    if (!Py_IsNone(lower) && !native_unbox_key<K>(lower, lo))
+        return false;
+    if (!Py_IsNone(upper) && !native_unbox_key<K>(upper, hi))
+        return false;
+
+    first = Py_IsNone(lower) ? map.begin() : map.lower_bound(lo);
+    last = Py_IsNone(upper) ? map.end() : map.lower_bound(hi);
+    if (!Py_IsNone(lower) && !Py_IsNone(upper) && !(lo < hi))
+        last = first;
+
+    return true;
+}
+
+// Fold f(item, partial) over [first, last) and return the partial results
+// in key order. The head of the range is folded with the GIL held, what's
+// left after scan_grain items is split by key into one partition per core,
+// each found by its own lower_bound and folded by a thread of its own with
+// the GIL released.
+template<typename T, typename K, typename V>
+template<typename R, typename F>
+std::vector<R> pystdcxx_typed_map<T, K, V>::scan(typename native_map::iterator first, typename native_map::iterator last, const R &init, F f)
+{
+    std::vector<R> partials(1, init);
+    size_t count = 0;
+    for (; first != last && count < scan_grain; ++first, ++count)
+        f(*first, partials[0]);
+
+    if (first == last)
+        return partials;
+
+    // Boundary keys are kept increasing and within the range, floating
+    // point rounding can't make partitions overlap
+    size_t n = std::max(1u, std::thread::hardware_concurrency());
+    typename K::type lower = first->first, upper = std::prev(last)->first, key = lower;
+    std::vector<typename native_map::iterator> bounds(1, first);
+    for (size_t i = 1; i < n; ++i) {
+        key = std::min(std::max(split_key(lower, upper, i, n), key), upper);
+        bounds.push_back(map.lower_bound(key));
+    }
+    bounds.push_back(last);
+
+    partials.resize(n + 1, init);
+    std::vector<std::exception_ptr> errors(n);
+    auto work = [&] (size_t i) {
+        try {
+            R partial(init);
+            for (typename native_map::iterator iter = bounds[i]; iter != bounds[i + 1]; ++iter)
+                f(*iter, partial);
+            partials[i + 1] = std::move(partial);
+        } catch ( ... ) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    ++scans;
+    try {
+        py_without_gil([&] () {
+            std::vector<std::thread> workers;
+            size_t i = 1;
+            try {
+                for (; i < n; ++i)
+                    workers.emplace_back(work, i);
+            } catch (std::system_error &) {
+                // Out of threads, partitions left run in this thread
+            }
+
+            for (size_t j = i; j < n; ++j)
+                work(j);
+            work(0);
+
+            for (std::thread &worker: workers)
+                worker.join();
+
+            for (std::exception_ptr &error: errors) {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+        });
+    } catch ( ... ) {
+        --scans;
+        throw;
+    }
+
+    --scans;
+    return partials;
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::sum_values(T *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *lower = Py_None, *upper = Py_None;
+    static const char *kwlist[] = { "lo", "hi", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", const_cast<char **>(kwlist), &lower, &upper))
+        return nullptr;
+
+    if constexpr (V::is_object) {
+        PyErr_SetString(PyExc_TypeError, "Values of map aren't native numbers");
+        return nullptr;
+    } else {
+        typename native_map::iterator first, last;
+        if (!self->key_range(lower, upper, first, last))
+            return nullptr;
+
+        try {
+            typedef native_sum<typename V::type> partial_sum;
+            std::vector<partial_sum> partials = self->scan(first, last, partial_sum(),
+                                                           [] (const typename native_map::value_type &item, partial_sum &sum) {
+                                                               sum.add(item.second);
+                                                           });
+
+            partial_sum total;
+            for (const partial_sum &partial: partials) {
+                total.add(partial.value);
+                total.overflow |= partial.overflow;
+            }
+
+            if (total.overflow) {
+                PyErr_SetString(PyExc_OverflowError, "Sum of values overflows");
+                return nullptr;
+            }
+
+            return V::box(total.value);
+        } catch (std::exception &e) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+            return nullptr;
+        }
+    }
+}
+
+// Bins are between consecutive edges, the last bin includes its upper edge
+// as numpy.histogram does
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::histogram(T *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *bins, *lower = Py_None, *upper = Py_None;
+    static const char *kwlist[] = { "bins", "lo", "hi", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", const_cast<char **>(kwlist), &bins, &lower, &upper))
+        return nullptr;
+
+    if constexpr (V::is_object) {
+        PyErr_SetString(PyExc_TypeError, "Values of map aren't native numbers");
+        return nullptr;
+    } else {
+        typedef typename V::type value_type;
+
+        py_ptr<PyObject> seq(PySequence_Fast(bins, "bins should be a sequence of edges"));
+        if (!seq.get())
+            return nullptr;
+
+        Py_ssize_t size = PySequence_Fast_GET_SIZE(seq.get());
+        std::vector<value_type> edges(size);
+        for (Py_ssize_t i = 0; i < size; ++i) {
+            if (!V::unbox(PySequence_Fast_GET_ITEM(seq.get(), i), edges[i]))
+                return nullptr;
+            if (i > 0 && !(edges[i - 1] < edges[i])) {
+                PyErr_SetString(PyExc_ValueError, "bins should be increasing edges");
+                return nullptr;
+            }
+        }
+
+        if (size < 2) {
+            PyErr_SetString(PyExc_ValueError, "bins should have at least two edges");
+            return nullptr;
+        }
+
+        typename native_map::iterator first, last;
+        if (!self->key_range(lower, upper, first, last))
+            return nullptr;
+
+        try {
+            typedef std::vector<Py_ssize_t> counts;
+            std::vector<counts> partials = self->scan(first, last, counts(size - 1),
+                                                      [&edges] (const typename native_map::value_type &item, counts &bin) {
+                                                          typename std::vector<value_type>::const_iterator pos;
+                                                          pos = std::upper_bound(edges.begin(), edges.end(), item.second);
+                                                          if (pos == edges.end() && item.second == edges.back())
+                                                              --pos;
+                                                          if (pos != edges.begin() && pos != edges.end())
+                                                              ++bin[pos - edges.begin() - 1];
+                                                      });
+
+            py_ptr<PyObject> list(PyList_New(size - 1));
+            if (!list.get())
+                return nullptr;
+
+            for (Py_ssize_t i = 0; i < size - 1; ++i) {
+                Py_ssize_t total = 0;
+                for (const counts &partial: partials)
+                    total += partial[i];
+
+                PyObject *count = PyLong_FromSsize_t(total);
+                if (!count)
+                    return nullptr;
+                PyList_SET_ITEM(list.get(), i, count);
+            }
+
+            return list.release();
+        } catch (std::exception &e) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+            return nullptr;
+        }
+    }
+}
+
+template<typename T, typename K, typename V>
+PyObject *pystdcxx_typed_map<T, K, V>::count_if(T *self, PyObject *args, PyObject *kwds)
+{
+    const char *op;
+    PyObject *threshold, *lower = Py_None, *upper = Py_None;
+    static const char *kwlist[] = { "op", "threshold", "lo", "hi", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sO|OO", const_cast<char **>(kwlist), &op, &threshold, &lower, &upper))
+        return nullptr;
+
+    if constexpr (V::is_object) {
+        PyErr_SetString(PyExc_TypeError, "Values of map aren't native numbers");
+        return nullptr;
+    } else {
+        typename V::type t;
+        if (!V::unbox(threshold, t))
+            return nullptr;
+
+        typename native_map::iterator first, last;
+        if (!self->key_range(lower, upper, first, last))
+            return nullptr;
+
+        try {
+            // One scan per operator, so the comparison is inlined
+            auto count = [&] (auto pred) {
+                std::vector<Py_ssize_t> partials = self->scan(first, last, Py_ssize_t(0),
+                                                              [pred] (const typename native_map::value_type &item, Py_ssize_t &n) {
+                                                                  n += pred(item.second);
+                                                              });
+
+                Py_ssize_t total = 0;
+                for (Py_ssize_t partial: partials)
+                    total += partial;
+                return PyLong_FromSsize_t(total);
+            };
+
+            std::string name(op);
+            if (name == "<")
+                return count([t] (typename V::type v) { return v < t; });
+            if (name == "<=")
+                return count([t] (typename V::type v) { return v <= t; });
+            if (name == ">")
+                return count([t] (typename V::type v) { return v > t; });
+            if (name == ">=")
+                return count([t] (typename V::type v) { return v >= t; });
+            if (name == "==")
+                return count([t] (typename V::type v) { return v == t; });
+            if (name == "!=")
+                return count([t] (typename V::type v) { return v != t; });
+
+            PyErr_SetString(PyExc_ValueError, "op should be one of <, <=, >, >=, == and !=");
+            return nullptr;
+        } catch (std::exception &e) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+            return nullptr;
+        }
+    }
+}
+
+template<typename T, typename K, typename V>
+template<typename I>
+PyObject *pystdcxx_typed_map<T, K, V>::basic_iterator<I>::tp_iter(basic_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+template<typename T, typename K, typename V>
+template<typename I>
+PyObject *pystdcxx_typed_map<T, K, V>::basic_iterator<I>::tp_iternext(basic_iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change map while iterating");
+        return nullptr;
+    }
+
+    if (self->first == self->last)
+        return nullptr;
+
+    PyObject *item = make_item(*self->first);
+    ++self->first;
+    return item;
+}
+
+template class pystdcxx_typed_map<pystdcxx_map_i64_i64, native_i64, native_i64>;
+template class pystdcxx_typed_map<pystdcxx_map_i64_f64, native_i64, native_f64>;
+template class pystdcxx_typed_map<pystdcxx_map_i64_obj, native_i64, native_obj>;
+template class pystdcxx_typed_map<pystdcxx_map_f64_f64, native_f64, native_f64>;
@@ -0,0 +1,122 @@
+#ifndef PYSTDCXX_TYPED_MAP_HPP
+#define PYSTDCXX_TYPED_MAP_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <map>
+#include <vector>
+#include "utils.hpp"
+#include "native.hpp"
+
+// Ordered map of native keys and values, like map_i64_f64. Items are
+// stored unboxed in the tree, so an item costs only its node, and a map
+// without object values never has to be visited by GC. Reductions over
+// numeric values run without the GIL, large key ranges are split across
+// threads. T is the concrete type which gives the type name.
+template<typename T, typename K, typename V>
+class pystdcxx_typed_map: public py_object<T>
+{
+protected:
+    typedef std::map<typename K::type, typename V::type> native_map;
+
+public:
+    pystdcxx_typed_map(): version(0), scans(0)
+    {
+        this->maintain_tracking();
+    }
+
+    ~pystdcxx_typed_map()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(T *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(T *self, visitproc visit, void *arg);
+    static int tp_clear(T *self);
+    static PyObject *tp_repr(T *self);
+    static PyObject *tp_iter(T *self);
+    static Py_ssize_t sq_length(T *self);
+    static int sq_contains(T *self, PyObject *key);
+    static Py_ssize_t mp_length(T *self);
+    static PyObject *mp_subscript(T *self, PyObject *key);
+    static int mp_ass_subscript(T *self, PyObject *key, PyObject *value);
+    static PyObject *get(T *self, PyObject *args);
+    static PyObject *pop(T *self, PyObject *args);
+    static PyObject *popitem(T *self, PyObject *args, PyObject *kwds);
+    static PyObject *clear(T *self, PyObject *args);
+    static PyObject *reverse(T *self, PyObject *args);
+    static PyObject *sum_values(T *self, PyObject *args, PyObject *kwds);
+    static PyObject *histogram(T *self, PyObject *args, PyObject *kwds);
+    static PyObject *count_if(T *self, PyObject *args, PyObject *kwds);
+
+protected:
+    bool prepare_modify();
+    bool key_range(PyObject *lower, PyObject *upper, typename native_map::iterator &first, typename native_map::iterator &last);
+    template<typename R, typename F>
+    std::vector<R> scan(typename native_map::iterator first, typename native_map::iterator last, const R &init, F f);
+    bool insert(PyObject *key, PyObject *value);
+    static PyObject *make_item(const typename native_map::value_type &item);
+
+    template<typename I>
+    class basic_iterator: public py_object<basic_iterator<I>>
+    {
+    public:
+        basic_iterator(T *owner, I first, I last):
+            owner(owner, true),
+            version(owner->version),
+            first(first),
+            last(last)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.typed_map_iterator"; }
+        static const char *tp_doc() { return "Iterator of typed map"; }
+        static PyObject *tp_iter(basic_iterator *self);
+        static PyObject *tp_iternext(basic_iterator *self);
+
+    private:
+        py_ptr<T> owner;
+        unsigned int version;
+        I first, last;
+    };
+
+    typedef basic_iterator<typename native_map::iterator> iterator;
+    typedef basic_iterator<typename native_map::reverse_iterator> reverse_iterator;
+
+    unsigned int version;
+    unsigned int scans;         // Scans running without GIL, the map can't change
+    native_map map;
+};
+
+class pystdcxx_map_i64_i64: public pystdcxx_typed_map<pystdcxx_map_i64_i64, native_i64, native_i64>
+{
+public:
+    static const char *tp_name() { return "pystdcxx.map_i64_i64"; }
+    static const char *tp_doc() { return "Ordered map of int64 to int64 stored unboxed"; }
+};
+
+class pystdcxx_map_i64_f64: public pystdcxx_typed_map<pystdcxx_map_i64_f64, native_i64, native_f64>
+{
+public:
+    static const char *tp_name() { return "pystdcxx.map_i64_f64"; }
+    static const char *tp_doc() { return "Ordered map of int64 to float stored unboxed"; }
+};
+
+class pystdcxx_map_i64_obj: public pystdcxx_typed_map<pystdcxx_map_i64_obj, native_i64, native_obj>
+{
+public:
+    static const char *tp_name() { return "pystdcxx.map_i64_obj"; }
+    static const char *tp_doc() { return "Ordered map of int64 to object with unboxed keys"; }
+};
+
+class pystdcxx_map_f64_f64: public pystdcxx_typed_map<pystdcxx_map_f64_f64, native_f64, native_f64>
+{
+public:
+    static const char *tp_name() { return "pystdcxx.map_f64_f64"; }
+    static const char *tp_doc() { return "Ordered map of float to float stored unboxed"; }
+};
+
+#endif // PYSTDCXX_TYPED_MAP_HPP
@@ -0,0 +1,231 @@
+#include "typed_set.hpp"
+
+template<typename T, typename K>
+PyMethodDef *pystdcxx_typed_set<T, K>::tp_methods()
+{
+    static PyMethodDef methods[] = {
+        { "add",          (PyCFunction)pystdcxx_typed_set::add,      METH_O,       "Add item" },
+        { "remove",       (PyCFunction)pystdcxx_typed_set::remove,   METH_O,       "Remove item" },
+        { "popitem",      (PyCFunction)pystdcxx_typed_set::popitem,  METH_VARARGS | METH_KEYWORDS,       "Pop and remove the first/last item" },
+        { "clear",        (PyCFunction)pystdcxx_typed_set::clear,    METH_NOARGS,  "Clear all items" },
+        { "reverse",      (PyCFunction)pystdcxx_typed_set::reverse,  METH_NOARGS,  "Return an iterator in reverse order" },
+        { nullptr },
+    };
+
+    return methods;
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(type) T());
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create typed set object failure");
+        return nullptr;
+    }
+}
+
+template<typename T, typename K>
+int pystdcxx_typed_set<T, K>::tp_init(T *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *tuple = nullptr;
+    static const char *kwlist[] = { "tuple", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &tuple))
+        return -1;
+
+    if (!tuple)
+        return 0;
+
+    if (!py_tuple_check(tuple)) {
+        PyErr_SetString(PyExc_ValueError, "Require list/tuple type");
+        return -1;
+    }
+
+    try {
+        py_tuple_for_each(tuple, [self] (PyObject *item) {
+            typename K::type key;
+            if (!native_unbox_key<K>(item, key))
+                throw std::runtime_error("Convert key error");
+            size_t size = self->set.size();
+            self->set.emplace_hint(self->set.end(), key);
+            if (size != self->set.size())
+                ++self->version;
+        });
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+// Only instances of Python subclasses are tracked, for their __dict__
+template<typename T, typename K>
+int pystdcxx_typed_set<T, K>::tp_traverse(T *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+    return 0;
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::tp_repr(T *self)
+{
+    try {
+        std::string repr("{");
+        const char *comma = "";
+
+        for (auto iter = self->set.begin(); iter != self->set.end(); ++iter) {
+            py_ptr<PyObject> key(K::box(*iter));
+            if (!key.get())
+                return nullptr;
+
+            repr += comma;
+            repr += py_repr(key.get());
+            comma = ", ";
+        }
+
+        repr += "}";
+        return PyUnicode_DecodeUTF8(repr.c_str(), repr.size(), "ignore");
+    } catch (std::exception &e) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::tp_iter(T *self)
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) iterator(self, self->set.begin(), self->set.end()));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::reverse(T *self, PyObject *Py_UNUSED(args))
+{
+    try {
+        return reinterpret_cast<PyObject *>(new(self) reverse_iterator(self, self->set.rbegin(), self->set.rend()));
+    } catch ( ... ) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Create iterator failure");
+        return nullptr;
+    }
+}
+
+template<typename T, typename K>
+Py_ssize_t pystdcxx_typed_set<T, K>::sq_length(T *self)
+{
+    return self->set.size();
+}
+
+template<typename T, typename K>
+int pystdcxx_typed_set<T, K>::sq_contains(T *self, PyObject *key)
+{
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k))
+        return -1;
+
+    return self->set.find(k) != self->set.end();
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::add(T *self, PyObject *key)
+{
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k))
+        return nullptr;
+
+    try {
+        size_t size = self->set.size();
+        self->set.emplace_hint(self->set.end(), k);
+        if (size == self->set.size())
+            Py_RETURN_FALSE;
+
+        ++self->version;
+        Py_RETURN_TRUE;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::remove(T *self, PyObject *key)
+{
+    typename K::type k;
+    if (!native_unbox_key<K>(key, k))
+        return nullptr;
+
+    size_t result = self->set.erase(k);
+    if (result)
+        ++self->version;
+    return PyBool_FromLong(result);
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::popitem(T *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *is_last = nullptr;
+    static const char *kwlist[] = { "last", nullptr };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char **>(kwlist), &is_last))
+        return nullptr;
+
+    if (self->set.empty()) {
+        PyErr_SetString(PyExc_ValueError, "Empty set");
+        return nullptr;
+    }
+
+    auto iter = is_last && PyObject_IsTrue(is_last) ? std::prev(self->set.end()) : self->set.begin();
+    PyObject *key = K::box(*iter);
+    if (key) {
+        self->set.erase(iter);
+        ++self->version;
+    }
+
+    return key;
+}
+
+template<typename T, typename K>
+PyObject *pystdcxx_typed_set<T, K>::clear(T *self, PyObject *Py_UNUSED(args))
+{
+    if (!self->set.empty())
+        ++self->version;
+    self->set.clear();
+    Py_RETURN_NONE;
+}
+
+template<typename T, typename K>
+template<typename I>
+PyObject *pystdcxx_typed_set<T, K>::basic_iterator<I>::tp_iter(basic_iterator *self)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+template<typename T, typename K>
+template<typename I>
+PyObject *pystdcxx_typed_set<T, K>::basic_iterator<I>::tp_iternext(basic_iterator *self)
+{
+    if (self->version != self->owner->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Can't change set while iterating");
+        return nullptr;
+    }
+
+    if (self->first == self->last)
+        return nullptr;
+
+    PyObject *key = K::box(*self->first);
+    ++self->first;
+    return key;
+}
+
+template class pystdcxx_typed_set<pystdcxx_set_i64, native_i64>;
+template class pystdcxx_typed_set<pystdcxx_set_f64, native_f64>;
@@ -0,0 +1,90 @@
+#ifndef PYSTDCXX_TYPED_SET_HPP
+#define PYSTDCXX_TYPED_SET_HPP
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pyerrors.h>
+#include <set>
+#include "utils.hpp"
+#include "native.hpp"
+
+// Ordered set of native keys, like set_i64. Keys are stored unboxed so a
+// set holds no Python object at all. T is the concrete type which gives
+// the type name.
+template<typename T, typename K>
+class pystdcxx_typed_set: public py_object<T>
+{
+protected:
+    typedef std::set<typename K::type> native_set;
+
+public:
+    pystdcxx_typed_set(): version(0)
+    {
+        this->maintain_tracking();
+    }
+
+    ~pystdcxx_typed_set()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static PyMethodDef *tp_methods();
+    static PyObject *tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+    static int tp_init(T *self, PyObject *args, PyObject *kwds);
+    static int tp_traverse(T *self, visitproc visit, void *arg);
+    static PyObject *tp_repr(T *self);
+    static PyObject *tp_iter(T *self);
+    static Py_ssize_t sq_length(T *self);
+    static int sq_contains(T *self, PyObject *key);
+    static PyObject *add(T *self, PyObject *key);
+    static PyObject *remove(T *self, PyObject *key);
+    static PyObject *popitem(T *self, PyObject *args, PyObject *kwds);
+    static PyObject *clear(T *self, PyObject *args);
+    static PyObject *reverse(T *self, PyObject *args);
+
+protected:
+    template<typename I>
+    class basic_iterator: public py_object<basic_iterator<I>>
+    {
+    public:
+        basic_iterator(T *owner, I first, I last):
+            owner(owner, true),
+            version(owner->version),
+            first(first),
+            last(last)
+        {
+        }
+
+        static const char *tp_name() { return "pystdcxx.typed_set_iterator"; }
+        static const char *tp_doc() { return "Iterator of typed set"; }
+        static PyObject *tp_iter(basic_iterator *self);
+        static PyObject *tp_iternext(basic_iterator *self);
+
+    private:
+        py_ptr<T> owner;
+        unsigned int version;
+        I first, last;
+    };
+
+    typedef basic_iterator<typename native_set::iterator> iterator;
+    typedef basic_iterator<typename native_set::reverse_iterator> reverse_iterator;
+
+    unsigned int version;
+    native_set set;
+};
+
+class pystdcxx_set_i64: public pystdcxx_typed_set<pystdcxx_set_i64, native_i64>
+{
+public:
+    static const char *tp_name() { return "pystdcxx.set_i64"; }
+    static const char *tp_doc() { return "Ordered set of int64 stored unboxed"; }
+};
+
+class pystdcxx_set_f64: public pystdcxx_typed_set<pystdcxx_set_f64, native_f64>
+{
+public:
+    static const char *tp_name() { return "pystdcxx.set_f64"; }
+    static const char *tp_doc() { return "Ordered set of float stored unboxed"; }
+};
+
+#endif // PYSTDCXX_TYPED_SET_HPP
@@ -4,10 +4,16 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <pyerrors.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <vector>
 #include <stdexcept>
 #include <string>
 #include <cassert>
+#include <cstring>
+#include <exception>
+#include <utility>
 
 template <typename T>
 class py_ptr
@@ -56,6 +62,11 @@ public:
         return p_;
     }
 
+    T &operator*() const
+    {
+        return *p_;
+    }
+
     T **operator&()
     {
         if (p_)
@@ -85,12 +96,38 @@ private:
     T *p_;
 };
 
+// Key searched for in a tree ordered by a three-way comparator. The node
+// compared equal to key on the way down is recorded, so the position
+// returned by lower_bound needs no further comparison to be confirmed.
+struct py_probe
+{
+    explicit py_probe(const py_ptr<PyObject> &key): key(key), equal(nullptr) {}
+
+    const py_ptr<PyObject> &key;
+    mutable PyObject *equal;
+};
+
+// Order of keys, either by the less function, by the three-way cmp
+// function returning <0, 0 or >0, or by the < operator if neither is given.
 struct py_less
 {
-    explicit py_less(py_ptr<PyObject> &less): less(less) {}
+    typedef void is_transparent;
+
+    explicit py_less(const py_ptr<PyObject> &less, const py_ptr<PyObject> &cmp = py_ptr<PyObject>()):
+        less(less), cmp(cmp)
+    {
+    }
 
     bool operator()(const py_ptr<PyObject> &lhs, const py_ptr<PyObject> &rhs) const
     {
+        // No object is less than itself, interned keys compare equal
+        // without calling into Python
+        if (lhs.get() == rhs.get())
+            return false;
+
+        if (cmp.get())
+            return compare(lhs, rhs) < 0;
+
         PyObject *f = less.get();
         if (f) {
             py_ptr<PyObject> result(PyObject_CallFunctionObjArgs(f, lhs.get(), rhs.get(), nullptr));
@@ -107,9 +144,101 @@ struct py_less
         }
     }
 
-    py_ptr<PyObject> &less;
+    bool operator()(const py_ptr<PyObject> &lhs, const py_probe &rhs) const
+    {
+        if (!cmp.get())
+            return (*this)(lhs, rhs.key);
+
+        int result = compare(lhs, rhs.key);
+        if (result == 0)
+            rhs.equal = lhs.get();
+        return result < 0;
+    }
+
+    bool operator()(const py_probe &lhs, const py_ptr<PyObject> &rhs) const
+    {
+        if (!cmp.get())
+            return (*this)(lhs.key, rhs);
+
+        int result = compare(lhs.key, rhs);
+        if (result == 0)
+            lhs.equal = rhs.get();
+        return result < 0;
+    }
+
+    // Sign of cmp(lhs, rhs), only valid if cmp is given
+    int compare(const py_ptr<PyObject> &lhs, const py_ptr<PyObject> &rhs) const
+    {
+        if (lhs.get() == rhs.get())
+            return 0;
+
+        py_ptr<PyObject> result(PyObject_CallFunctionObjArgs(cmp.get(), lhs.get(), rhs.get(), nullptr));
+        if (!result.get())
+            throw std::runtime_error("Compare two object error");
+
+        if (PyLong_Check(result.get())) {
+            int overflow;
+            long n = PyLong_AsLongAndOverflow(result.get(), &overflow);
+            if (n == -1 && PyErr_Occurred())
+                throw std::runtime_error("Compare two object error");
+
+            return overflow ? overflow : (n > 0) - (n < 0);
+        }
+
+        // Like functools.cmp_to_key, any result comparable with 0 will do
+        py_ptr<PyObject> zero(PyLong_FromLong(0));
+        if (!zero.get())
+            throw std::bad_alloc();
+
+        int negative = PyObject_RichCompareBool(result.get(), zero.get(), Py_LT);
+        if (negative < 0)
+            throw std::runtime_error("Compare two object error");
+        if (negative)
+            return -1;
+
+        int positive = PyObject_RichCompareBool(result.get(), zero.get(), Py_GT);
+        if (positive < 0)
+            throw std::runtime_error("Compare two object error");
+        return positive;
+    }
+
+    py_ptr<PyObject> less;
+    py_ptr<PyObject> cmp;
 };
 
+// Position of key in a range of sorted keys, or last if it doesn't exist.
+// A three-way comparator ends the search at the first equal key.
+template<typename I>
+static inline I py_sorted_find(I first, I last, const py_ptr<PyObject> &key, const py_less &comp)
+{
+    if (!comp.cmp.get()) {
+        I iter = std::lower_bound(first, last, key, comp);
+        return iter == last || comp(key, *iter) ? last : iter;
+    }
+
+    I lo = first, hi = last;
+    while (lo < hi) {
+        I mid = lo + (hi - lo) / 2;
+        int result = comp.compare(*mid, key);
+        if (result == 0)
+            return mid;
+
+        if (result < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return last;
+}
+
+// Same rule as CPython dict uses, an untracked tuple stays untracked as
+// it's immutable, any other GC object may take part in a cycle.
+static inline bool py_may_be_tracked(PyObject *ob)
+{
+    return PyObject_IS_GC(ob) && (!PyTuple_CheckExact(ob) || PyObject_GC_IsTracked(ob));
+}
+
 static inline bool py_tuple_check(PyObject *tuple)
 {
     return PyList_Check(tuple) || PyTuple_Check(tuple);
@@ -159,48 +288,227 @@ static inline std::string py_repr(PyObject *ob)
     return std::string(str);
 }
 
+// Run f with GIL released, exceptions thrown by f are rethrown once the
+// GIL is held again. f must not touch any Python object.
+template <typename F>
+void py_without_gil(F f)
+{
+    std::exception_ptr error;
+
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        f();
+    } catch ( ... ) {
+        error = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Order dependent hash of a sequence of objects, mixed the same way as
+// CPython hashes tuples.
+class py_hasher
+{
+public:
+    py_hasher(): acc_(prime5), len_(0) {}
+
+    void add(PyObject *ob)
+    {
+        Py_hash_t hash = PyObject_Hash(ob);
+        if (hash == -1)
+            throw std::runtime_error("Hash object error");
+
+        acc_ += static_cast<Py_uhash_t>(hash) * prime2;
+        acc_ = (acc_ << rotate) | (acc_ >> (8 * sizeof(Py_uhash_t) - rotate));
+        acc_ *= prime1;
+        ++len_;
+    }
+
+    Py_hash_t result() const
+    {
+        Py_uhash_t acc = acc_ + (len_ ^ (prime5 ^ 3527539UL));
+        if (acc == static_cast<Py_uhash_t>(-1))
+            return 1546275796;
+        return static_cast<Py_hash_t>(acc);
+    }
+
+private:
+#if SIZEOF_PY_HASH_T > 4
+    static constexpr Py_uhash_t prime1 = 11400714785074694791ULL;
+    static constexpr Py_uhash_t prime2 = 14029467366897019727ULL;
+    static constexpr Py_uhash_t prime5 = 2870177450012600261ULL;
+    static constexpr int rotate = 31;
+#else
+    static constexpr Py_uhash_t prime1 = 2654435761UL;
+    static constexpr Py_uhash_t prime2 = 2246822519UL;
+    static constexpr Py_uhash_t prime5 = 374761393UL;
+    static constexpr int rotate = 13;
+#endif
+
+    Py_uhash_t acc_;
+    Py_uhash_t len_;
+};
+
+// Key range [lower, upper) of an ordered container given by slices, a null
+// bound means unbounded. Step of a slice may be None, 1 or -1 to reverse.
+struct py_key_range
+{
+    py_key_range(): reverse(false) {}
+
+    // Narrow the range by slice, return false with exception set if slice
+    // is invalid.
+    bool narrow(const py_less &less, PyObject *slice)
+    {
+        PySliceObject *s = reinterpret_cast<PySliceObject *>(slice);
+        if (!Py_IsNone(s->step)) {
+            long step = PyLong_AsLong(s->step);
+            if (step == -1 && PyErr_Occurred())
+                return false;
+            if (step != 1 && step != -1) {
+                PyErr_SetString(PyExc_ValueError, "slice step should be 1 or -1");
+                return false;
+            }
+            if (step == -1)
+                reverse = !reverse;
+        }
+
+        if (!Py_IsNone(s->start)) {
+            py_ptr<PyObject> key(s->start, true);
+            if (!lower.get() || less(lower, key))
+                lower = key;
+        }
+
+        if (!Py_IsNone(s->stop)) {
+            py_ptr<PyObject> key(s->stop, true);
+            if (!upper.get() || less(key, upper))
+                upper = key;
+        }
+
+        return true;
+    }
+
+    bool contains(const py_less &less, const py_ptr<PyObject> &key) const
+    {
+        return (!lower.get() || !less(key, lower)) && (!upper.get() || less(key, upper));
+    }
+
+    template<typename C>
+    std::pair<typename C::iterator, typename C::iterator> resolve(C &c) const
+    {
+        typename C::iterator first = lower.get() ? c.lower_bound(lower) : c.begin();
+        typename C::iterator last = upper.get() ? c.lower_bound(upper) : c.end();
+        if (lower.get() && upper.get() && !c.key_comp()(lower, upper))
+            last = first;
+        return std::make_pair(first, last);
+    }
+
+    py_ptr<PyObject> lower, upper;
+    bool reverse;
+};
+
+// Per module state, every module object owns the heap types it creates so
+// that subinterpreters never share type objects.
+struct py_module_state
+{
+    enum { max_types = 64 };
+    PyTypeObject *types[max_types];
+    PyObject *interned;         // intern_table of containers with intern=True
+};
+
+extern PyModuleDef pystdcxx_def;
+
+inline size_t py_type_next_index()
+{
+    static std::atomic<size_t> next(0);
+    return next++;
+}
+
+// Find the stdcxx module which created type or one of its bases
+inline PyObject *py_module_of(PyTypeObject *type)
+{
+    for (; type; type = type->tp_base) {
+        if (PyType_HasFeature(type, Py_TPFLAGS_HEAPTYPE)) {
+            PyObject *module = reinterpret_cast<PyHeapTypeObject *>(type)->ht_module;
+            if (module && PyModule_GetDef(module) == &pystdcxx_def)
+                return module;
+        }
+    }
+
+    PyErr_SetString(PyExc_TypeError, "Object doesn't belong to stdcxx module");
+    return nullptr;
+}
+
+template<typename T>
+class py_object;
+
 template<typename T>
 class py_type
 {
 public:
-    static PyTypeObject *get()
-    {
-        static PyTypeObject type = {
-            .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
-            .tp_name = tp_name(),
-            .tp_basicsize = sizeof(T),
-            .tp_itemsize = 0,
-            .tp_dealloc = (destructor)tp_dealloc(),
-            .tp_getattr = (getattrfunc)tp_getattr(),
-            .tp_setattr = (setattrfunc)tp_setattr(),
-            .tp_repr = (reprfunc)tp_repr(),
-            .tp_as_sequence = tp_as_sequence(),
-            .tp_as_mapping = tp_as_mapping(),
-            .tp_hash = (hashfunc)tp_hash(),
-            .tp_call = (ternaryfunc)tp_call(),
-            .tp_str = (reprfunc)tp_str(),
-            .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
-            .tp_doc = tp_doc(),
-            .tp_traverse = (traverseproc)tp_traverse(),
-            .tp_clear = (inquiry)tp_clear(),
-            .tp_richcompare = (richcmpfunc)tp_richcompare(),
-            .tp_iter = (getiterfunc)tp_iter(),
-            .tp_iternext = (iternextfunc)tp_iternext(),
-            .tp_methods = tp_methods(),
-            .tp_descr_get = (descrgetfunc)tp_descr_get(),
-            .tp_descr_set = (descrsetfunc)tp_descr_set(),
-            .tp_init = (initproc)tp_init(),
-            .tp_new = (newfunc)tp_new(),
+    // Get the type object of T owned by module, it's created from spec()
+    // the first time the module asks for it.
+    static PyTypeObject *get(PyObject *module)
+    {
+        if (!module)
+            return nullptr;
+
+        size_t i = index();
+        if (i >= py_module_state::max_types) {
+            PyErr_SetString(PyExc_RuntimeError, "Too many types in module");
+            return nullptr;
+        }
+
+        py_module_state *state = static_cast<py_module_state *>(PyModule_GetState(module));
+        if (!state->types[i])
+            state->types[i] = reinterpret_cast<PyTypeObject *>(PyType_FromModuleAndSpec(module, spec(), nullptr));
+
+        return state->types[i];
+    }
+
+    // Get the type object of T owned by the same module as related
+    template<typename O>
+    static PyTypeObject *get(py_object<O> *related)
+    {
+        return get(py_module_of(Py_TYPE(reinterpret_cast<PyObject *>(related))));
+    }
+
+    // Check if ob is an instance of T created by any stdcxx module
+    static bool check(PyObject *ob)
+    {
+        for (PyTypeObject *type = Py_TYPE(ob); type; type = type->tp_base) {
+            if (!PyType_HasFeature(type, Py_TPFLAGS_HEAPTYPE))
+                continue;
+
+            PyObject *module = reinterpret_cast<PyHeapTypeObject *>(type)->ht_module;
+            if (!module || PyModule_GetDef(module) != &pystdcxx_def)
+                continue;
+
+            py_module_state *state = static_cast<py_module_state *>(PyModule_GetState(module));
+            return index() < py_module_state::max_types && state->types[index()] == type;
+        }
+
+        return false;
+    }
+
+    static PyType_Spec *spec()
+    {
+        static std::vector<PyType_Slot> slots = make_slots();
+        static PyType_Spec spec = {
+            .name = tp_name(),
+            .basicsize = sizeof(T),
+            .itemsize = 0,
+            .flags = spec_flags(slots),
+            .slots = slots.data(),
         };
 
-        return &type;
+        return &spec;
     }
 
     static void *allocate(PyTypeObject *type) { return allocate_<T>(type, nullptr); }
     static void free(void *p) { free_<T>(p, nullptr); }
     static PyMethodDef *tp_methods() { return tp_methods_<T>(nullptr); }
-    static PySequenceMethods *tp_as_sequence() { return tp_as_sequence_<T>(nullptr); }
-    static PyMappingMethods *tp_as_mapping() { return tp_as_mapping_<T>(nullptr); }
     static constexpr const char *tp_name() { return tp_name_<T>(nullptr); }
     static constexpr const char *tp_doc() { return tp_doc_<T>(nullptr); }
     static constexpr void (*tp_dealloc())(T *self) { return tp_dealloc_<T>(nullptr); }
@@ -233,58 +541,89 @@ public:
     static constexpr int (*mp_ass_subscript())(T *self, PyObject *key, PyObject *value) { return mp_ass_subscript_<T>(nullptr); }
 
 private:
-    template<typename O>
-    static void *allocate_(PyTypeObject *type, ...) { return PyObject_New(T, type); }
+    static size_t index()
+    {
+        static const size_t value = py_type_next_index();
+        return value;
+    }
 
-    template<typename O>
-    static void *allocate_(PyTypeObject *type, decltype(&O::tp_traverse)) { return PyObject_GC_New(T, type); }
+    // Types without tp_new are only created from C++, like iterators
+    static unsigned int spec_flags(const std::vector<PyType_Slot> &slots)
+    {
+        unsigned int flags = tp_flags();
+        if (std::none_of(slots.begin(), slots.end(), [] (const PyType_Slot &slot) { return slot.slot == Py_tp_new; }))
+            flags |= Py_TPFLAGS_DISALLOW_INSTANTIATION;
+        return flags;
+    }
 
-    template<typename O>
-    static void free_(void *p, ...) { PyObject_Del(p); }
+    static std::vector<PyType_Slot> make_slots()
+    {
+        std::vector<PyType_Slot> slots;
+        auto add = [&slots] (int slot, void *pfunc) {
+            if (pfunc)
+                slots.push_back({ slot, pfunc });
+        };
 
-    template<typename O>
-    static void free_(void *p, decltype(&O::tp_traverse)) { PyObject_GC_Del(p); }
+        add(Py_tp_dealloc, reinterpret_cast<void *>(tp_dealloc()));
+        add(Py_tp_getattr, reinterpret_cast<void *>(tp_getattr()));
+        add(Py_tp_setattr, reinterpret_cast<void *>(tp_setattr()));
+        add(Py_tp_repr, reinterpret_cast<void *>(tp_repr()));
+        add(Py_tp_hash, reinterpret_cast<void *>(tp_hash()));
+        add(Py_tp_call, reinterpret_cast<void *>(tp_call()));
+        add(Py_tp_str, reinterpret_cast<void *>(tp_str()));
+        add(Py_tp_doc, const_cast<char *>(tp_doc()));
+        add(Py_tp_traverse, reinterpret_cast<void *>(tp_traverse()));
+        add(Py_tp_clear, reinterpret_cast<void *>(tp_clear()));
+        add(Py_tp_richcompare, reinterpret_cast<void *>(tp_richcompare()));
+        add(Py_tp_iter, reinterpret_cast<void *>(tp_iter()));
+        add(Py_tp_iternext, reinterpret_cast<void *>(tp_iternext()));
+        add(Py_tp_methods, tp_methods());
+        add(Py_tp_descr_get, reinterpret_cast<void *>(tp_descr_get()));
+        add(Py_tp_descr_set, reinterpret_cast<void *>(tp_descr_set()));
+        add(Py_tp_init, reinterpret_cast<void *>(tp_init()));
+        add(Py_tp_new, reinterpret_cast<void *>(tp_new()));
+        add(Py_sq_length, reinterpret_cast<void *>(sq_length()));
+        add(Py_sq_concat, reinterpret_cast<void *>(sq_concat()));
+        add(Py_sq_repeat, reinterpret_cast<void *>(sq_repeat()));
+        add(Py_sq_item, reinterpret_cast<void *>(sq_item()));
+        add(Py_sq_ass_item, reinterpret_cast<void *>(sq_ass_item()));
+        add(Py_sq_contains, reinterpret_cast<void *>(sq_contains()));
+        add(Py_sq_inplace_concat, reinterpret_cast<void *>(sq_inplace_concat()));
+        add(Py_sq_inplace_repeat, reinterpret_cast<void *>(sq_inplace_repeat()));
+        add(Py_mp_length, reinterpret_cast<void *>(mp_length()));
+        add(Py_mp_subscript, reinterpret_cast<void *>(mp_subscript()));
+        add(Py_mp_ass_subscript, reinterpret_cast<void *>(mp_ass_subscript()));
+        slots.push_back({ 0, nullptr });
+
+        return slots;
+    }
 
-    template<typename O>
-    static PyMethodDef *tp_methods_(...) { return nullptr; }
+    // PyObject_New doesn't zero memory like tp_alloc does, clear the body so
+    // slots appended by Python subclasses (__dict__, __weakref__) start NULL.
+    static void *zero_body(T *p, PyTypeObject *type)
+    {
+        if (p)
+            std::memset(reinterpret_cast<char *>(p) + sizeof(PyObject), 0, type->tp_basicsize - sizeof(PyObject));
+        return p;
+    }
 
     template<typename O>
-    static PyMethodDef *tp_methods_(decltype(&O::tp_methods)) { return O::tp_methods(); }
+    static void *allocate_(PyTypeObject *type, ...) { return zero_body(PyObject_New(T, type), type); }
 
     template<typename O>
-    static PySequenceMethods *tp_as_sequence_(...) { return nullptr; }
+    static void *allocate_(PyTypeObject *type, decltype(&O::tp_traverse)) { return zero_body(PyObject_GC_New(T, type), type); }
 
     template<typename O>
-    static PySequenceMethods *tp_as_sequence_(decltype(&O::sq_item))
-    {
-        static PySequenceMethods methods = {
-            .sq_length = (lenfunc)sq_length(),
-            .sq_concat = (binaryfunc)sq_concat(),
-            .sq_repeat = (ssizeargfunc)sq_repeat(),
-            .sq_item = (ssizeargfunc)sq_item(),
-            .sq_ass_item = (ssizeobjargproc)sq_ass_item(),
-            .sq_contains = (objobjproc)sq_contains(),
-            .sq_inplace_concat = (binaryfunc)sq_inplace_concat(),
-            .sq_inplace_repeat = (ssizeargfunc)sq_inplace_repeat(),
-        };
-
-        return &methods;
-    }
+    static void free_(void *p, ...) { PyObject_Del(p); }
 
     template<typename O>
-    static PyMappingMethods *tp_as_mapping_(...) { return nullptr; }
+    static void free_(void *p, decltype(&O::tp_traverse)) { PyObject_GC_Del(p); }
 
     template<typename O>
-    static PyMappingMethods *tp_as_mapping_(decltype(&O::mp_subscript))
-    {
-        static PyMappingMethods methods = {
-            .mp_length = (lenfunc)mp_length(),
-            .mp_subscript = (binaryfunc)mp_subscript(),
-            .mp_ass_subscript = (objobjargproc)mp_ass_subscript(),
-        };
+    static PyMethodDef *tp_methods_(...) { return nullptr; }
 
-        return &methods;
-    }
+    template<typename O>
+    static PyMethodDef *tp_methods_(decltype(&O::tp_methods)) { return O::tp_methods(); }
 
     template<typename O>
     static constexpr const char *tp_name_(...) { return ""; }
@@ -474,20 +813,19 @@ class py_object
 public:
     typedef py_type<T> this_type;
 
-    void *operator new(std::size_t size)
+    void *operator new(std::size_t size, PyTypeObject *type)
     {
-        void *self = this_type::allocate(this_type::get());
+        void *self = type ? this_type::allocate(type) : nullptr;
         if (!self)
             throw std::bad_alloc();
         return self;
     }
 
-    void *operator new(std::size_t size, PyTypeObject *type)
+    // Allocate an instance of T owned by the same module as related
+    template<typename O>
+    void *operator new(std::size_t size, py_object<O> *related)
     {
-        void *self = this_type::allocate(type);
-        if (!self)
-            throw std::bad_alloc();
-        return self;
+        return operator new(size, this_type::get(related));
     }
 
     void operator delete(void *self)
@@ -495,13 +833,137 @@ public:
         this_type::free(self);
     }
 
+    void operator delete(void *self, PyTypeObject *type)
+    {
+        this_type::free(self);
+    }
+
+    template<typename O>
+    void operator delete(void *self, py_object<O> *related)
+    {
+        this_type::free(self);
+    }
+
+    // Instances of heap types own a reference to their type
     static void tp_dealloc(T *self)
     {
+        PyTypeObject *type = Py_TYPE(reinterpret_cast<PyObject *>(self));
         delete self;
+        Py_DECREF(type);
+    }
+
+    // Containers start untracked like CPython dict and only enter GC once
+    // they hold an object which may form a cycle, so big containers of
+    // ints and strings cost nothing on collections. Instances of Python
+    // subclasses have a __dict__ and are always tracked.
+    void maintain_tracking()
+    {
+        PyObject *self = reinterpret_cast<PyObject *>(this);
+        if (Py_TYPE(self) != this_type::get(this) && !PyObject_GC_IsTracked(self))
+            PyObject_GC_Track(self);
+    }
+
+    void maintain_tracking(PyObject *ob)
+    {
+        PyObject *self = reinterpret_cast<PyObject *>(this);
+        if (ob && !PyObject_GC_IsTracked(self) && py_may_be_tracked(ob))
+            PyObject_GC_Track(self);
     }
 
 protected:
     PyObject_HEAD
 };
 
+// Canonical str and bytes keys shared by the containers of one module
+// created with intern=True. The table holds the only reference to a key
+// once every container dropped it, such keys are swept when the table has
+// doubled since the last sweep, so it never grows beyond twice the keys
+// in use.
+class intern_table: public py_object<intern_table>
+{
+public:
+    enum { min_limit = 1024 };
+
+    intern_table(): table(PyDict_New()), limit(min_limit)
+    {
+        if (!table.get())
+            throw std::bad_alloc();
+        PyObject_GC_Track(this);
+    }
+
+    ~intern_table()
+    {
+        PyObject_GC_UnTrack(this);
+    }
+
+    static const char *tp_name() { return "pystdcxx.intern_table"; }
+    static const char *tp_doc() { return "Table of canonical str and bytes keys"; }
+
+    // Only the type can be part of a cycle, the table holds str and bytes
+    static int tp_traverse(intern_table *self, visitproc visit, void *arg)
+    {
+        Py_VISIT(Py_TYPE(self));
+        return 0;
+    }
+
+    Py_ssize_t size() const { return PyDict_GET_SIZE(table.get()); }
+
+    // Return the canonical object equal to ob so equal keys share one
+    // object. str isn't interned as sys.intern does, such strings are
+    // immortal since Python 3.12 and could never be swept. Other objects,
+    // subclasses included, are returned as they are.
+    py_ptr<PyObject> intern(PyObject *ob)
+    {
+        Py_INCREF(ob);
+        if (PyUnicode_CheckExact(ob) || PyBytes_CheckExact(ob)) {
+            if (size() >= limit)
+                sweep();
+
+            PyObject *canonical = PyDict_SetDefault(table.get(), ob, ob);
+            if (!canonical) {
+                Py_DECREF(ob);
+                throw std::runtime_error("Intern key error");
+            }
+            Py_INCREF(canonical);
+            Py_DECREF(ob);
+            ob = canonical;
+        }
+
+        return py_ptr<PyObject>(ob);
+    }
+
+private:
+    // A key referenced only as key and value of the table is unused
+    void sweep()
+    {
+        std::vector<PyObject *> unused;
+        Py_ssize_t pos = 0;
+        PyObject *key, *value;
+        while (PyDict_Next(table.get(), &pos, &key, &value)) {
+            if (Py_REFCNT(key) == 2)
+                unused.push_back(key);
+        }
+
+        for (PyObject *key: unused) {
+            if (PyDict_DelItem(table.get(), key) < 0)
+                PyErr_Clear();
+        }
+
+        limit = std::max<Py_ssize_t>(size() * 2, min_limit);
+    }
+
+    py_ptr<PyObject> table;
+    Py_ssize_t limit;
+};
+
+// Get the intern table of the stdcxx module which created type of ob
+inline intern_table *py_intern_table(PyObject *ob)
+{
+    PyObject *module = py_module_of(Py_TYPE(ob));
+    if (!module)
+        return nullptr;
+
+    return reinterpret_cast<intern_table *>(static_cast<py_module_state *>(PyModule_GetState(module))->interned);
+}
+
 #endif // PYSTDCXX_UTILS_HPP